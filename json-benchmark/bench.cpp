@@ -0,0 +1,288 @@
+// Parses generated corpora with one of the parsers of this repository and prints a JSON line of
+// results per corpus. The parsers declare clashing global names, so this file is built once per
+// parser with BENCH_PARSER set to 1, 2 or 3.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/resource.h>
+
+#include "corpus.h"
+
+#if BENCH_PARSER == 1
+#include "json.h"
+#elif BENCH_PARSER == 2
+#include "json_exception.h"
+#include "json_parser.h"
+#elif BENCH_PARSER == 3
+#include "json_parser.h"
+#else
+#error "define BENCH_PARSER to 1, 2 or 3"
+#endif
+
+namespace {
+
+size_t g_allocations = 0;
+
+void *CountedAllocate(size_t size) {
+    ++g_allocations;
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *CountedAllocate(size_t size, std::align_val_t align) {
+    ++g_allocations;
+    size_t alignment = static_cast<size_t>(align);
+    if (void *p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+// Every allocation of the process is counted, the parsers' included
+void *operator new(size_t size) {
+    return CountedAllocate(size);
+}
+
+void *operator new[](size_t size) {
+    return CountedAllocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+    return CountedAllocate(size, align);
+}
+
+void *operator new[](size_t size, std::align_val_t align) {
+    return CountedAllocate(size, align);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+// Parses and frees one document. Returns the error message, which is empty on success.
+#if BENCH_PARSER == 1
+constexpr const char *kParserName = "json-parser001";
+// Why the parser is measured only on the basic corpora, or empty when it reads any JSON
+constexpr std::string_view kBasicOnly = "json-parser001 only reads non-negative integers and strings without escaped quotes, "
+                                   "does not unescape strings, and rejects arrays that start with an array or object";
+
+std::string ParseDocument(const std::string &input) {
+    auto [value, error] = json::parse(input);
+    return error;
+}
+#elif BENCH_PARSER == 2
+constexpr const char *kParserName = "json-parser002";
+constexpr std::string_view kBasicOnly;
+
+std::string ParseDocument(const std::string &input) {
+    try {
+        JsonParser parser;
+        std::unique_ptr<JsonValue> value(parser.Parse(input));
+        return "";
+    } catch (const JsonException &e) {
+        return e.what();
+    }
+}
+#else
+constexpr const char *kParserName = "json-parser003";
+constexpr std::string_view kBasicOnly;
+
+std::string ParseDocument(const std::string &input) {
+    JsonValue value;
+    return ParseJson(input, value);
+}
+#endif
+
+struct Options {
+    std::vector<std::string> corpora;
+    size_t size = 4 << 20;
+    double min_time = 1.0;
+    std::string label;
+};
+
+struct Result {
+    std::string error;
+    size_t bytes = 0;
+    size_t documents = 0;
+    size_t allocations = 0;
+    double seconds = 0;
+};
+
+// Parses every document of the corpus once, and returns the error of the first one that fails
+std::string ParseCorpus(const std::vector<std::string> &documents) {
+    for (const std::string &document : documents) {
+        std::string error = ParseDocument(document);
+        if (!error.empty()) {
+            return error;
+        }
+    }
+    return "";
+}
+
+Result Run(const Corpus &corpus, double min_time) {
+    std::vector<std::string> documents;
+    if (corpus.ndjson) {
+        for (size_t begin = 0, end; begin < corpus.text.size(); begin = end + 1) {
+            end = corpus.text.find('\n', begin);
+            if (end == std::string::npos) {
+                end = corpus.text.size();
+            }
+            documents.emplace_back(corpus.text, begin, end - begin);
+        }
+    } else {
+        documents.push_back(corpus.text);
+    }
+
+    // one untimed pass to warm up and check that the parser accepts the corpus
+    Result result;
+    result.error = ParseCorpus(documents);
+    if (!result.error.empty()) {
+        return result;
+    }
+
+    size_t allocations = g_allocations;
+    auto start = std::chrono::steady_clock::now();
+    do {
+        ParseCorpus(documents);
+        result.bytes += corpus.text.size();
+        result.documents += documents.size();
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (result.seconds < min_time);
+    result.allocations = g_allocations - allocations;
+    return result;
+}
+
+void WriteJsonString(std::string_view str) {
+    std::putchar('"');
+    for (char ch : str) {
+        if (ch == '"' || ch == '\\') {
+            std::printf("\\%c", ch);
+        } else if (static_cast<unsigned char>(ch) < 0x20) {
+            std::printf("\\u%04x", ch);
+        } else {
+            std::putchar(ch);
+        }
+    }
+    std::putchar('"');
+}
+
+void Report(const Options &options, const Corpus &corpus, const Result &result) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::printf("{\"parser\":\"%s\",\"corpus\":\"%s\",\"label\":", kParserName, corpus.name.c_str());
+    WriteJsonString(options.label);
+    // the results of a parser on a corpus it is not meant to read say nothing about its speed
+    bool comparable = kBasicOnly.empty() || corpus.basic;
+    std::printf(",\"comparable\":%s", comparable ? "true" : "false");
+    if (!comparable) {
+        std::printf(",\"reason\":");
+        WriteJsonString(kBasicOnly);
+    }
+
+    if (!result.error.empty()) {
+        std::printf(",\"ok\":false,\"error\":");
+        WriteJsonString(result.error.substr(0, 200));
+        std::printf("}\n");
+        return;
+    }
+
+    std::printf(",\"ok\":true,\"bytes\":%zu,\"documents\":%zu,\"seconds\":%.6f,\"mb_per_s\":%.2f,\"docs_per_s\":%.1f,"
+                "\"allocs_per_doc\":%.1f,\"peak_rss_kb\":%ld}\n",
+                result.bytes, result.documents, result.seconds, result.bytes / result.seconds / 1e6,
+                result.documents / result.seconds, static_cast<double>(result.allocations) / result.documents, usage.ru_maxrss);
+}
+
+bool ParseArguments(int argc, char *argv[], Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {
+            return false;
+        }
+
+        std::string value = argv[++i];
+        if (arg == "--corpus") {
+            if (value == "all") {
+                options.corpora = CorpusNames();
+            } else {
+                options.corpora.push_back(value);
+            }
+        } else if (arg == "--size") {
+            options.size = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--min-time") {
+            options.min_time = std::strtod(value.c_str(), nullptr);
+        } else if (arg == "--label") {
+            options.label = value;
+        } else {
+            return false;
+        }
+    }
+
+    if (options.corpora.empty()) {
+        options.corpora = CorpusNames();
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    Options options;
+    if (!ParseArguments(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--corpus NAME|all] [--size BYTES] [--min-time SECONDS] [--label TEXT]\n", argv[0]);
+        return 2;
+    }
+
+    for (const std::string &name : options.corpora) {
+        Corpus corpus;
+        if (!GenerateCorpus(name, options.size, corpus)) {
+            std::fprintf(stderr, "unknown corpus: %s\n", name.c_str());
+            return 2;
+        }
+
+        Report(options, corpus, Run(corpus, options.min_time));
+        std::fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Generators for documents shaped like the usual JSON benchmark files, so the suite needs no
+// downloads. The output depends only on the corpus name and the size, and is ASCII text with \u
+// escapes for everything else.
+//
+// Each corpus also has a basic variant within what json-parser001 reads: non-negative integers,
+// strings without escapes, and arrays of arrays or objects that start with a null, since it rejects
+// an array whose first element is an array or object.
+
+class CorpusRandom {
+  public:
+    explicit CorpusRandom(std::uint64_t seed) : state_(seed) {
+    }
+
+    // splitmix64
+    std::uint64_t Next() {
+        std::uint64_t z = (state_ += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    // In [0, n)
+    std::uint64_t Below(std::uint64_t n) {
+        return Next() % n;
+    }
+
+    // In [low, high)
+    double Uniform(double low, double high) {
+        return low + (high - low) * static_cast<double>(Next() >> 11) / static_cast<double>(std::uint64_t(1) << 53);
+    }
+
+  private:
+    std::uint64_t state_;
+};
+
+inline void _AppendNumber(std::string &out, double value, int precision) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.*g", precision, value);
+    out += buf;
+}
+
+// Degrees as a double, or when basic as an integer count of 10^-12 degrees from -180
+inline void _AppendCoordinate(std::string &out, double degrees, bool basic) {
+    if (basic) {
+        out += std::to_string(static_cast<std::uint64_t>((degrees + 180) * 1e12));
+    } else {
+        _AppendNumber(out, degrees, 17);
+    }
+}
+
+inline void _AppendWords(std::string &out, CorpusRandom &random, int count) {
+    static const char *const words[] = {"the", "json", "parser", "benchmark", "catalog", "event", "stream", "value",
+                                        "tokyo", "river", "quick", "number", "string", "object", "array", "nested"};
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) {
+            out += ' ';
+        }
+        out += words[random.Below(sizeof(words) / sizeof(words[0]))];
+    }
+}
+
+// Starts the next element of an array of arrays or objects
+inline void _AppendContainerSeparator(std::string &out, bool first, bool basic) {
+    if (first) {
+        out += basic ? "null," : "";
+    } else {
+        out += ',';
+    }
+}
+
+// Mostly ASCII words, with escaped quotes, newlines and non-ASCII code points mixed in unless basic
+inline void _AppendText(std::string &out, CorpusRandom &random, int words, bool basic) {
+    static const char *const escapes[] = {"\\n", "\\\"", "\\u3042", "\\u00e9", "\\\\", "\\t", "\\u540d\\u524d"};
+    out += '"';
+    for (int i = 0; i < words; ++i) {
+        if (i > 0) {
+            out += ' ';
+        }
+        if (random.Below(6) == 0 && !basic) {
+            out += escapes[random.Below(sizeof(escapes) / sizeof(escapes[0]))];
+        } else {
+            _AppendWords(out, random, 1);
+        }
+    }
+    out += '"';
+}
+
+// Search results of statuses with nested users and entities, like twitter.json
+inline std::string GenerateTwitter(size_t size, bool basic) {
+    CorpusRandom random(1);
+    std::string out = "{\"statuses\":[";
+    std::uint64_t id = 505874924095815681;
+    for (int n = 0; out.size() < size; ++n) {
+        _AppendContainerSeparator(out, n == 0, basic);
+
+        id += random.Below(1000000);
+        std::string id_text = std::to_string(id);
+        std::uint64_t user_id = 1000000 + random.Below(3000000000);
+        out += "{\"created_at\":\"Sun Aug 31 00:29:15 +0000 2014\",\"id\":" + id_text + ",\"id_str\":\"" + id_text + "\",\"text\":";
+        _AppendText(out, random, 12 + static_cast<int>(random.Below(20)), basic);
+        if (basic) {
+            out += ",\"source\":\"<a href='http://twitter.com/download/iphone' rel='nofollow'>Twitter for iPhone</a>\"";
+        } else {
+            out += ",\"source\":\"<a href=\\\"http://twitter.com/download/iphone\\\" rel=\\\"nofollow\\\">Twitter for iPhone</a>\"";
+        }
+        out += ",\"truncated\":false,\"in_reply_to_status_id\":null,\"user\":{\"id\":" + std::to_string(user_id);
+        out += ",\"name\":";
+        _AppendText(out, random, 2, basic);
+        out += ",\"screen_name\":\"user" + std::to_string(user_id % 100000) + "\",\"location\":";
+        _AppendText(out, random, 1, basic);
+        out += ",\"description\":";
+        _AppendText(out, random, 8 + static_cast<int>(random.Below(16)), basic);
+        out += ",\"url\":null,\"protected\":false,\"followers_count\":" + std::to_string(random.Below(100000));
+        out += ",\"friends_count\":" + std::to_string(random.Below(5000));
+        out += ",\"utc_offset\":" + (random.Below(2) == 0 ? std::string("null") : std::to_string(3600 * random.Below(12)));
+        out += ",\"verified\":" + std::string(random.Below(10) == 0 ? "true" : "false");
+        out += ",\"lang\":\"ja\",\"profile_background_color\":\"C0DEED\"},\"geo\":null,\"coordinates\":null";
+        out += ",\"retweet_count\":" + std::to_string(random.Below(100)) + ",\"favorite_count\":" + std::to_string(random.Below(100));
+        out += ",\"entities\":{\"hashtags\":[],\"symbols\":[],\"urls\":[],\"user_mentions\":[";
+        int mentions = static_cast<int>(random.Below(3));
+        for (int i = 0; i < mentions; ++i) {
+            std::string mention_id = std::to_string(1000000 + random.Below(3000000000));
+            _AppendContainerSeparator(out, i == 0, basic);
+            out += "{\"screen_name\":\"someone\",\"id\":" + mention_id + ",\"id_str\":\"" + mention_id + "\",\"indices\":[0,9]}";
+        }
+        out += "]},\"favorited\":false,\"retweeted\":false,\"lang\":\"ja\"}";
+    }
+    out += "],\"search_metadata\":{\"completed_in\":" + std::string(basic ? "87" : "0.087") + ",\"max_id\":" + std::to_string(id) +
+           ",\"count\":100}}";
+    return out;
+}
+
+// A GeoJSON polygon with long rings of coordinate pairs, like canada.json
+inline std::string GenerateCanada(size_t size, bool basic) {
+    CorpusRandom random(2);
+    std::string out = "{\"type\":\"FeatureCollection\",\"features\":[";
+    _AppendContainerSeparator(out, true, basic);
+    out += "{\"type\":\"Feature\",\"properties\":{\"name\":\"Canada\"},\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[";
+    for (int ring = 0; out.size() < size; ++ring) {
+        _AppendContainerSeparator(out, ring == 0, basic);
+        out += '[';
+        double lon = random.Uniform(-140, -50);
+        double lat = random.Uniform(42, 83);
+        for (int i = 0; i < 1000 && out.size() < size; ++i) {
+            lon += random.Uniform(-0.01, 0.01);
+            lat += random.Uniform(-0.01, 0.01);
+            _AppendContainerSeparator(out, i == 0, basic);
+            out += '[';
+            _AppendCoordinate(out, lon, basic);
+            out += ',';
+            _AppendCoordinate(out, lat, basic);
+            out += ']';
+        }
+        out += ']';
+    }
+    out += "]}}]}";
+    return out;
+}
+
+// A catalog of events keyed by id and performances with prices and seat maps, like citm_catalog.json
+inline std::string GenerateCitm(size_t size, bool basic) {
+    CorpusRandom random(3);
+    std::string first = basic ? "null," : "";
+    std::string events = "{";
+    std::string performances = "[";
+    std::uint64_t id = 138586341;
+    for (int n = 0; events.size() + performances.size() < size; ++n) {
+        id += 1 + random.Below(1000);
+        std::string id_text = std::to_string(id);
+        events += std::string(n > 0 ? "," : "") + "\"" + id_text + "\":{\"description\":null,\"id\":" + id_text +
+                  ",\"logo\":\"/images/UE0AAAAACEKo6QAAAAZDSVRN\",\"name\":";
+        _AppendText(events, random, 3, basic);
+        events += ",\"subTopicIds\":[337184269,337184283],\"subjectCode\":null,\"subtitle\":null,\"topicIds\":[324846099,107888604]}";
+
+        int count = 1 + static_cast<int>(random.Below(4));
+        for (int i = 0; i < count; ++i) {
+            _AppendContainerSeparator(performances, n == 0 && i == 0, basic);
+            performances += "{\"eventId\":" + id_text + ",\"id\":" + std::to_string(339887544 + random.Below(1000000)) +
+                            ",\"logo\":null,\"name\":null,\"prices\":[";
+            int prices = 1 + static_cast<int>(random.Below(3));
+            for (int j = 0; j < prices; ++j) {
+                _AppendContainerSeparator(performances, j == 0, basic);
+                performances += "{\"amount\":" + std::to_string(10000 + random.Below(90000)) +
+                                ",\"audienceSubCategoryId\":337100890,\"seatCategoryId\":338937295}";
+            }
+            performances += "],\"seatCategories\":[" + first + "{\"areas\":[" + first +
+                            "{\"areaId\":205705999,\"blockIds\":[]},{\"areaId\":205705998,\"blockIds\":[]}],"
+                            "\"seatCategoryId\":338937295}],\"seatMapImage\":null,\"start\":" +
+                            std::to_string(1372701600000 + 86400000 * random.Below(365)) + ",\"venueCode\":\"PLEYEL_PLEYEL\"}";
+        }
+    }
+    return "{\"areaNames\":{\"205705993\":\"Arriere-scene central\",\"205705994\":\"1er balcon central\"},\"events\":" + events +
+           "},\"performances\":" + performances + "]}";
+}
+
+// Many small values each nested 90 arrays and objects deep, within the default depth limit of every parser
+inline std::string GenerateDeep(size_t size, bool basic) {
+    CorpusRandom random(4);
+    std::string out = "[";
+    for (int n = 0; out.size() < size; ++n) {
+        _AppendContainerSeparator(out, n == 0, basic);
+        for (int i = 0; i < 45; ++i) {
+            out += "{\"k\":[";
+            if (i < 44) {
+                _AppendContainerSeparator(out, true, basic);
+            }
+        }
+        out += std::to_string(random.Below(1000));
+        for (int i = 0; i < 45; ++i) {
+            out += "]}";
+        }
+    }
+    out += ']';
+    return out;
+}
+
+// One log record per line with long, escape-heavy strings
+inline std::string GenerateNdjsonStrings(size_t size, bool basic) {
+    CorpusRandom random(5);
+    std::string out;
+    for (int n = 0; out.size() < size; ++n) {
+        out += "{\"id\":" + std::to_string(n) + ",\"level\":\"info\",\"message\":";
+        _AppendText(out, random, 20 + static_cast<int>(random.Below(40)), basic);
+        out += basic ? ",\"path\":\"/var/log/app/service.log\",\"tags\":[" : ",\"path\":\"/var/log/app\\/service.log\",\"tags\":[";
+        _AppendText(out, random, 1, basic);
+        out += ',';
+        _AppendText(out, random, 1, basic);
+        out += "],\"body\":";
+        _AppendText(out, random, 60 + static_cast<int>(random.Below(60)), basic);
+        out += "}\n";
+    }
+    return out;
+}
+
+struct Corpus {
+    std::string name;
+    std::string text;
+    // The text is one document per line instead of one document
+    bool ndjson;
+    // The basic variant, which every parser reads
+    bool basic;
+};
+
+inline const std::vector<std::string> &CorpusNames() {
+    static const std::vector<std::string> names = {"twitter",       "canada",       "citm",       "deep",       "ndjson_strings",
+                                                   "twitter_basic", "canada_basic", "citm_basic", "deep_basic", "ndjson_strings_basic"};
+    return names;
+}
+
+// Returns false for an unknown name. A name ending in _basic is the basic variant of a corpus.
+inline bool GenerateCorpus(const std::string &name, size_t size, Corpus &corpus) {
+    static const std::string basic_suffix = "_basic";
+    std::string base = name;
+    corpus.name = name;
+    corpus.ndjson = false;
+    corpus.basic = base.size() > basic_suffix.size() &&
+                   base.compare(base.size() - basic_suffix.size(), basic_suffix.size(), basic_suffix) == 0;
+    if (corpus.basic) {
+        base.resize(base.size() - basic_suffix.size());
+    }
+
+    if (base == "twitter") {
+        corpus.text = GenerateTwitter(size, corpus.basic);
+    } else if (base == "canada") {
+        corpus.text = GenerateCanada(size, corpus.basic);
+    } else if (base == "citm") {
+        corpus.text = GenerateCitm(size, corpus.basic);
+    } else if (base == "deep") {
+        corpus.text = GenerateDeep(size, corpus.basic);
+    } else if (base == "ndjson_strings") {
+        corpus.text = GenerateNdjsonStrings(size, corpus.basic);
+        corpus.ndjson = true;
+    } else {
+        return false;
+    }
+    return true;
+}
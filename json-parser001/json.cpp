@@ -180,7 +180,7 @@ std::tuple<std::vector<JsonToken>, std::string> lex(const std::string &raw_json)
         } else if (c == '"') {
             auto [token, new_index, error] = lex_string(raw_json, i);
             if (!error.empty()) {
-                return {{}, format_error("failed to lex string: " + error, i)};
+                return {std::vector<JsonToken>(), format_error("failed to lex string: " + error, i)};
             }
 
             tokens.push_back(token);
@@ -189,7 +189,7 @@ std::tuple<std::vector<JsonToken>, std::string> lex(const std::string &raw_json)
         } else if (c >= '0' && c <= '9') {
             auto [token, new_index, error] = lex_number(raw_json, i);
             if (!error.empty()) {
-                return {{}, format_error("failed to lex number: " + error, i)};
+                return {std::vector<JsonToken>(), format_error("failed to lex number: " + error, i)};
             }
 
             tokens.push_back(token);
@@ -197,7 +197,7 @@ std::tuple<std::vector<JsonToken>, std::string> lex(const std::string &raw_json)
             continue;
         } else if (c == 'n') {
             if (!match_keyword(raw_json, i, "null")) {
-                return {{}, format_error("found unknown literal", i)};
+                return {std::vector<JsonToken>(), format_error("found unknown literal", i)};
             }
 
             tokens.push_back({"null", JsonTokenType::kNull, i});
@@ -205,7 +205,7 @@ std::tuple<std::vector<JsonToken>, std::string> lex(const std::string &raw_json)
             continue;
         } else if (c == 't') {
             if (!match_keyword(raw_json, i, "true")) {
-                return {{}, format_error("found unknown literal", i)};
+                return {std::vector<JsonToken>(), format_error("found unknown literal", i)};
             }
 
             tokens.push_back({"true", JsonTokenType::kBoolean, i});
@@ -213,7 +213,7 @@ std::tuple<std::vector<JsonToken>, std::string> lex(const std::string &raw_json)
             continue;
         } else if (c == 'f') {
             if (!match_keyword(raw_json, i, "false")) {
-                return {{}, format_error("found unknown literal", i)};
+                return {std::vector<JsonToken>(), format_error("found unknown literal", i)};
             }
 
             tokens.push_back({"false", JsonTokenType::kBoolean, i});
@@ -221,7 +221,7 @@ std::tuple<std::vector<JsonToken>, std::string> lex(const std::string &raw_json)
             continue;
         }
 
-        return {{}, format_error("found unknown error", i)};
+        return {std::vector<JsonToken>(), format_error("found unknown error", i)};
     }
 
     return {tokens, ""};
@@ -265,7 +265,7 @@ std::tuple<JsonValue, size_t, std::string> parse(std::vector<JsonToken> &tokens,
 std::tuple<JsonValue, std::string> parse(const std::string &input) {
     auto [tokens, error] = lex(input);
     if (!error.empty()) {
-        return {{}, error};
+        return {JsonValue(), error};
     }
 
     auto [value, _, parse_error] = parse(tokens);
@@ -1,5 +1,7 @@
 #include "json_array.h"
 
+#include <cstddef>
+
 JsonArray::JsonArray(std::vector<JsonValue *> value) : JsonValue(JsonType::kArray), value_(std::move(value)) {
 }
 
@@ -1,11 +1,22 @@
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <string_view>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utf8_validator.h"
 
 template <typename Iter>
 class InputSource {
   public:
-    InputSource(const Iter &current, const Iter &end) : current_(current), end_(end), consumed_(false), line_(1) {
+    InputSource(const Iter &current, const Iter &end)
+        : current_(current), end_(end), consumed_(false), line_(1), offset_(0), validate_utf8_(false),
+          invalid_utf8_(NO_OFFSET) {
     }
 
     int GetChar() {
@@ -15,6 +26,7 @@ class InputSource {
             }
 
             ++current_;
+            ++offset_;
         }
 
         if (current_ == end_) {
@@ -34,6 +46,7 @@ class InputSource {
         if (consumed_) {
             consumed_ = false;
             ++current_;
+            ++offset_;
         }
 
         return current_;
@@ -43,6 +56,11 @@ class InputSource {
         return line_;
     }
 
+    // Bytes read before the current one; like the line, a consumed character counts as current
+    size_t Offset() const noexcept {
+        return offset_;
+    }
+
     void SkipWhiteSpace() {
         while (true) {
             int ch = GetChar();
@@ -63,6 +81,15 @@ class InputSource {
         return true;
     }
 
+    // Sources that can see ahead append a run of plain string characters here; this one reads byte by byte.
+    void ReadStringRun(std::string &) {
+    }
+
+    // Contiguous sources return the rest of a string that needs no unescaping without copying it
+    bool ReadPlainString(std::string_view &) {
+        return false;
+    }
+
     bool Match(const std::string &pattern) {
         for (auto it = pattern.cbegin(); it != pattern.cend(); ++it) {
             if (GetChar() != static_cast<int>(*it)) {
@@ -74,11 +101,202 @@ class InputSource {
         return true;
     }
 
+    // Strings are checked to be valid UTF-8 while they are read
+    void SetValidateUtf8(bool validate) noexcept {
+        validate_utf8_ = validate;
+    }
+
+    bool ValidatesUtf8() const noexcept {
+        return validate_utf8_;
+    }
+
+    // The offset of the invalid UTF-8 sequence a string was rejected for, or NO_OFFSET
+    size_t InvalidUtf8Offset() const noexcept {
+        return invalid_utf8_;
+    }
+
+    void SetInvalidUtf8Offset(size_t offset) noexcept {
+        invalid_utf8_ = offset;
+    }
+
     static constexpr int END_OF_INPUT = -1;
+    static constexpr size_t NO_OFFSET = static_cast<size_t>(-1);
 
   private:
     Iter current_;
     Iter end_;
     bool consumed_;
     int line_;
-};
\ No newline at end of file
+    size_t offset_;
+    bool validate_utf8_;
+    size_t invalid_utf8_;
+};
+
+// Returns the first byte in [p, end) that ends a run of plain string characters: a quote, a
+// backslash or a control character.
+inline const char *_ScanPlainString(const char *p, const char *end) {
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control_max = _mm_set1_epi8(0x1f);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                       _mm_cmpeq_epi8(_mm_max_epu8(v, control_max), control_max));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+
+    while (p != end && *p != '"' && *p != '\\' && static_cast<unsigned char>(*p) >= ' ') {
+        ++p;
+    }
+
+    return p;
+}
+
+// Contiguous input. The cursor is a plain pointer, whitespace and plain string runs are consumed in
+// bulk, and the line number is only counted when it is asked for.
+template <>
+class InputSource<const char *> {
+  public:
+    InputSource(const char *current, const char *end)
+        : begin_(current), current_(current), end_(end), consumed_(false), validate_utf8_(false), invalid_utf8_(NO_OFFSET) {
+    }
+
+    int GetChar() {
+        if (current_ == end_) {
+            consumed_ = false;
+            return END_OF_INPUT;
+        }
+
+        consumed_ = true;
+        return *current_++ & 0xff;
+    }
+
+    void UnGetChar() {
+        if (consumed_) {
+            consumed_ = false;
+            --current_;
+        }
+    }
+
+    const char *Current() {
+        consumed_ = false;
+        return current_;
+    }
+
+    // Like Current, without giving up the right to UnGetChar
+    const char *Position() const noexcept {
+        return current_;
+    }
+
+    // a consumed character only counts once the next one is read, as in the generic source
+    int Line() const noexcept {
+        const char *last = consumed_ ? current_ - 1 : current_;
+        return 1 + static_cast<int>(std::count(begin_, last, '\n'));
+    }
+
+    size_t Offset() const noexcept {
+        return static_cast<size_t>((consumed_ ? current_ - 1 : current_) - begin_);
+    }
+
+    void SkipWhiteSpace() {
+        consumed_ = false;
+
+        // indentation of pretty printed documents
+        while (end_ - current_ >= 8 && std::memcmp(current_, "        ", 8) == 0) {
+            current_ += 8;
+        }
+
+        while (current_ != end_ && (*current_ == ' ' || *current_ == '\t' || *current_ == '\n' || *current_ == '\r')) {
+            ++current_;
+        }
+    }
+
+    bool Expect(int expected) {
+        SkipWhiteSpace();
+        if (GetChar() != expected) {
+            UnGetChar();
+            return false;
+        }
+
+        return true;
+    }
+
+    void ReadStringRun(std::string &out) {
+        _ReadStringRun(end_, out);
+    }
+
+    bool ReadPlainString(std::string_view &out) {
+        return _ReadPlainString(end_, out);
+    }
+
+    bool Match(const std::string &pattern) {
+        for (auto it = pattern.cbegin(); it != pattern.cend(); ++it) {
+            if (GetChar() != static_cast<int>(*it)) {
+                UnGetChar();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Strings are checked to be valid UTF-8 while they are read. A run of plain characters is checked
+    // in bulk and stops before an invalid sequence, which _ParseString then rejects.
+    void SetValidateUtf8(bool validate) noexcept {
+        validate_utf8_ = validate;
+    }
+
+    bool ValidatesUtf8() const noexcept {
+        return validate_utf8_;
+    }
+
+    size_t InvalidUtf8Offset() const noexcept {
+        return invalid_utf8_;
+    }
+
+    void SetInvalidUtf8Offset(size_t offset) noexcept {
+        invalid_utf8_ = offset;
+    }
+
+    static constexpr int END_OF_INPUT = -1;
+    static constexpr size_t NO_OFFSET = static_cast<size_t>(-1);
+
+  protected:
+    // Appends the plain string characters before limit
+    void _ReadStringRun(const char *limit, std::string &out) {
+        consumed_ = false;
+
+        const char *p = _ScanPlainString(current_, limit);
+        if (validate_utf8_) {
+            p = _FindInvalidUtf8(current_, p);
+        }
+        out.append(current_, p);
+        current_ = p;
+    }
+
+    // Consumes the string body and its closing quote when the body, which ends before limit, has no escapes
+    bool _ReadPlainString(const char *limit, std::string_view &out) {
+        consumed_ = false;
+
+        const char *p = _ScanPlainString(current_, limit);
+        if (p == end_ || *p != '"' || (validate_utf8_ && _FindInvalidUtf8(current_, p) != p)) {
+            return false;
+        }
+
+        out = std::string_view(current_, static_cast<size_t>(p - current_));
+        current_ = p + 1;
+        return true;
+    }
+
+    const char *begin_;
+    const char *current_;
+    const char *end_;
+    bool consumed_;
+    bool validate_utf8_;
+    size_t invalid_utf8_;
+};
@@ -0,0 +1,844 @@
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_parser.h"
+#include "json_writer.h"
+#include "utf8_validator.h"
+
+// Binary encodings of JsonValue: CBOR (RFC 8949) and MessagePack. Integers are written as integers
+// and numbers as floats, so a value reads back with the same kInteger and kNumber types. Integers
+// too large for int64 read back as numbers, as they do from JSON.
+//
+// JsonValue has no binary type, so byte strings (CBOR major type 2, MessagePack bin) read back as
+// strings. With ParseOptions::borrow_strings, text and byte strings point into the input instead of
+// being copied. CBOR tags are skipped and their content is read.
+
+template <typename Sink>
+inline void _WriteBigEndian(std::uint64_t value, int size, Sink &sink) {
+    char buf[8];
+    for (int i = size - 1; i >= 0; --i) {
+        buf[i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+    sink.Write(buf, static_cast<size_t>(size));
+}
+
+// Whether a double converts to float and back unchanged, so it can be written in four bytes
+inline bool _FitsInFloat(double value) {
+    if (std::isnan(value) || std::isinf(value)) {
+        return true;
+    }
+    return std::fabs(value) <= FLT_MAX && static_cast<double>(static_cast<float>(value)) == value;
+}
+
+inline std::uint32_t _FloatBits(double value) {
+    float f = static_cast<float>(value);
+    std::uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+inline std::uint64_t _DoubleBits(double value) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// The initial byte of a CBOR item and the shortest encoding of its argument
+template <typename Sink>
+inline void _WriteCborHead(int major, std::uint64_t argument, Sink &sink) {
+    char initial = static_cast<char>(major << 5);
+    if (argument < 24) {
+        sink.Put(static_cast<char>(initial | argument));
+    } else if (argument <= 0xff) {
+        sink.Put(static_cast<char>(initial | 24));
+        _WriteBigEndian(argument, 1, sink);
+    } else if (argument <= 0xffff) {
+        sink.Put(static_cast<char>(initial | 25));
+        _WriteBigEndian(argument, 2, sink);
+    } else if (argument <= 0xffffffff) {
+        sink.Put(static_cast<char>(initial | 26));
+        _WriteBigEndian(argument, 4, sink);
+    } else {
+        sink.Put(static_cast<char>(initial | 27));
+        _WriteBigEndian(argument, 8, sink);
+    }
+}
+
+template <typename Sink>
+inline void _WriteCborString(std::string_view str, Sink &sink) {
+    _WriteCborHead(3, str.size(), sink);
+    sink.Write(str.data(), str.size());
+}
+
+// Calls write for value and then for its elements and members in document order, and write_key before
+// each member. Both encodings give the size of an array or object up front and have nothing after it,
+// so nested ones are walked from a stack instead of recursively.
+template <typename Write, typename WriteKey>
+inline void _WriteBinary(const JsonValue &root, Write write, WriteKey write_key) {
+    std::vector<_WriteFrame> stack;
+    const JsonValue *value = &root;
+    while (value != nullptr) {
+        write(*value);
+        if (value->IsArray()) {
+            stack.push_back({value, value->Get<JsonArray>().begin(), JsonObject::const_iterator()});
+        } else if (value->IsObject()) {
+            stack.push_back({value, JsonArray::const_iterator(), value->Get<JsonObject>().begin()});
+        }
+
+        value = nullptr;
+        while (value == nullptr && !stack.empty()) {
+            _WriteFrame &frame = stack.back();
+            if (frame.value->IsArray() && frame.element != frame.value->Get<JsonArray>().end()) {
+                value = &*frame.element++;
+            } else if (frame.value->IsObject() && frame.member != frame.value->Get<JsonObject>().end()) {
+                write_key(frame.member->first);
+                value = &frame.member->second;
+                ++frame.member;
+            } else {
+                stack.pop_back();
+            }
+        }
+    }
+}
+
+// A scalar, or the head of an array or object
+template <typename Sink>
+inline void _WriteCborItem(const JsonValue &value, Sink &sink) {
+    switch (value.Type()) {
+    case JsonType::kNull:
+        sink.Put(static_cast<char>(0xf6));
+        break;
+    case JsonType::kBoolean:
+        sink.Put(static_cast<char>(value.Get<bool>() ? 0xf5 : 0xf4));
+        break;
+    case JsonType::kInteger: {
+        std::int64_t n = value.Get<std::int64_t>();
+        if (n >= 0) {
+            _WriteCborHead(0, static_cast<std::uint64_t>(n), sink);
+        } else {
+            // major type 1 holds -1 - n
+            _WriteCborHead(1, ~static_cast<std::uint64_t>(n), sink);
+        }
+        break;
+    }
+    case JsonType::kNumber: {
+        double d = value.Get<double>();
+        if (_FitsInFloat(d)) {
+            sink.Put(static_cast<char>(0xfa));
+            _WriteBigEndian(_FloatBits(d), 4, sink);
+        } else {
+            sink.Put(static_cast<char>(0xfb));
+            _WriteBigEndian(_DoubleBits(d), 8, sink);
+        }
+        break;
+    }
+    case JsonType::kString:
+        _WriteCborString(value.GetStringView(), sink);
+        break;
+    case JsonType::kArray:
+        _WriteCborHead(4, value.Get<JsonArray>().size(), sink);
+        break;
+    case JsonType::kObject:
+        _WriteCborHead(5, value.Get<JsonObject>().size(), sink);
+        break;
+    }
+}
+
+template <typename Sink>
+inline void _WriteCbor(const JsonValue &value, Sink &sink) {
+    _WriteBinary(value, [&sink](const JsonValue &item) { _WriteCborItem(item, sink); },
+                 [&sink](std::string_view key) { _WriteCborString(key, sink); });
+}
+
+// Prefix byte followed by the size in 1, 2 or 4 bytes, as MessagePack strings, arrays and maps have
+template <typename Sink>
+inline void _WriteMessagePackSize(size_t size, int prefix8, int prefix16, int prefix32, Sink &sink) {
+    if (size <= 0xff && prefix8 != 0) {
+        sink.Put(static_cast<char>(prefix8));
+        _WriteBigEndian(size, 1, sink);
+    } else if (size <= 0xffff) {
+        sink.Put(static_cast<char>(prefix16));
+        _WriteBigEndian(size, 2, sink);
+    } else {
+        sink.Put(static_cast<char>(prefix32));
+        _WriteBigEndian(size, 4, sink);
+    }
+}
+
+template <typename Sink>
+inline void _WriteMessagePackString(std::string_view str, Sink &sink) {
+    if (str.size() < 32) {
+        sink.Put(static_cast<char>(0xa0 | str.size()));
+    } else {
+        _WriteMessagePackSize(str.size(), 0xd9, 0xda, 0xdb, sink);
+    }
+    sink.Write(str.data(), str.size());
+}
+
+template <typename Sink>
+inline void _WriteMessagePackInteger(std::int64_t n, Sink &sink) {
+    if (n >= 0) {
+        std::uint64_t u = static_cast<std::uint64_t>(n);
+        if (u < 0x80) {
+            sink.Put(static_cast<char>(u));
+        } else if (u <= 0xff) {
+            sink.Put(static_cast<char>(0xcc));
+            _WriteBigEndian(u, 1, sink);
+        } else if (u <= 0xffff) {
+            sink.Put(static_cast<char>(0xcd));
+            _WriteBigEndian(u, 2, sink);
+        } else if (u <= 0xffffffff) {
+            sink.Put(static_cast<char>(0xce));
+            _WriteBigEndian(u, 4, sink);
+        } else {
+            sink.Put(static_cast<char>(0xcf));
+            _WriteBigEndian(u, 8, sink);
+        }
+        return;
+    }
+
+    std::uint64_t u = static_cast<std::uint64_t>(n);
+    if (n >= -32) {
+        sink.Put(static_cast<char>(u));
+    } else if (n >= std::numeric_limits<std::int8_t>::min()) {
+        sink.Put(static_cast<char>(0xd0));
+        _WriteBigEndian(u, 1, sink);
+    } else if (n >= std::numeric_limits<std::int16_t>::min()) {
+        sink.Put(static_cast<char>(0xd1));
+        _WriteBigEndian(u, 2, sink);
+    } else if (n >= std::numeric_limits<std::int32_t>::min()) {
+        sink.Put(static_cast<char>(0xd2));
+        _WriteBigEndian(u, 4, sink);
+    } else {
+        sink.Put(static_cast<char>(0xd3));
+        _WriteBigEndian(u, 8, sink);
+    }
+}
+
+// A scalar, or the head of an array or object
+template <typename Sink>
+inline void _WriteMessagePackItem(const JsonValue &value, Sink &sink) {
+    switch (value.Type()) {
+    case JsonType::kNull:
+        sink.Put(static_cast<char>(0xc0));
+        break;
+    case JsonType::kBoolean:
+        sink.Put(static_cast<char>(value.Get<bool>() ? 0xc3 : 0xc2));
+        break;
+    case JsonType::kInteger:
+        _WriteMessagePackInteger(value.Get<std::int64_t>(), sink);
+        break;
+    case JsonType::kNumber: {
+        double d = value.Get<double>();
+        if (_FitsInFloat(d)) {
+            sink.Put(static_cast<char>(0xca));
+            _WriteBigEndian(_FloatBits(d), 4, sink);
+        } else {
+            sink.Put(static_cast<char>(0xcb));
+            _WriteBigEndian(_DoubleBits(d), 8, sink);
+        }
+        break;
+    }
+    case JsonType::kString:
+        _WriteMessagePackString(value.GetStringView(), sink);
+        break;
+    case JsonType::kArray: {
+        const JsonArray &array = value.Get<JsonArray>();
+        if (array.size() < 16) {
+            sink.Put(static_cast<char>(0x90 | array.size()));
+        } else {
+            _WriteMessagePackSize(array.size(), 0, 0xdc, 0xdd, sink);
+        }
+        break;
+    }
+    case JsonType::kObject: {
+        const JsonObject &object = value.Get<JsonObject>();
+        if (object.size() < 16) {
+            sink.Put(static_cast<char>(0x80 | object.size()));
+        } else {
+            _WriteMessagePackSize(object.size(), 0, 0xde, 0xdf, sink);
+        }
+        break;
+    }
+    }
+}
+
+template <typename Sink>
+inline void _WriteMessagePack(const JsonValue &value, Sink &sink) {
+    _WriteBinary(value, [&sink](const JsonValue &item) { _WriteMessagePackItem(item, sink); },
+                 [&sink](std::string_view key) { _WriteMessagePackString(key, sink); });
+}
+
+// The second parameter is only taken as a sink when it has Put()
+template <typename Sink, typename = decltype(std::declval<Sink &>().Put(' '))>
+void WriteCbor(const JsonValue &value, Sink &sink) {
+    _WriteCbor(value, sink);
+}
+
+inline std::string WriteCbor(const JsonValue &value) {
+    std::string out;
+    StringSink sink(out);
+    _WriteCbor(value, sink);
+    return out;
+}
+
+template <typename Sink, typename = decltype(std::declval<Sink &>().Put(' '))>
+void WriteMessagePack(const JsonValue &value, Sink &sink) {
+    _WriteMessagePack(value, sink);
+}
+
+inline std::string WriteMessagePack(const JsonValue &value) {
+    std::string out;
+    StringSink sink(out);
+    _WriteMessagePack(value, sink);
+    return out;
+}
+
+// Bytes of a binary encoding being decoded
+class _BinaryInput {
+  public:
+    _BinaryInput(const char *begin, const char *end) : begin_(begin), current_(begin), end_(end) {
+    }
+
+    // Points data at the next size bytes and moves past them
+    bool Read(size_t size, const char *&data) {
+        if (size > static_cast<size_t>(end_ - current_)) {
+            return false;
+        }
+
+        data = current_;
+        current_ += size;
+        return true;
+    }
+
+    bool ReadBigEndian(int size, std::uint64_t &value) {
+        const char *data;
+        if (!Read(static_cast<size_t>(size), data)) {
+            return false;
+        }
+
+        value = 0;
+        for (int i = 0; i < size; ++i) {
+            value = (value << 8) | static_cast<std::uint8_t>(data[i]);
+        }
+        return true;
+    }
+
+    int Peek() const noexcept {
+        return current_ == end_ ? -1 : static_cast<std::uint8_t>(*current_);
+    }
+
+    size_t Remaining() const noexcept {
+        return static_cast<size_t>(end_ - current_);
+    }
+
+    size_t Offset() const noexcept {
+        return static_cast<size_t>(current_ - begin_);
+    }
+
+    const char *Current() const noexcept {
+        return current_;
+    }
+
+  private:
+    const char *begin_;
+    const char *current_;
+    const char *end_;
+};
+
+// One decoded item: a scalar, a string, or the head of an array or object
+struct _BinaryItem {
+    JsonType type;
+    // Byte strings are not checked for UTF-8
+    bool is_bytes;
+    // The string was joined from chunks into the scratch buffer, so it cannot be borrowed
+    bool in_scratch;
+    // Arrays and objects of unknown size end with a break
+    bool indefinite;
+    bool boolean;
+    std::int64_t integer;
+    double number;
+    std::string_view string;
+    size_t size;
+};
+
+inline void _SetBinaryUnsigned(std::uint64_t value, _BinaryItem &item) {
+    if (value <= static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) {
+        item.type = JsonType::kInteger;
+        item.integer = static_cast<std::int64_t>(value);
+    } else {
+        item.type = JsonType::kNumber;
+        item.number = static_cast<double>(value);
+    }
+}
+
+inline double _HalfToDouble(std::uint16_t half) {
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double value;
+    if (exponent == 0) {
+        value = std::ldexp(mantissa, -24);
+    } else if (exponent == 31) {
+        value = mantissa == 0 ? std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+    } else {
+        value = std::ldexp(mantissa + 1024, exponent - 25);
+    }
+    return (half & 0x8000) != 0 ? -value : value;
+}
+
+inline double _BitsToFloat(std::uint64_t bits) {
+    std::uint32_t u = static_cast<std::uint32_t>(bits);
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+inline double _BitsToDouble(std::uint64_t bits) {
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+struct _Cbor {
+    static constexpr const char *kName = "CBOR";
+
+    // Reads the argument that follows an initial byte with additional information info. 31, which
+    // means an indefinite length, is left to the caller.
+    static bool ReadArgument(_BinaryInput &in, int info, std::uint64_t &argument) {
+        if (info < 24) {
+            argument = static_cast<std::uint64_t>(info);
+            return true;
+        }
+        if (info > 27) {
+            return false;
+        }
+        return in.ReadBigEndian(1 << (info - 24), argument);
+    }
+
+    static bool ReadItem(_BinaryInput &in, _BinaryItem &item, std::string &scratch) {
+        item.is_bytes = false;
+        item.in_scratch = false;
+        item.indefinite = false;
+
+        while (true) {
+            const char *initial;
+            if (!in.Read(1, initial)) {
+                return false;
+            }
+
+            int major = static_cast<std::uint8_t>(*initial) >> 5;
+            int info = *initial & 0x1f;
+            std::uint64_t argument = 0;
+            if (info == 31 ? major < 2 || major == 6 : !ReadArgument(in, info, argument)) {
+                return false;
+            }
+
+            switch (major) {
+            case 0:
+                _SetBinaryUnsigned(argument, item);
+                return true;
+            case 1:
+                if (argument <= static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) {
+                    item.type = JsonType::kInteger;
+                    item.integer = -1 - static_cast<std::int64_t>(argument);
+                } else {
+                    item.type = JsonType::kNumber;
+                    item.number = -1.0 - static_cast<double>(argument);
+                }
+                return true;
+            case 2:
+            case 3:
+                item.type = JsonType::kString;
+                item.is_bytes = major == 2;
+                if (info == 31) {
+                    item.in_scratch = true;
+                    return ReadChunks(in, major, item, scratch);
+                }
+                return ReadString(in, argument, item);
+            case 4:
+            case 5:
+                item.type = major == 4 ? JsonType::kArray : JsonType::kObject;
+                item.indefinite = info == 31;
+                item.size = static_cast<size_t>(argument);
+                // every element takes at least one byte, so a larger size is an error before anything is allocated
+                return item.indefinite || argument <= in.Remaining();
+            case 6:
+                // the tag is dropped and the item it applies to is read instead
+                continue;
+            default:
+                return ReadSimple(in, info, argument, item);
+            }
+        }
+    }
+
+    static bool ReadString(_BinaryInput &in, std::uint64_t size, _BinaryItem &item) {
+        const char *data;
+        if (size > in.Remaining() || !in.Read(static_cast<size_t>(size), data)) {
+            return false;
+        }
+
+        item.string = std::string_view(data, static_cast<size_t>(size));
+        return true;
+    }
+
+    // An indefinite-length string is a series of definite-length strings of the same type
+    static bool ReadChunks(_BinaryInput &in, int major, _BinaryItem &item, std::string &scratch) {
+        scratch.clear();
+        while (!ReadBreak(in)) {
+            const char *initial;
+            std::uint64_t size;
+            if (!in.Read(1, initial) || static_cast<std::uint8_t>(*initial) >> 5 != major ||
+                !ReadArgument(in, *initial & 0x1f, size) || !ReadString(in, size, item)) {
+                return false;
+            }
+            scratch.append(item.string);
+        }
+
+        item.string = scratch;
+        return true;
+    }
+
+    static bool ReadSimple(_BinaryInput &in, int info, std::uint64_t argument, _BinaryItem &item) {
+        switch (info) {
+        case 20:
+        case 21:
+            item.type = JsonType::kBoolean;
+            item.boolean = info == 21;
+            return true;
+        case 22:
+        case 23:
+            // undefined has no JSON counterpart either
+            item.type = JsonType::kNull;
+            return true;
+        case 25:
+            item.type = JsonType::kNumber;
+            item.number = _HalfToDouble(static_cast<std::uint16_t>(argument));
+            return true;
+        case 26:
+            item.type = JsonType::kNumber;
+            item.number = _BitsToFloat(argument);
+            return true;
+        case 27:
+            item.type = JsonType::kNumber;
+            item.number = _BitsToDouble(argument);
+            return true;
+        default:
+            (void)in;
+            return false;
+        }
+    }
+
+    static bool ReadBreak(_BinaryInput &in) {
+        const char *data;
+        return in.Peek() == 0xff && in.Read(1, data);
+    }
+};
+
+struct _MessagePack {
+    static constexpr const char *kName = "MessagePack";
+
+    static bool ReadItem(_BinaryInput &in, _BinaryItem &item, std::string &) {
+        item.is_bytes = false;
+        item.in_scratch = false;
+        item.indefinite = false;
+
+        const char *prefix;
+        if (!in.Read(1, prefix)) {
+            return false;
+        }
+
+        int byte = static_cast<std::uint8_t>(*prefix);
+        std::uint64_t argument;
+        if (byte < 0x80 || byte >= 0xe0) {
+            item.type = JsonType::kInteger;
+            item.integer = static_cast<std::int8_t>(byte);
+            return true;
+        }
+        if (byte < 0x90) {
+            return ReadContainer(JsonType::kObject, byte & 0x0f, in, item);
+        }
+        if (byte < 0xa0) {
+            return ReadContainer(JsonType::kArray, byte & 0x0f, in, item);
+        }
+        if (byte < 0xc0) {
+            return ReadString(in, byte & 0x1f, false, item);
+        }
+
+        switch (byte) {
+        case 0xc0:
+            item.type = JsonType::kNull;
+            return true;
+        case 0xc2:
+        case 0xc3:
+            item.type = JsonType::kBoolean;
+            item.boolean = byte == 0xc3;
+            return true;
+        case 0xc4:
+        case 0xc5:
+        case 0xc6:
+            return in.ReadBigEndian(1 << (byte - 0xc4), argument) && ReadString(in, argument, true, item);
+        case 0xca:
+            item.type = JsonType::kNumber;
+            if (!in.ReadBigEndian(4, argument)) {
+                return false;
+            }
+            item.number = _BitsToFloat(argument);
+            return true;
+        case 0xcb:
+            item.type = JsonType::kNumber;
+            if (!in.ReadBigEndian(8, argument)) {
+                return false;
+            }
+            item.number = _BitsToDouble(argument);
+            return true;
+        case 0xcc:
+        case 0xcd:
+        case 0xce:
+        case 0xcf:
+            if (!in.ReadBigEndian(1 << (byte - 0xcc), argument)) {
+                return false;
+            }
+            _SetBinaryUnsigned(argument, item);
+            return true;
+        case 0xd0:
+        case 0xd1:
+        case 0xd2:
+        case 0xd3: {
+            int size = 1 << (byte - 0xd0);
+            if (!in.ReadBigEndian(size, argument)) {
+                return false;
+            }
+
+            // sign-extend from the top bit of the value
+            int shift = 64 - 8 * size;
+            item.type = JsonType::kInteger;
+            item.integer = static_cast<std::int64_t>(argument << shift) >> shift;
+            return true;
+        }
+        case 0xd9:
+        case 0xda:
+        case 0xdb:
+            return in.ReadBigEndian(1 << (byte - 0xd9), argument) && ReadString(in, argument, false, item);
+        case 0xdc:
+        case 0xdd:
+            return in.ReadBigEndian(2 << (byte - 0xdc), argument) && ReadContainer(JsonType::kArray, argument, in, item);
+        case 0xde:
+        case 0xdf:
+            return in.ReadBigEndian(2 << (byte - 0xde), argument) && ReadContainer(JsonType::kObject, argument, in, item);
+        default:
+            // 0xc1 is never used, and extension types have no JSON counterpart
+            return false;
+        }
+    }
+
+    static bool ReadString(_BinaryInput &in, std::uint64_t size, bool is_bytes, _BinaryItem &item) {
+        const char *data;
+        if (size > in.Remaining() || !in.Read(static_cast<size_t>(size), data)) {
+            return false;
+        }
+
+        item.type = JsonType::kString;
+        item.is_bytes = is_bytes;
+        item.string = std::string_view(data, static_cast<size_t>(size));
+        return true;
+    }
+
+    static bool ReadContainer(JsonType type, std::uint64_t size, _BinaryInput &in, _BinaryItem &item) {
+        item.type = type;
+        item.size = static_cast<size_t>(size);
+        return size <= in.Remaining();
+    }
+
+    static bool ReadBreak(_BinaryInput &) {
+        return false;
+    }
+};
+
+// An array or object being decoded
+struct _BinaryFrame {
+    JsonValue *container;
+    bool is_object;
+    bool indefinite;
+    size_t remaining;
+    const SymbolTable::Shape *shape;
+};
+
+// Decodes one value of Format into value with an explicit stack of open arrays and objects, like
+// ParseContext. Object keys must be strings.
+template <typename Format>
+class _BinaryDecoder {
+  public:
+    _BinaryDecoder(JsonValue *value, const ParseOptions &options)
+        : value_(value), options_(&options), invalid_utf8_(false), invalid_utf8_at_(nullptr) {
+    }
+
+    // Whether a string was rejected as invalid UTF-8, and then the invalid sequence, or nullptr when it
+    // was in a string joined from chunks
+    bool InvalidUtf8(const char *&at) const noexcept {
+        at = invalid_utf8_at_;
+        return invalid_utf8_;
+    }
+
+    bool Decode(_BinaryInput &in) {
+        std::vector<_BinaryFrame> stack;
+        _BinaryItem item;
+        while (true) {
+            if (!Format::ReadItem(in, item, scratch_)) {
+                return false;
+            }
+
+            switch (item.type) {
+            case JsonType::kNull:
+                *value_ = JsonValue();
+                break;
+            case JsonType::kBoolean:
+                *value_ = JsonValue(item.boolean);
+                break;
+            case JsonType::kInteger:
+                *value_ = JsonValue(item.integer);
+                break;
+            case JsonType::kNumber:
+                *value_ = JsonValue(item.number);
+                break;
+            case JsonType::kString:
+                if (!_CheckString(item)) {
+                    return false;
+                }
+                if (options_->borrow_strings && !item.in_scratch) {
+                    *value_ = JsonValue::Borrow(item.string);
+                } else {
+                    *value_ = JsonValue(item.string, nullptr);
+                }
+                break;
+            case JsonType::kArray:
+            case JsonType::kObject:
+                if (stack.size() >= options_->max_depth) {
+                    return false;
+                }
+
+                *value_ = JsonValue(item.type, nullptr);
+                if (item.type == JsonType::kArray && !item.indefinite) {
+                    value_->Get<JsonArray>().reserve(item.size);
+                }
+                stack.push_back(_BinaryFrame{value_, item.type == JsonType::kObject, item.indefinite, item.size,
+                                             options_->symbols != nullptr ? options_->symbols->Root() : nullptr});
+                break;
+            }
+
+            // moves to the next element or member, closing the containers that are complete
+            while (true) {
+                if (stack.empty()) {
+                    return true;
+                }
+
+                _BinaryFrame &frame = stack.back();
+                if (frame.indefinite ? Format::ReadBreak(in) : frame.remaining == 0) {
+                    stack.pop_back();
+                    continue;
+                }
+
+                --frame.remaining;
+                if (!frame.is_object) {
+                    JsonArray &array = frame.container->Get<JsonArray>();
+                    array.emplace_back();
+                    value_ = &array.back();
+                } else if (!_ReadKey(in, frame, item)) {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+
+  private:
+    bool _CheckString(const _BinaryItem &item) {
+        if (item.is_bytes || !options_->validate_utf8) {
+            return true;
+        }
+
+        size_t valid = ValidateUtf8(item.string);
+        if (valid == item.string.size()) {
+            return true;
+        }
+
+        invalid_utf8_ = true;
+        invalid_utf8_at_ = item.in_scratch ? nullptr : item.string.data() + valid;
+        return false;
+    }
+
+    bool _ReadKey(_BinaryInput &in, _BinaryFrame &frame, _BinaryItem &item) {
+        if (!Format::ReadItem(in, item, scratch_) || item.type != JsonType::kString || !_CheckString(item)) {
+            return false;
+        }
+
+        JsonObject &object = frame.container->Get<JsonObject>();
+        if (frame.shape != nullptr) {
+            frame.shape = options_->symbols->Next(frame.shape, item.string);
+            value_ = &_InternedObjectMember(object, frame.shape->key, *options_->symbols);
+        } else {
+            value_ = &_ObjectMember(object, item.string);
+        }
+        return true;
+    }
+
+    JsonValue *value_;
+    const ParseOptions *options_;
+    // Indefinite-length strings are joined here
+    std::string scratch_;
+    bool invalid_utf8_;
+    const char *invalid_utf8_at_;
+};
+
+template <typename Format>
+inline const char *_ParseBinary(const char *begin, const char *end, JsonValue &value, std::string *error,
+                                const ParseOptions &options) {
+    _BinaryInput in(begin, end);
+    _BinaryDecoder<Format> decoder(&value, options);
+    const char *invalid_utf8;
+    if (!decoder.Decode(in) && error != nullptr) {
+        if (!decoder.InvalidUtf8(invalid_utf8)) {
+            *error = std::string("invalid ") + Format::kName + " at offset " + std::to_string(in.Offset());
+        } else {
+            size_t offset = invalid_utf8 != nullptr ? static_cast<size_t>(invalid_utf8 - begin) : in.Offset();
+            *error = std::string("invalid UTF-8 in ") + Format::kName + " at offset " + std::to_string(offset);
+        }
+    }
+    return in.Current();
+}
+
+// Decodes one CBOR item from [begin, end) and returns the end of it. Bytes after the item are not
+// read, so a stream of items is decoded by calling this again from the returned position.
+inline const char *ParseCbor(const char *begin, const char *end, JsonValue &value, std::string *error,
+                             const ParseOptions &options = ParseContext::DefaultOptions()) {
+    return _ParseBinary<_Cbor>(begin, end, value, error, options);
+}
+
+// Returns the error message, which is empty on success
+inline std::string ParseCbor(const std::string &input, JsonValue &value,
+                             const ParseOptions &options = ParseContext::DefaultOptions()) {
+    std::string error;
+    ParseCbor(input.data(), input.data() + input.size(), value, &error, options);
+    return error;
+}
+
+// Decodes one MessagePack object from [begin, end) and returns the end of it
+inline const char *ParseMessagePack(const char *begin, const char *end, JsonValue &value, std::string *error,
+                                    const ParseOptions &options = ParseContext::DefaultOptions()) {
+    return _ParseBinary<_MessagePack>(begin, end, value, error, options);
+}
+
+inline std::string ParseMessagePack(const std::string &input, JsonValue &value,
+                                    const ParseOptions &options = ParseContext::DefaultOptions()) {
+    std::string error;
+    ParseMessagePack(input.data(), input.data() + input.size(), value, &error, options);
+    return error;
+}
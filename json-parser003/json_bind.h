@@ -0,0 +1,392 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "json_parser.h"
+
+// Parses JSON straight into C++ types without building a JsonValue. A struct is bound by
+// specializing JsonBinding with its fields:
+//
+//   template <>
+//   struct JsonBinding<User> {
+//       static constexpr auto kFields = JsonFields(JsonField("id", &User::id), JsonField("name", &User::name));
+//   };
+//
+// Fields can be bool, integers, floating point numbers, std::string, std::vector, std::optional,
+// JsonValue or other bound structs. A member whose key is not bound is skipped, and a field
+// without a member keeps its value. A value of the wrong type or out of range for its field is an
+// error; null is only accepted by std::optional and JsonValue.
+template <typename T>
+struct JsonBinding;
+
+template <typename Struct, typename Member>
+struct JsonField {
+    constexpr JsonField(std::string_view name, Member Struct::*member) : name(name), member(member) {
+    }
+
+    std::string_view name;
+    Member Struct::*member;
+};
+
+// The fields of a struct, and a perfect hash of their names found at compile time: every name
+// hashes to its own slot of a table with at least twice as many slots as fields, so a key is
+// looked up with one hash and one comparison.
+template <typename... Fields>
+class JsonFields {
+  public:
+    static constexpr size_t kSize = sizeof...(Fields);
+    static_assert(kSize < std::numeric_limits<std::uint8_t>::max(), "too many fields");
+
+    static constexpr size_t kTableSize = [] {
+        size_t size = 1;
+        while (size < kSize * 2) {
+            size *= 2;
+        }
+        return size;
+    }();
+
+    constexpr JsonFields(Fields... fields) : fields_(fields...), names_{fields.name...}, seed_(0), table_{} {
+        for (size_t i = 0; i < kSize; ++i) {
+            for (size_t j = 0; j < i; ++j) {
+                if (names_[i] == names_[j]) {
+                    throw "duplicate field name";
+                }
+            }
+        }
+
+        while (!_TryFill()) {
+            if (++seed_ == 0) {
+                throw "no perfect hash";
+            }
+        }
+    }
+
+    // Returns the index of the field named key, or kSize when there is none
+    constexpr size_t Find(std::string_view key) const {
+        size_t slot = table_[_Slot(key, seed_)];
+        return slot != 0 && names_[slot - 1] == key ? slot - 1 : kSize;
+    }
+
+    constexpr const std::tuple<Fields...> &Get() const {
+        return fields_;
+    }
+
+  private:
+    static constexpr size_t _Slot(std::string_view key, std::uint32_t seed) {
+        // FNV-1a
+        std::uint32_t hash = 2166136261u ^ seed;
+        for (char ch : key) {
+            hash = (hash ^ static_cast<std::uint8_t>(ch)) * 16777619u;
+        }
+        return (hash ^ (hash >> 16)) & (kTableSize - 1);
+    }
+
+    constexpr bool _TryFill() {
+        for (size_t i = 0; i < kTableSize; ++i) {
+            table_[i] = 0;
+        }
+
+        for (size_t i = 0; i < kSize; ++i) {
+            size_t slot = _Slot(names_[i], seed_);
+            if (table_[slot] != 0) {
+                return false;
+            }
+            table_[slot] = static_cast<std::uint8_t>(i + 1);
+        }
+        return true;
+    }
+
+    std::tuple<Fields...> fields_;
+    std::array<std::string_view, kSize> names_;
+    std::uint32_t seed_;
+    // The index of the field plus one, 0 for an empty slot
+    std::array<std::uint8_t, kTableSize> table_;
+};
+
+constexpr size_t kDefaultBindDepth = 100;
+
+template <typename T, typename = void>
+struct _IsBound : std::false_type {};
+
+template <typename T>
+struct _IsBound<T, std::void_t<decltype(JsonBinding<T>::kFields)>> : std::true_type {};
+
+template <typename T>
+struct _IsVector : std::false_type {};
+
+template <typename T, typename Allocator>
+struct _IsVector<std::vector<T, Allocator>> : std::true_type {};
+
+// Context for _Parse that stores into a T
+template <typename T>
+class BindContext {
+    static_assert(std::is_arithmetic<T>::value || std::is_same<T, std::string>::value || _IsVector<T>::value ||
+                      _IsBound<T>::value,
+                  "the type has no JsonBinding");
+
+  public:
+    BindContext(T *value, std::string *buffer, size_t depth = kDefaultBindDepth)
+        : value_(value), buffer_(buffer), depth_(depth) {
+    }
+
+    bool SetNull() {
+        return false;
+    }
+
+    bool SetBool(bool value) {
+        if constexpr (std::is_same<T, bool>::value) {
+            *value_ = value;
+            return true;
+        }
+        return false;
+    }
+
+    bool SetNumber(double value) {
+        if constexpr (std::is_floating_point<T>::value) {
+            *value_ = static_cast<T>(value);
+            return true;
+        }
+        return false;
+    }
+
+    bool SetInt64(std::int64_t value) {
+        if constexpr (std::is_floating_point<T>::value) {
+            *value_ = static_cast<T>(value);
+            return true;
+        } else if constexpr (std::is_integral<T>::value && !std::is_same<T, bool>::value) {
+            if constexpr (std::is_signed<T>::value) {
+                if (value < std::numeric_limits<T>::min() || value > std::numeric_limits<T>::max()) {
+                    return false;
+                }
+            } else if (value < 0 || static_cast<std::uint64_t>(value) > std::numeric_limits<T>::max()) {
+                return false;
+            }
+
+            *value_ = static_cast<T>(value);
+            return true;
+        }
+        return false;
+    }
+
+    // The string is unescaped straight into the field
+    template <typename Source>
+    bool ParseString(Source &in) {
+        if constexpr (std::is_same<T, std::string>::value) {
+            std::string_view view;
+            if (in.ReadPlainString(view)) {
+                value_->assign(view);
+                return true;
+            }
+
+            value_->clear();
+            return _ParseString(*value_, in);
+        }
+        return false;
+    }
+
+    bool ParseArrayStart() {
+        if constexpr (_IsVector<T>::value) {
+            if (depth_ == 0) {
+                return false;
+            }
+
+            --depth_;
+            value_->clear();
+            return true;
+        }
+        return false;
+    }
+
+    template <typename Source>
+    bool ParseArrayItem(Source &in, size_t) {
+        if constexpr (_IsVector<T>::value) {
+            value_->emplace_back();
+
+            BindContext<typename T::value_type> context(&value_->back(), buffer_, depth_);
+            return _Parse(context, in);
+        }
+        return false;
+    }
+
+    bool ParseArrayStop() {
+        ++depth_;
+        return true;
+    }
+
+    bool ParseObjectStart() {
+        if constexpr (_IsBound<T>::value) {
+            if (depth_ == 0) {
+                return false;
+            }
+
+            --depth_;
+            return true;
+        }
+        return false;
+    }
+
+    template <typename Source>
+    bool ParseObjectItem(Source &in, const std::string &key) {
+        if constexpr (_IsBound<T>::value) {
+            using Fields = std::decay_t<decltype(JsonBinding<T>::kFields)>;
+            size_t index = JsonBinding<T>::kFields.Find(key);
+            if (index == Fields::kSize) {
+                return _SkipValue(in, *buffer_, depth_, ParseContext::DefaultOptions());
+            }
+
+            return _ParseField(in, index, std::make_index_sequence<Fields::kSize>());
+        }
+        return false;
+    }
+
+    bool ParseObjectStop() {
+        ++depth_;
+        return true;
+    }
+
+  private:
+    template <typename Source, size_t... I>
+    bool _ParseField(Source &in, size_t index, std::index_sequence<I...>) {
+        bool ret = false;
+        ((index == I && (ret = _ParseMember(in, std::get<I>(JsonBinding<T>::kFields.Get()).member), true)) || ...);
+        return ret;
+    }
+
+    template <typename Source, typename Struct, typename Member>
+    bool _ParseMember(Source &in, Member Struct::*member) {
+        BindContext<Member> context(&(value_->*member), buffer_, depth_);
+        return _Parse(context, in);
+    }
+
+    T *value_;
+    std::string *buffer_;
+    size_t depth_;
+};
+
+// null resets the optional, and any other value is parsed into it
+template <typename T>
+class BindContext<std::optional<T>> {
+  public:
+    BindContext(std::optional<T> *value, std::string *buffer, size_t depth = kDefaultBindDepth)
+        : value_(value), buffer_(buffer), depth_(depth) {
+    }
+
+    bool SetNull() {
+        value_->reset();
+        return true;
+    }
+
+    bool SetBool(bool value) {
+        return _Inner().SetBool(value);
+    }
+
+    bool SetNumber(double value) {
+        return _Inner().SetNumber(value);
+    }
+
+    bool SetInt64(std::int64_t value) {
+        return _Inner().SetInt64(value);
+    }
+
+    template <typename Source>
+    bool ParseString(Source &in) {
+        return _Inner().ParseString(in);
+    }
+
+    bool ParseArrayStart() {
+        return _Open() && _Inner().ParseArrayStart();
+    }
+
+    template <typename Source>
+    bool ParseArrayItem(Source &in, size_t index) {
+        return _Inner().ParseArrayItem(in, index);
+    }
+
+    bool ParseArrayStop() {
+        ++depth_;
+        return true;
+    }
+
+    bool ParseObjectStart() {
+        return _Open() && _Inner().ParseObjectStart();
+    }
+
+    template <typename Source>
+    bool ParseObjectItem(Source &in, const std::string &key) {
+        return _Inner().ParseObjectItem(in, key);
+    }
+
+    bool ParseObjectStop() {
+        ++depth_;
+        return true;
+    }
+
+  private:
+    // The inner context keeps no state between calls but its depth, which is tracked here
+    BindContext<T> _Inner() {
+        if (!value_->has_value()) {
+            value_->emplace();
+        }
+        return BindContext<T>(&**value_, buffer_, depth_);
+    }
+
+    bool _Open() {
+        if (depth_ == 0) {
+            return false;
+        }
+
+        --depth_;
+        return true;
+    }
+
+    std::optional<T> *value_;
+    std::string *buffer_;
+    size_t depth_;
+};
+
+// A JsonValue field takes any value
+template <>
+class BindContext<JsonValue> : public ParseContext {
+  public:
+    BindContext(JsonValue *value, std::string *buffer, size_t depth = kDefaultBindDepth)
+        : ParseContext(value, nullptr, buffer, DefaultOptions(), depth) {
+    }
+};
+
+// The generic _Parse is an exact match for BindContext<JsonValue>, so this sends it to the same
+// non-recursive Parse as a ParseContext
+template <typename Source>
+inline bool _Parse(BindContext<JsonValue> &context, Source &in) {
+    return context.Parse(in);
+}
+
+template <typename T, typename Iter>
+Iter ParseJsonInto(const Iter &begin, const Iter &end, T &value, std::string *error) {
+    std::string buffer;
+    BindContext<T> context(&value, &buffer);
+    return _Parse(context, begin, end, error);
+}
+
+template <typename T>
+const char *ParseJsonInto(const char *begin, const char *end, T &value, std::string *error) {
+    std::string buffer;
+    BindContext<T> context(&value, &buffer);
+    return _ParseContiguous(context, begin, end, error);
+}
+
+// Returns the error message, which is empty on success
+template <typename T>
+std::string ParseJsonInto(const std::string &input, T &value) {
+    std::string error;
+    ParseJsonInto(input.data(), input.data() + input.size(), value, &error);
+    return error;
+}
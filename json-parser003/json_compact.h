@@ -0,0 +1,636 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_parser.h"
+
+// A read-only document of 8-byte NaN-boxed values. An array is a count followed by its elements, so
+// a numeric array takes half the memory of a JsonArray.
+//
+// A double is stored as its bits, and every NaN as the positive quiet NaN. The negative quiet NaNs
+// box the other values, with the type in bits 48-50 and a 48-bit payload:
+//   null, bool      0 or 1
+//   int48           the integer, when it fits in 48 bits
+//   int64           a pointer to the integer
+//   string          a pointer to a 32-bit length, the bytes and a NUL
+//   array           a pointer to a 64-bit count and the elements
+//   object          a pointer to a 64-bit count and the members, each a key string and a value
+// Everything pointed to is in the arena of the CompactDocument, so the values are only valid while
+// it lives.
+class CompactDocument;
+struct CompactMember;
+
+constexpr std::uint64_t kCompactBoxed = 0xfff8000000000000;
+constexpr std::uint64_t kCompactNaN = 0x7ff8000000000000;
+constexpr std::uint64_t kCompactPayloadMask = (std::uint64_t(1) << 48) - 1;
+
+enum class _CompactTag : std::uint64_t {
+    kNull,
+    kBoolean,
+    kInt48,
+    kInt64,
+    kString,
+    kArray,
+    kObject,
+    kInvalid,
+};
+
+// A contiguous run of elements or members, for range for
+template <typename T>
+class CompactRange {
+  public:
+    CompactRange(const T *begin, const T *end) : begin_(begin), end_(end) {
+    }
+
+    const T *begin() const noexcept {
+        return begin_;
+    }
+
+    const T *end() const noexcept {
+        return end_;
+    }
+
+    size_t size() const noexcept {
+        return static_cast<size_t>(end_ - begin_);
+    }
+
+  private:
+    const T *begin_;
+    const T *end_;
+};
+
+// A value of a CompactDocument. The getters check the type like JsonValue::Get.
+class CompactValue {
+  public:
+    CompactValue() : bits_(_Box(_CompactTag::kInvalid, 0)) {
+    }
+
+    bool IsValid() const noexcept {
+        return !_IsTag(_CompactTag::kInvalid);
+    }
+
+    JsonType Type() const;
+
+    bool GetBool() const;
+    std::int64_t GetInt64() const;
+    // Integers are converted
+    double GetDouble() const;
+    std::string_view GetString() const;
+
+    // Elements of an array or members of an object
+    size_t Size() const;
+
+    // Invalid when there is no such member or element
+    CompactValue operator[](std::string_view key) const;
+    CompactValue operator[](size_t index) const;
+
+    CompactRange<CompactValue> Elements() const;
+    CompactRange<CompactMember> Members() const;
+
+    bool ToValue(JsonValue &value) const;
+
+  private:
+    friend class CompactDocument;
+    friend class _CompactContext;
+
+    explicit CompactValue(std::uint64_t bits) : bits_(bits) {
+    }
+
+    static std::uint64_t _Box(_CompactTag tag, std::uint64_t payload) {
+        return kCompactBoxed | (static_cast<std::uint64_t>(tag) << 48) | payload;
+    }
+
+    static CompactValue _Double(double value) {
+        std::uint64_t bits = kCompactNaN;
+        if (!std::isnan(value)) {
+            std::memcpy(&bits, &value, sizeof(bits));
+        }
+        return CompactValue(bits);
+    }
+
+    // Pointers of user space fit in the payload on the 64-bit targets in use
+    static CompactValue _BoxPointer(_CompactTag tag, const void *p) {
+        std::uint64_t address = reinterpret_cast<std::uintptr_t>(p);
+        JSON_ASSERT((address & ~kCompactPayloadMask) == 0);
+        return CompactValue(_Box(tag, address));
+    }
+
+    bool _IsBoxed() const noexcept {
+        return (bits_ & kCompactBoxed) == kCompactBoxed;
+    }
+
+    bool _IsTag(_CompactTag tag) const noexcept {
+        return _IsBoxed() && static_cast<_CompactTag>((bits_ >> 48) & 7) == tag;
+    }
+
+    template <typename T>
+    const T *_Pointer() const noexcept {
+        return reinterpret_cast<const T *>(static_cast<std::uintptr_t>(bits_ & kCompactPayloadMask));
+    }
+
+    std::uint64_t bits_;
+};
+
+static_assert(sizeof(CompactValue) == 8, "a compact value is one word");
+
+struct CompactMember {
+    CompactValue key;
+    CompactValue value;
+
+    std::string_view Key() const {
+        return key.GetString();
+    }
+};
+
+// Context for _Parse that pushes each value on a stack. A closed array or object is copied from the
+// top of the stack into the arena and replaces its elements there.
+class _CompactContext {
+  public:
+    _CompactContext(CompactDocument *doc, size_t depth) : doc_(doc), depth_(depth), mark_(0) {
+    }
+
+    bool SetNull() {
+        return _Push(CompactValue(CompactValue::_Box(_CompactTag::kNull, 0)));
+    }
+
+    bool SetBool(bool value) {
+        return _Push(CompactValue(CompactValue::_Box(_CompactTag::kBoolean, value ? 1 : 0)));
+    }
+
+    bool SetNumber(double value) {
+        return _Push(CompactValue::_Double(value));
+    }
+
+    bool SetInt64(std::int64_t value);
+
+    template <typename Source>
+    bool ParseString(Source &in);
+
+    bool ParseArrayStart() {
+        return _Open();
+    }
+
+    template <typename Source>
+    bool ParseArrayItem(Source &in, size_t) {
+        _CompactContext context(doc_, depth_);
+        return _Parse(context, in);
+    }
+
+    bool ParseArrayStop();
+
+    bool ParseObjectStart() {
+        return _Open();
+    }
+
+    template <typename Source>
+    bool ParseObjectItem(Source &in, const std::string &key);
+
+    bool ParseObjectStop();
+
+  private:
+    bool _Open();
+    bool _Push(CompactValue value);
+
+    CompactDocument *doc_;
+    size_t depth_;
+    // Where the elements or members of this context start on the stack
+    size_t mark_;
+};
+
+class CompactDocument {
+  public:
+    CompactDocument() = default;
+
+    CompactDocument(const CompactDocument &) = delete;
+    CompactDocument &operator=(const CompactDocument &) = delete;
+
+    template <typename Iter>
+    Iter Parse(const Iter &begin, const Iter &end, std::string *error) {
+        _Reset();
+        _CompactContext context(this, DEFAULT_MAX_DEPTH);
+        std::string message;
+        Iter ret = _Parse(context, begin, end, &message);
+        _Finish(message.empty(), error, message);
+        return ret;
+    }
+
+    const char *Parse(const char *begin, const char *end, std::string *error) {
+        _Reset();
+        _CompactContext context(this, DEFAULT_MAX_DEPTH);
+        std::string message;
+        const char *ret = _ParseContiguous(context, begin, end, &message);
+        _Finish(message.empty(), error, message);
+        return ret;
+    }
+
+    // Returns the error message, which is empty on success
+    std::string Parse(const std::string &input) {
+        std::string error;
+        Parse(input.data(), input.data() + input.size(), &error);
+        return error;
+    }
+
+    // Builds the compact form of value, the inverse of CompactValue::ToValue
+    void Assign(const JsonValue &value) {
+        _Reset();
+        root_ = _Make(value);
+    }
+
+    // Invalid when the last parse failed
+    CompactValue Root() const noexcept {
+        return root_;
+    }
+
+  private:
+    friend class _CompactContext;
+
+    static constexpr size_t DEFAULT_MAX_DEPTH = 100;
+
+    void _Reset() {
+        root_ = CompactValue();
+        stack_.clear();
+        arena_.release();
+    }
+
+    void _Finish(bool ok, std::string *error, std::string &message) {
+        if (ok && stack_.size() == 1) {
+            root_ = stack_.back();
+        } else {
+            arena_.release();
+        }
+        stack_.clear();
+        if (error != nullptr) {
+            *error = std::move(message);
+        }
+    }
+
+    CompactValue _MakeInt64(std::int64_t value) {
+        constexpr std::int64_t limit = std::int64_t(1) << 47;
+        if (value >= -limit && value < limit) {
+            return CompactValue(CompactValue::_Box(_CompactTag::kInt48, static_cast<std::uint64_t>(value) & kCompactPayloadMask));
+        }
+
+        void *p = arena_.allocate(sizeof(value), alignof(std::int64_t));
+        std::memcpy(p, &value, sizeof(value));
+        return CompactValue::_BoxPointer(_CompactTag::kInt64, p);
+    }
+
+    CompactValue _MakeString(std::string_view str) {
+        JSON_ASSERT(str.size() <= std::numeric_limits<std::uint32_t>::max());
+        std::uint32_t length = static_cast<std::uint32_t>(str.size());
+        char *p = static_cast<char *>(arena_.allocate(sizeof(length) + str.size() + 1, alignof(std::uint32_t)));
+        std::memcpy(p, &length, sizeof(length));
+        str.copy(p + sizeof(length), str.size());
+        p[sizeof(length) + str.size()] = '\0';
+        return CompactValue::_BoxPointer(_CompactTag::kString, p);
+    }
+
+    // Removes the key and value pairs from first on the stack whose key comes again later, as parsing
+    // into a JsonObject keeps the last value of a key
+    void _RemoveDuplicateKeys(size_t first) {
+        size_t count = (stack_.size() - first) / 2;
+        std::string_view small[kMaxPairwiseKeys];
+        std::vector<std::string_view> large;
+        std::string_view *keys = small;
+        if (count > kMaxPairwiseKeys) {
+            large.resize(count);
+            keys = large.data();
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            keys[i] = stack_[first + 2 * i].GetString();
+        }
+
+        std::vector<bool> keep;
+        if (!_DuplicateKeys(keys, count, keep)) {
+            return;
+        }
+
+        size_t out = first;
+        for (size_t i = 0; i < count; ++i) {
+            if (keep[i]) {
+                stack_[out++] = stack_[first + 2 * i];
+                stack_[out++] = stack_[first + 2 * i + 1];
+            }
+        }
+        stack_.resize(out);
+    }
+
+    // Moves the values from first on the stack into an array or object in the arena
+    CompactValue _MakeContainer(_CompactTag tag, size_t first) {
+        size_t values = stack_.size() - first;
+        std::uint64_t count = tag == _CompactTag::kObject ? values / 2 : values;
+        void *p = arena_.allocate(sizeof(count) + values * sizeof(CompactValue), alignof(std::uint64_t));
+        std::memcpy(p, &count, sizeof(count));
+        if (values > 0) {
+            std::memcpy(static_cast<char *>(p) + sizeof(count), &stack_[first], values * sizeof(CompactValue));
+        }
+
+        stack_.resize(first);
+        return CompactValue::_BoxPointer(tag, p);
+    }
+
+    // Nested arrays and objects are built from a stack instead of recursively. Their values go on stack_
+    // as they do when parsing, and each one is moved into the arena once it is complete.
+    CompactValue _Make(const JsonValue &root) {
+        struct Frame {
+            const JsonValue *value;
+            size_t first;
+            JsonArray::const_iterator element;
+            JsonObject::const_iterator member;
+        };
+
+        std::vector<Frame> frames;
+        const JsonValue *value = &root;
+        while (true) {
+            if (value != nullptr) {
+                if (value->IsArray()) {
+                    frames.push_back({value, stack_.size(), value->Get<JsonArray>().begin(), JsonObject::const_iterator()});
+                } else if (value->IsObject()) {
+                    frames.push_back({value, stack_.size(), JsonArray::const_iterator(), value->Get<JsonObject>().begin()});
+                } else {
+                    stack_.push_back(_MakeScalar(*value));
+                }
+                value = nullptr;
+            }
+
+            if (frames.empty()) {
+                break;
+            }
+
+            Frame &frame = frames.back();
+            _CompactTag tag;
+            if (frame.value->IsArray()) {
+                if (frame.element != frame.value->Get<JsonArray>().end()) {
+                    value = &*frame.element++;
+                    continue;
+                }
+                tag = _CompactTag::kArray;
+            } else {
+                if (frame.member != frame.value->Get<JsonObject>().end()) {
+                    stack_.push_back(_MakeString(frame.member->first));
+                    value = &frame.member->second;
+                    ++frame.member;
+                    continue;
+                }
+                tag = _CompactTag::kObject;
+            }
+
+            CompactValue container = _MakeContainer(tag, frame.first);
+            frames.pop_back();
+            stack_.push_back(container);
+        }
+
+        CompactValue made = stack_.back();
+        stack_.pop_back();
+        return made;
+    }
+
+    CompactValue _MakeScalar(const JsonValue &value) {
+        switch (value.Type()) {
+        case JsonType::kBoolean:
+            return CompactValue(CompactValue::_Box(_CompactTag::kBoolean, value.Get<bool>() ? 1 : 0));
+        case JsonType::kInteger:
+            return _MakeInt64(value.Get<std::int64_t>());
+        case JsonType::kNumber:
+            return CompactValue::_Double(value.Get<double>());
+        case JsonType::kString:
+            return _MakeString(value.GetStringView());
+        default:
+            return CompactValue(CompactValue::_Box(_CompactTag::kNull, 0));
+        }
+    }
+
+    std::pmr::monotonic_buffer_resource arena_;
+    // The values of the arrays and objects that are not closed yet
+    std::vector<CompactValue> stack_;
+    std::string buffer_;
+    CompactValue root_;
+};
+
+inline bool _CompactContext::SetInt64(std::int64_t value) {
+    return _Push(doc_->_MakeInt64(value));
+}
+
+// The string is unescaped into the buffer of the document unless it can be copied from the input
+template <typename Source>
+inline bool _CompactContext::ParseString(Source &in) {
+    std::string_view view;
+    if (!in.ReadPlainString(view)) {
+        doc_->buffer_.clear();
+        if (!_ParseString(doc_->buffer_, in)) {
+            return false;
+        }
+        view = doc_->buffer_;
+    }
+
+    return _Push(doc_->_MakeString(view));
+}
+
+inline bool _CompactContext::ParseArrayStop() {
+    ++depth_;
+    doc_->stack_.push_back(doc_->_MakeContainer(_CompactTag::kArray, mark_));
+    return true;
+}
+
+template <typename Source>
+inline bool _CompactContext::ParseObjectItem(Source &in, const std::string &key) {
+    _Push(doc_->_MakeString(key));
+    _CompactContext context(doc_, depth_);
+    return _Parse(context, in);
+}
+
+inline bool _CompactContext::ParseObjectStop() {
+    ++depth_;
+    doc_->_RemoveDuplicateKeys(mark_);
+    doc_->stack_.push_back(doc_->_MakeContainer(_CompactTag::kObject, mark_));
+    return true;
+}
+
+inline bool _CompactContext::_Open() {
+    if (depth_ == 0) {
+        return false;
+    }
+
+    --depth_;
+    mark_ = doc_->stack_.size();
+    return true;
+}
+
+inline bool _CompactContext::_Push(CompactValue value) {
+    doc_->stack_.push_back(value);
+    return true;
+}
+
+inline JsonType CompactValue::Type() const {
+    if (!_IsBoxed()) {
+        return JsonType::kNumber;
+    }
+
+    switch (static_cast<_CompactTag>((bits_ >> 48) & 7)) {
+    case _CompactTag::kBoolean:
+        return JsonType::kBoolean;
+    case _CompactTag::kInt48:
+    case _CompactTag::kInt64:
+        return JsonType::kInteger;
+    case _CompactTag::kString:
+        return JsonType::kString;
+    case _CompactTag::kArray:
+        return JsonType::kArray;
+    case _CompactTag::kObject:
+        return JsonType::kObject;
+    default:
+        return JsonType::kNull;
+    }
+}
+
+inline bool CompactValue::GetBool() const {
+    JSON_ASSERT(_IsTag(_CompactTag::kBoolean));
+    return (bits_ & 1) != 0;
+}
+
+inline std::int64_t CompactValue::GetInt64() const {
+    if (_IsTag(_CompactTag::kInt64)) {
+        std::int64_t value;
+        std::memcpy(&value, _Pointer<std::int64_t>(), sizeof(value));
+        return value;
+    }
+
+    JSON_ASSERT(_IsTag(_CompactTag::kInt48));
+    // sign-extends bit 47
+    return static_cast<std::int64_t>(bits_ << 16) >> 16;
+}
+
+inline double CompactValue::GetDouble() const {
+    JSON_ASSERT(Type() == JsonType::kNumber || Type() == JsonType::kInteger);
+    if (_IsBoxed()) {
+        return static_cast<double>(GetInt64());
+    }
+
+    double value;
+    std::memcpy(&value, &bits_, sizeof(value));
+    return value;
+}
+
+inline std::string_view CompactValue::GetString() const {
+    JSON_ASSERT(_IsTag(_CompactTag::kString));
+    const char *p = _Pointer<char>();
+    std::uint32_t length;
+    std::memcpy(&length, p, sizeof(length));
+    return std::string_view(p + sizeof(length), length);
+}
+
+inline size_t CompactValue::Size() const {
+    JSON_ASSERT(_IsTag(_CompactTag::kArray) || _IsTag(_CompactTag::kObject));
+    return static_cast<size_t>(*_Pointer<std::uint64_t>());
+}
+
+inline CompactValue CompactValue::operator[](std::string_view key) const {
+    if (!_IsTag(_CompactTag::kObject)) {
+        return CompactValue();
+    }
+
+    for (const CompactMember &member : Members()) {
+        if (member.Key() == key) {
+            return member.value;
+        }
+    }
+    return CompactValue();
+}
+
+inline CompactValue CompactValue::operator[](size_t index) const {
+    if (!_IsTag(_CompactTag::kArray) || index >= Size()) {
+        return CompactValue();
+    }
+
+    return Elements().begin()[index];
+}
+
+inline CompactRange<CompactValue> CompactValue::Elements() const {
+    JSON_ASSERT(_IsTag(_CompactTag::kArray));
+    const CompactValue *first = reinterpret_cast<const CompactValue *>(_Pointer<std::uint64_t>() + 1);
+    return CompactRange<CompactValue>(first, first + Size());
+}
+
+inline CompactRange<CompactMember> CompactValue::Members() const {
+    JSON_ASSERT(_IsTag(_CompactTag::kObject));
+    const CompactMember *first = reinterpret_cast<const CompactMember *>(_Pointer<std::uint64_t>() + 1);
+    return CompactRange<CompactMember>(first, first + Size());
+}
+
+// Nested arrays and objects are converted from a stack instead of recursively
+inline bool CompactValue::ToValue(JsonValue &value) const {
+    if (!IsValid()) {
+        return false;
+    }
+
+    struct Frame {
+        CompactValue source;
+        JsonValue *value;
+        size_t index;
+    };
+
+    std::vector<Frame> stack;
+    CompactValue source = *this;
+    JsonValue *slot = &value;
+    while (true) {
+        if (slot != nullptr) {
+            switch (source.Type()) {
+            case JsonType::kNull:
+                *slot = JsonValue();
+                break;
+            case JsonType::kBoolean:
+                *slot = JsonValue(source.GetBool());
+                break;
+            case JsonType::kInteger:
+                *slot = JsonValue(source.GetInt64());
+                break;
+            case JsonType::kNumber:
+                *slot = JsonValue(source.GetDouble());
+                break;
+            case JsonType::kString:
+                *slot = JsonValue(source.GetString(), nullptr);
+                break;
+            case JsonType::kArray:
+                *slot = JsonValue(JsonType::kArray);
+                slot->Get<JsonArray>().resize(source.Size());
+                stack.push_back({source, slot, 0});
+                break;
+            case JsonType::kObject:
+                *slot = JsonValue(JsonType::kObject);
+                stack.push_back({source, slot, 0});
+                break;
+            }
+            slot = nullptr;
+        }
+
+        if (stack.empty()) {
+            break;
+        }
+
+        Frame &frame = stack.back();
+        if (frame.index == frame.source.Size()) {
+            stack.pop_back();
+            continue;
+        }
+
+        size_t i = frame.index++;
+        if (frame.source._IsTag(_CompactTag::kArray)) {
+            source = frame.source.Elements().begin()[i];
+            slot = &frame.value->Get<JsonArray>()[i];
+        } else {
+            const CompactMember &member = frame.source.Members().begin()[i];
+            source = member.value;
+            slot = &_ObjectMember(frame.value->Get<JsonObject>(), member.Key());
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <memory_resource>
+#include <string>
+
+#include "json_parser.h"
+
+// A parsed document whose strings, arrays and objects are all allocated from one monotonic arena.
+// Destroying or re-parsing the document releases every node at once without visiting them.
+//
+// Values in the document are only valid while the document lives; copy a value to keep it longer.
+// Values stored into the document's arrays and objects must not own heap memory, because their
+// destructors never run.
+class JsonDocument {
+  public:
+    JsonDocument() = default;
+    explicit JsonDocument(size_t initial_size) : arena_(initial_size) {
+    }
+
+    JsonDocument(const JsonDocument &) = delete;
+    JsonDocument &operator=(const JsonDocument &) = delete;
+
+    template <typename Iter>
+    Iter Parse(const Iter &begin, const Iter &end, std::string *error) {
+        Reset();
+        ParseContext context(&root_, &arena_, &buffer_, ParseContext::DefaultOptions());
+        return _Parse(context, begin, end, error);
+    }
+
+    // With options.borrow_strings the document is also only valid while the input lives
+    const char *Parse(const char *begin, const char *end, std::string *error,
+                      const ParseOptions &options = ParseContext::DefaultOptions()) {
+        Reset();
+        ParseContext context(&root_, &arena_, &buffer_, options);
+        return _ParseContiguous(context, begin, end, error);
+    }
+
+    std::string Parse(const std::string &input, const ParseOptions &options = ParseContext::DefaultOptions()) {
+        std::string error;
+        Parse(input.data(), input.data() + input.size(), &error, options);
+        return error;
+    }
+
+    const JsonValue &Root() const noexcept {
+        return root_;
+    }
+
+    JsonValue &Root() noexcept {
+        return root_;
+    }
+
+  private:
+    void Reset() {
+        root_ = JsonValue();
+        arena_.release();
+    }
+
+    std::pmr::monotonic_buffer_resource arena_;
+    std::string buffer_;
+    JsonValue root_;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json_parser.h"
+
+// Read-only mapping of a whole regular file
+class MappedFile {
+  public:
+    MappedFile() : data_(nullptr), size_(0) {
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        Close();
+    }
+
+    // Fails for files that cannot be mapped, such as pipes and empty files; error is left empty then.
+    // advice is passed to madvise(); the default suits reading the file front to back once.
+    bool Open(int fd, std::string *error, int advice = MADV_SEQUENTIAL) {
+        Close();
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            *error = std::string("cannot stat file: ") + std::strerror(errno);
+            return false;
+        }
+        if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+            return false;
+        }
+
+        void *data = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+
+        ::madvise(data, static_cast<size_t>(st.st_size), advice);
+
+        data_ = static_cast<const char *>(data);
+        size_ = static_cast<size_t>(st.st_size);
+        return true;
+    }
+
+    void Close() {
+        if (data_ != nullptr) {
+            ::munmap(const_cast<char *>(data_), size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+    }
+
+    const char *Data() const noexcept {
+        return data_;
+    }
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+
+  private:
+    const char *data_;
+    size_t size_;
+};
+
+// Appends everything that can be read from fd to out
+inline bool _ReadAll(int fd, std::string &out, std::string *error) {
+    char buf[64 * 1024];
+    while (true) {
+        ssize_t size = ::read(fd, buf, sizeof(buf));
+        if (size == 0) {
+            return true;
+        }
+        if (size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            *error = std::string("cannot read file: ") + std::strerror(errno);
+            return false;
+        }
+
+        out.append(buf, static_cast<size_t>(size));
+    }
+}
+
+// Parses a file straight from a read-only mapping of it, or from a buffered read of it when it
+// cannot be mapped, such as a pipe. Returns the error message, which is empty on success.
+//
+// The mapping is released before returning, so borrow_strings is ignored. To keep strings pointing
+// into the file, map it with MappedFile and call ParseJson on it.
+inline std::string ParseJsonFile(const std::string &path, JsonValue &value,
+                                 const ParseOptions &options = ParseContext::DefaultOptions()) {
+    std::string error;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return "cannot open " + path + ": " + std::strerror(errno);
+    }
+
+    ParseOptions file_options = options;
+    file_options.borrow_strings = false;
+
+    MappedFile file;
+    if (file.Open(fd, &error)) {
+        ::close(fd);
+        ParseJson(file.Data(), file.Data() + file.Size(), value, &error, file_options);
+        return error;
+    }
+
+    std::string input;
+    bool ok = error.empty() && _ReadAll(fd, input, &error);
+    ::close(fd);
+    if (!ok) {
+        return error;
+    }
+
+    ParseJson(input.data(), input.data() + input.size(), value, &error, file_options);
+    return error;
+}
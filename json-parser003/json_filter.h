@@ -0,0 +1,298 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_parser.h"
+#include "json_pointer.h"
+
+// The value found for one pointer of a JsonPointerFilter
+struct JsonFilterMatch {
+    bool found = false;
+    JsonValue value;
+};
+
+// A set of JSON Pointers compiled into a trie of reference tokens. It is read-only while parsing,
+// so one filter can be shared by parses on many threads.
+class JsonPointerFilter {
+  public:
+    JsonPointerFilter() : nodes_{Node{std::string(), kNoIndex, -1, {}}} {
+    }
+
+    // Returns the index of the pointer in the parse result, or -1 when it is not a valid JSON Pointer.
+    // Adding the same pointer twice returns the same index.
+    int Add(std::string_view pointer) {
+        std::vector<std::string> tokens;
+        if (!_ParseJsonPointer(pointer, tokens)) {
+            return -1;
+        }
+
+        size_t node = 0;
+        for (std::string &token : tokens) {
+            size_t child = _Child(node, token);
+            if (child == kNoNode) {
+                size_t index;
+                if (!_ParseJsonPointerIndex(token, index)) {
+                    index = kNoIndex;
+                }
+
+                child = nodes_.size();
+                nodes_[node].children.push_back(child);
+                nodes_.push_back(Node{std::move(token), index, -1, {}});
+            }
+            node = child;
+        }
+
+        if (nodes_[node].target < 0) {
+            nodes_[node].target = static_cast<int>(size_++);
+        }
+        return nodes_[node].target;
+    }
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+
+  private:
+    template <typename Source>
+    friend class FilterContext;
+
+    static constexpr size_t kNoIndex = std::numeric_limits<size_t>::max();
+    static constexpr size_t kNoNode = std::numeric_limits<size_t>::max();
+
+    struct Node {
+        std::string key;
+        // The key as an array index, or kNoIndex
+        size_t index;
+        // Index of the pointer that ends here, or -1
+        int target;
+        std::vector<size_t> children;
+    };
+
+    // Returns the child of node for an object key, or kNoNode when there is none
+    size_t _Child(size_t node, std::string_view key) const {
+        for (size_t child : nodes_[node].children) {
+            if (nodes_[child].key == key) {
+                return child;
+            }
+        }
+        return kNoNode;
+    }
+
+    // Returns the child of node for an array index, or kNoNode when there is none
+    size_t _Child(size_t node, size_t index) const {
+        for (size_t child : nodes_[node].children) {
+            if (nodes_[child].index == index) {
+                return child;
+            }
+        }
+        return kNoNode;
+    }
+
+    // Node 0 is the whole document
+    std::vector<Node> nodes_;
+    size_t size_ = 0;
+};
+
+// Context for _Parse on a value that leads to the targets of a filter. Values that lead nowhere are
+// skipped, which with ParseOptions::skip_unchecked only walks the structural index of contiguous input.
+template <typename Source>
+class FilterContext {
+  public:
+    FilterContext(const JsonPointerFilter *filter, size_t node, std::vector<JsonFilterMatch> *matches,
+                  std::string *buffer, const ParseOptions *options, size_t depth)
+        : filter_(filter), node_(node), matches_(matches), buffer_(buffer), options_(options), depth_(depth) {
+    }
+
+    // Parses the value at node of the filter: a target is parsed in full, a value on the way to one
+    // only looks for its children, and anything else is skipped
+    static bool Parse(const JsonPointerFilter &filter, size_t node, Source &in, std::vector<JsonFilterMatch> &matches,
+                      std::string &buffer, const ParseOptions &options, size_t depth) {
+        if (node == JsonPointerFilter::kNoNode) {
+            return _SkipValue(in, buffer, depth, options);
+        }
+
+        // with a duplicate key the last member wins, as in ParseJson
+        _Unmatch(filter, node, matches);
+
+        const JsonPointerFilter::Node &n = filter.nodes_[node];
+        if (n.target >= 0) {
+            JsonFilterMatch &match = matches[n.target];
+            match.found = true;
+            ParseContext context(&match.value, nullptr, &buffer, options, depth);
+            if (!_Parse(context, in)) {
+                return false;
+            }
+
+            _MatchNested(filter, node, match.value, matches);
+            return true;
+        }
+
+        if (n.children.empty()) {
+            return _SkipValue(in, buffer, depth, options);
+        }
+
+        FilterContext context(&filter, node, &matches, &buffer, &options, depth);
+        return _Parse(context, in);
+    }
+
+    bool SetNull() {
+        return true;
+    }
+
+    bool SetBool(bool) {
+        return true;
+    }
+
+    bool SetNumber(double) {
+        return true;
+    }
+
+    bool SetInt64(std::int64_t) {
+        return true;
+    }
+
+    bool ParseString(Source &in) {
+        SkipContext context(buffer_, depth_);
+        return context.ParseString(in);
+    }
+
+    bool ParseArrayStart() {
+        return _Open();
+    }
+
+    bool ParseArrayItem(Source &in, size_t index) {
+        return Parse(*filter_, filter_->_Child(node_, index), in, *matches_, *buffer_, *options_, depth_);
+    }
+
+    bool ParseArrayStop() {
+        ++depth_;
+        return true;
+    }
+
+    bool ParseObjectStart() {
+        return _Open();
+    }
+
+    bool ParseObjectItem(Source &in, const std::string &key) {
+        return Parse(*filter_, filter_->_Child(node_, key), in, *matches_, *buffer_, *options_, depth_);
+    }
+
+    bool ParseObjectStop() {
+        ++depth_;
+        return true;
+    }
+
+  private:
+    static void _Unmatch(const JsonPointerFilter &filter, size_t node, std::vector<JsonFilterMatch> &matches) {
+        const JsonPointerFilter::Node &n = filter.nodes_[node];
+        if (n.target >= 0 && matches[n.target].found) {
+            matches[n.target] = JsonFilterMatch();
+        }
+        for (size_t child : n.children) {
+            _Unmatch(filter, child, matches);
+        }
+    }
+
+    // A pointer below a target is looked up in the parsed value of the target
+    static void _MatchNested(const JsonPointerFilter &filter, size_t node, const JsonValue &value,
+                             std::vector<JsonFilterMatch> &matches) {
+        for (size_t child : filter.nodes_[node].children) {
+            const JsonPointerFilter::Node &n = filter.nodes_[child];
+            const JsonValue *member = nullptr;
+            if (value.Is<JsonArray>()) {
+                const JsonArray &array = value.Get<JsonArray>();
+                if (n.index < array.size()) {
+                    member = &array[n.index];
+                }
+            } else if (value.Is<JsonObject>()) {
+                const JsonObject &object = value.Get<JsonObject>();
+                auto it = object.find(std::string_view(n.key));
+                if (it != object.end()) {
+                    member = &it->second;
+                }
+            }
+
+            if (member == nullptr) {
+                continue;
+            }
+            if (n.target >= 0) {
+                matches[n.target].found = true;
+                matches[n.target].value = *member;
+            }
+            _MatchNested(filter, child, *member, matches);
+        }
+    }
+
+    bool _Open() {
+        if (depth_ == 0) {
+            return false;
+        }
+
+        --depth_;
+        return true;
+    }
+
+    const JsonPointerFilter *filter_;
+    size_t node_;
+    std::vector<JsonFilterMatch> *matches_;
+    std::string *buffer_;
+    const ParseOptions *options_;
+    size_t depth_;
+};
+
+template <typename Source>
+inline bool _ParseFiltered(Source &in, const JsonPointerFilter &filter, std::vector<JsonFilterMatch> &matches,
+                           std::string *error, const ParseOptions &options) {
+    matches.assign(filter.Size(), JsonFilterMatch());
+
+    std::string buffer;
+    if (!FilterContext<Source>::Parse(filter, 0, in, matches, buffer, options, options.max_depth)) {
+        if (error != nullptr) {
+            _SyntaxError(in, error);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+// Parses only the values at the pointers of filter into matches[i], where i is the index Add()
+// returned for the pointer. Everything else is checked as it is skipped, unless
+// options.skip_unchecked only counts the brackets of skipped values in contiguous input. The matches
+// are incomplete when parsing fails.
+template <typename Iter>
+Iter ParseJsonFiltered(const Iter &begin, const Iter &end, const JsonPointerFilter &filter,
+                       std::vector<JsonFilterMatch> &matches, std::string *error,
+                       const ParseOptions &options = ParseContext::DefaultOptions()) {
+    InputSource<Iter> in(begin, end);
+    _ParseFiltered(in, filter, matches, error, options);
+    return in.Current();
+}
+
+inline const char *ParseJsonFiltered(const char *begin, const char *end, const JsonPointerFilter &filter,
+                                     std::vector<JsonFilterMatch> &matches, std::string *error,
+                                     const ParseOptions &options = ParseContext::DefaultOptions()) {
+    StructuralIndex index;
+    if (StructuralIndex::IsSupported() && index.Build(begin, end)) {
+        StructuralInputSource in(begin, end, index);
+        _ParseFiltered(in, filter, matches, error, options);
+        return in.Current();
+    }
+
+    InputSource<const char *> in(begin, end);
+    _ParseFiltered(in, filter, matches, error, options);
+    return in.Current();
+}
+
+// Returns the error message, which is empty on success
+inline std::string ParseJsonFiltered(const std::string &input, const JsonPointerFilter &filter,
+                                     std::vector<JsonFilterMatch> &matches,
+                                     const ParseOptions &options = ParseContext::DefaultOptions()) {
+    std::string error;
+    ParseJsonFiltered(input.data(), input.data() + input.size(), filter, matches, &error, options);
+    return error;
+}
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "json_symbol_table.h"
+
+// Object members stored contiguously in insertion order. Lookups scan the members while there are
+// few of them, and go through a hash index once there are more than kMaxLinearSearch. The index is
+// kept up to date by the methods that add or remove members, so const lookups never write and can
+// run on several threads. The interface is the part of std::map that JsonObject users need.
+//
+// Keys are views. They point either into memory the object allocates from its resource, or, once a
+// key has been added with try_emplace_interned, into a SymbolTable for every key of the object.
+template <typename Value>
+class FlatObject {
+  public:
+    using key_type = std::string_view;
+    using mapped_type = Value;
+    using value_type = std::pair<std::string_view, Value>;
+    using allocator_type = std::pmr::polymorphic_allocator<value_type>;
+    using iterator = typename std::pmr::vector<value_type>::iterator;
+    using const_iterator = typename std::pmr::vector<value_type>::const_iterator;
+    using size_type = std::size_t;
+
+    static constexpr size_type kMaxLinearSearch = 16;
+
+    FlatObject() : symbols_(nullptr) {
+    }
+
+    explicit FlatObject(const allocator_type &allocator) : members_(allocator), index_(allocator), symbols_(nullptr) {
+    }
+
+    FlatObject(std::initializer_list<value_type> members) : FlatObject() {
+        for (const value_type &member : members) {
+            try_emplace(member.first).first->second = member.second;
+        }
+    }
+
+    // Like the standard containers, a copy uses the default resource. It owns its keys and builds its
+    // own index.
+    FlatObject(const FlatObject &other) : FlatObject() {
+        _CopyFrom(other);
+    }
+
+    FlatObject(FlatObject &&other) noexcept
+        : members_(std::move(other.members_)), index_(std::move(other.index_)), symbols_(other.symbols_) {
+        other.members_.clear();
+        other.index_.clear();
+        other.symbols_ = nullptr;
+    }
+
+    FlatObject &operator=(const FlatObject &other) {
+        if (this != &other) {
+            clear();
+            _CopyFrom(other);
+        }
+        return *this;
+    }
+
+    // Keys allocated from another resource are copied, as the elements of a pmr vector are
+    FlatObject &operator=(FlatObject &&other) {
+        if (this == &other) {
+            return *this;
+        }
+
+        clear();
+        if (get_allocator() != other.get_allocator()) {
+            _CopyFrom(other);
+            return *this;
+        }
+
+        members_.swap(other.members_);
+        index_.swap(other.index_);
+        std::swap(symbols_, other.symbols_);
+        return *this;
+    }
+
+    ~FlatObject() {
+        clear();
+    }
+
+    allocator_type get_allocator() const noexcept {
+        return members_.get_allocator();
+    }
+
+    iterator begin() noexcept {
+        return members_.begin();
+    }
+    iterator end() noexcept {
+        return members_.end();
+    }
+    const_iterator begin() const noexcept {
+        return members_.begin();
+    }
+    const_iterator end() const noexcept {
+        return members_.end();
+    }
+
+    size_type size() const noexcept {
+        return members_.size();
+    }
+
+    bool empty() const noexcept {
+        return members_.empty();
+    }
+
+    size_type capacity() const noexcept {
+        return members_.capacity();
+    }
+
+    void reserve(size_type size) {
+        members_.reserve(size);
+    }
+
+    void clear() noexcept {
+        for (value_type &member : members_) {
+            _FreeKey(member.first);
+        }
+        members_.clear();
+        index_.clear();
+        symbols_ = nullptr;
+    }
+
+    iterator find(std::string_view key) {
+        return members_.begin() + _Find(key);
+    }
+
+    const_iterator find(std::string_view key) const {
+        return members_.begin() + _Find(key);
+    }
+
+    size_type count(std::string_view key) const {
+        return _Find(key) != members_.size() ? 1 : 0;
+    }
+
+    // Appends a member with a default value unless key is already there
+    std::pair<iterator, bool> try_emplace(std::string_view key) {
+        size_type pos = _Find(key);
+        if (pos != members_.size()) {
+            return {members_.begin() + pos, false};
+        }
+
+        return {_Append(symbols_ != nullptr ? symbols_->Intern(key) : _CopyKey(key)), true};
+    }
+
+    // Like try_emplace, for a key that is already interned in symbols. The key is not copied unless
+    // the object already owns copies of its other keys.
+    std::pair<iterator, bool> try_emplace_interned(std::string_view key, SymbolTable &symbols) {
+        if (members_.empty()) {
+            symbols_ = &symbols;
+        }
+        if (symbols_ != &symbols) {
+            return try_emplace(key);
+        }
+
+        size_type pos = _Find(key);
+        if (pos != members_.size()) {
+            return {members_.begin() + pos, false};
+        }
+
+        return {_Append(key), true};
+    }
+
+    Value &operator[](std::string_view key) {
+        return try_emplace(key).first->second;
+    }
+
+    size_type erase(std::string_view key) {
+        size_type pos = _Find(key);
+        if (pos == members_.size()) {
+            return 0;
+        }
+
+        _FreeKey(members_[pos].first);
+        members_.erase(members_.begin() + pos);
+        // the positions after pos have moved
+        index_.clear();
+        if (members_.size() > kMaxLinearSearch) {
+            _BuildIndex();
+        }
+        return 1;
+    }
+
+    // Objects are equal when they have the same members in any order
+    bool operator==(const FlatObject &other) const {
+        if (size() != other.size()) {
+            return false;
+        }
+
+        for (const value_type &member : members_) {
+            auto it = other.find(member.first);
+            if (it == other.end() || !(it->second == member.second)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool operator!=(const FlatObject &other) const {
+        return !(*this == other);
+    }
+
+  private:
+    std::pmr::memory_resource *_Resource() const noexcept {
+        return members_.get_allocator().resource();
+    }
+
+    std::string_view _CopyKey(std::string_view key) {
+        if (key.empty()) {
+            return std::string_view();
+        }
+
+        char *chars = static_cast<char *>(_Resource()->allocate(key.size(), 1));
+        std::memcpy(chars, key.data(), key.size());
+        return std::string_view(chars, key.size());
+    }
+
+    void _FreeKey(std::string_view key) noexcept {
+        if (symbols_ == nullptr && !key.empty()) {
+            _Resource()->deallocate(const_cast<char *>(key.data()), key.size(), 1);
+        }
+    }
+
+    void _CopyFrom(const FlatObject &other) {
+        members_.reserve(other.size());
+        for (const value_type &member : other.members_) {
+            members_.emplace_back(_CopyKey(member.first), member.second);
+        }
+        if (members_.size() > kMaxLinearSearch) {
+            _BuildIndex();
+        }
+    }
+
+    iterator _Append(std::string_view key) {
+        members_.emplace_back(key, Value());
+        if (!index_.empty()) {
+            _IndexInsert(members_.size() - 1);
+        } else if (members_.size() > kMaxLinearSearch) {
+            _BuildIndex();
+        }
+        return members_.end() - 1;
+    }
+
+    // Returns the position of key, or size() when it is missing
+    size_type _Find(std::string_view key) const {
+        if (index_.empty()) {
+            for (size_type i = 0; i < members_.size(); ++i) {
+                if (members_[i].first == key) {
+                    return i;
+                }
+            }
+            return members_.size();
+        }
+
+        size_type mask = index_.size() - 1;
+        for (size_type slot = std::hash<std::string_view>()(key) & mask; index_[slot] != 0; slot = (slot + 1) & mask) {
+            if (members_[index_[slot] - 1].first == key) {
+                return index_[slot] - 1;
+            }
+        }
+        return members_.size();
+    }
+
+    // Open addressing with linear probing; a slot holds the member position plus one, 0 is empty
+    void _BuildIndex() {
+        size_type capacity = 32;
+        while (capacity < members_.size() * 2) {
+            capacity *= 2;
+        }
+
+        index_.assign(capacity, 0);
+        for (size_type i = 0; i < members_.size(); ++i) {
+            _IndexInsert(i);
+        }
+    }
+
+    void _IndexInsert(size_type pos) {
+        if (members_.size() * 2 > index_.size()) {
+            _BuildIndex();
+            return;
+        }
+
+        size_type mask = index_.size() - 1;
+        size_type slot = std::hash<std::string_view>()(members_[pos].first) & mask;
+        while (index_[slot] != 0) {
+            slot = (slot + 1) & mask;
+        }
+        index_[slot] = static_cast<std::uint32_t>(pos + 1);
+    }
+
+    std::pmr::vector<value_type> members_;
+    // Empty while there are at most kMaxLinearSearch members
+    std::pmr::vector<std::uint32_t> index_;
+    // Set when every key is interned in this table instead of owned by the object
+    SymbolTable *symbols_;
+};
@@ -0,0 +1,500 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_parser.h"
+#include "json_pointer.h"
+#include "structural_index.h"
+
+class LazyDocument;
+class LazyIterator;
+
+// A value in a LazyDocument, reached by key, index, JSON Pointer or iteration. Nothing is unescaped
+// or converted until ToValue() is called. An invalid value stands for a missing member or element.
+class LazyValue {
+  public:
+    LazyValue() : doc_(nullptr), pos_(0) {
+    }
+
+    bool IsValid() const noexcept {
+        return doc_ != nullptr;
+    }
+
+    // Numbers are told apart by their text, and only an integer of 19 digits or more is converted to
+    // see whether it fits in int64. kNull for an invalid value or number.
+    JsonType Type() const;
+
+    // Elements of an array or members of an object. Like iteration, this counts every member in the
+    // text, including the earlier ones of a repeated key. The count is not kept, so each call walks
+    // the whole container.
+    size_t Size() const;
+
+    // The last member with the key, whose value ToValue() on the object keeps
+    LazyValue operator[](std::string_view key) const;
+    // Walks the elements before index, so indexing every element in a loop is quadratic; iterate
+    // instead
+    LazyValue operator[](size_t index) const;
+    LazyValue At(std::string_view pointer) const;
+
+    // Iterates the elements of an array or the members of an object
+    LazyIterator begin() const;
+    LazyIterator end() const;
+
+    // Parses this value, and only this value, into value
+    bool ToValue(JsonValue &value, std::string *error = nullptr) const;
+
+  private:
+    friend class LazyDocument;
+    friend class LazyIterator;
+
+    LazyValue(const LazyDocument *doc, std::uint32_t pos) : doc_(doc), pos_(pos) {
+    }
+
+    char _Char() const;
+    JsonType _NumberType() const;
+
+    const LazyDocument *doc_;
+    // Index of the first token of the value in the structural index
+    std::uint32_t pos_;
+};
+
+class LazyIterator {
+  public:
+    LazyValue operator*() const {
+        return LazyValue(doc_, is_object_ ? pos_ + 3 : pos_);
+    }
+
+    // The unescaped key of the current object member
+    std::string Key() const;
+
+    LazyIterator &operator++();
+
+    bool operator==(const LazyIterator &other) const noexcept {
+        return pos_ == other.pos_;
+    }
+
+    bool operator!=(const LazyIterator &other) const noexcept {
+        return pos_ != other.pos_;
+    }
+
+  private:
+    friend class LazyValue;
+
+    LazyIterator(const LazyDocument *doc, std::uint32_t pos, bool is_object) : doc_(doc), pos_(pos), is_object_(is_object) {
+    }
+
+    const LazyDocument *doc_;
+    // An element, or the opening quote of a key followed by its closing quote, ':' and the value
+    std::uint32_t pos_;
+    bool is_object_;
+};
+
+// Parsing only runs stage 1 of the two-stage parser and checks the order of the tokens it found,
+// which also pairs up every bracket. Walking to a value then skips whole subtrees in one step, and
+// strings and numbers are checked when they are converted.
+//
+// The input is not copied, so it must outlive the document.
+class LazyDocument {
+  public:
+    LazyDocument() : begin_(nullptr), end_(nullptr) {
+    }
+
+    LazyDocument(const LazyDocument &) = delete;
+    LazyDocument &operator=(const LazyDocument &) = delete;
+
+    bool Parse(const char *begin, const char *end, std::string *error,
+               const ParseOptions &options = ParseContext::DefaultOptions()) {
+        begin_ = begin;
+        end_ = end;
+        options_ = options;
+        matches_.clear();
+
+        if (!index_.Build(begin, end)) {
+            if (error != nullptr) {
+                *error = "input too large";
+            }
+            return false;
+        }
+
+        return _Validate(error);
+    }
+
+    // Returns the error message, which is empty on success
+    std::string Parse(const std::string &input, const ParseOptions &options = ParseContext::DefaultOptions()) {
+        std::string error;
+        Parse(input.data(), input.data() + input.size(), &error, options);
+        return error;
+    }
+
+    // The document would point into the temporary
+    std::string Parse(std::string &&input, const ParseOptions &options = ParseContext::DefaultOptions()) = delete;
+
+    LazyValue Root() const {
+        return matches_.empty() ? LazyValue() : LazyValue(this, 0);
+    }
+
+  private:
+    friend class LazyValue;
+    friend class LazyIterator;
+
+    enum class Expect : std::uint8_t {
+        kValue,
+        kValueOrClose,
+        kKey,
+        kKeyOrClose,
+        kColon,
+        kCommaOrClose,
+        kEnd,
+    };
+
+    const char *_Ptr(std::uint32_t pos) const {
+        const std::vector<std::uint32_t> &positions = index_.Positions();
+        return pos < positions.size() ? begin_ + positions[pos] : end_;
+    }
+
+    char _Char(std::uint32_t pos) const {
+        return *_Ptr(pos);
+    }
+
+    // Returns the token after the value at pos
+    std::uint32_t _Skip(std::uint32_t pos) const {
+        switch (_Char(pos)) {
+        case '[':
+        case '{':
+            return matches_[pos] + 1;
+        case '"':
+            return pos + 2;
+        default:
+            return pos + 1;
+        }
+    }
+
+    // The key whose opening quote is at pos, unescaped only when it has escapes
+    std::string_view _Key(std::uint32_t pos, std::string &buffer) const {
+        const char *begin = _Ptr(pos) + 1;
+        const char *end = _Ptr(pos + 1);
+        if (std::memchr(begin, '\\', static_cast<size_t>(end - begin)) == nullptr) {
+            return std::string_view(begin, static_cast<size_t>(end - begin));
+        }
+
+        InputSource<const char *> in(begin, end + 1);
+        buffer.clear();
+        _ParseString(buffer, in);
+        return buffer;
+    }
+
+    bool _Fail(std::uint32_t pos, std::string *error) {
+        if (error != nullptr) {
+            StructuralInputSource in(begin_, end_, index_, _Ptr(pos));
+            _SyntaxError(in, error);
+        }
+
+        matches_.clear();
+        return false;
+    }
+
+    // Checks the grammar at the level of tokens, with an explicit stack instead of recursion, and
+    // records the closing bracket of every opening one
+    bool _Validate(std::string *error) {
+        const std::vector<std::uint32_t> &positions = index_.Positions();
+        std::uint32_t size = static_cast<std::uint32_t>(positions.size());
+        matches_.assign(size, 0);
+
+        std::vector<std::uint32_t> open;
+        Expect expect = Expect::kValue;
+        for (std::uint32_t i = 0; i < size; ++i) {
+            char ch = _Char(i);
+            bool value_done = false;
+            switch (expect) {
+            case Expect::kValueOrClose:
+                if (ch == ']') {
+                    if (!_Close(open, i)) {
+                        return _Fail(i, error);
+                    }
+                    value_done = true;
+                    break;
+                }
+                [[fallthrough]];
+            case Expect::kValue:
+                if (ch == '[' || ch == '{') {
+                    open.push_back(i);
+                    expect = ch == '[' ? Expect::kValueOrClose : Expect::kKeyOrClose;
+                } else if (ch == '"') {
+                    if (i + 1 == size) {
+                        return _Fail(i, error);
+                    }
+                    ++i;
+                    value_done = true;
+                } else if ((ch >= '0' && ch <= '9') || ch == '-' || ch == 't' || ch == 'f' || ch == 'n') {
+                    value_done = true;
+                } else {
+                    return _Fail(i, error);
+                }
+                break;
+            case Expect::kKeyOrClose:
+                if (ch == '}') {
+                    if (!_Close(open, i)) {
+                        return _Fail(i, error);
+                    }
+                    value_done = true;
+                    break;
+                }
+                [[fallthrough]];
+            case Expect::kKey:
+                if (ch != '"' || i + 1 == size) {
+                    return _Fail(i, error);
+                }
+                ++i;
+                expect = Expect::kColon;
+                break;
+            case Expect::kColon:
+                if (ch != ':') {
+                    return _Fail(i, error);
+                }
+                expect = Expect::kValue;
+                break;
+            case Expect::kCommaOrClose:
+                if (ch == ',') {
+                    expect = _Char(open.back()) == '[' ? Expect::kValue : Expect::kKey;
+                } else if (!_Close(open, i)) {
+                    return _Fail(i, error);
+                } else {
+                    value_done = true;
+                }
+                break;
+            case Expect::kEnd:
+                return _Fail(i, error);
+            }
+
+            if (value_done) {
+                expect = open.empty() ? Expect::kEnd : Expect::kCommaOrClose;
+            }
+        }
+
+        if (expect != Expect::kEnd) {
+            return _Fail(size, error);
+        }
+
+        return true;
+    }
+
+    bool _Close(std::vector<std::uint32_t> &open, std::uint32_t pos) {
+        char ch = _Char(pos);
+        if (open.empty() || (ch != ']' && ch != '}') || _Char(open.back()) != (ch == ']' ? '[' : '{')) {
+            return false;
+        }
+
+        matches_[open.back()] = pos;
+        open.pop_back();
+        return true;
+    }
+
+    const char *begin_;
+    const char *end_;
+    ParseOptions options_;
+    StructuralIndex index_;
+    // For an opening bracket, the position of its closing bracket
+    std::vector<std::uint32_t> matches_;
+};
+
+inline char LazyValue::_Char() const {
+    return doc_->_Char(pos_);
+}
+
+inline JsonType LazyValue::Type() const {
+    if (!IsValid()) {
+        return JsonType::kNull;
+    }
+
+    switch (_Char()) {
+    case '{':
+        return JsonType::kObject;
+    case '[':
+        return JsonType::kArray;
+    case '"':
+        return JsonType::kString;
+    case 't':
+    case 'f':
+        return JsonType::kBoolean;
+    case 'n':
+        return JsonType::kNull;
+    default:
+        return _NumberType();
+    }
+}
+
+// Checks the number the way _ParseNumber does, up to the next token
+inline JsonType LazyValue::_NumberType() const {
+    const char *p = doc_->_Ptr(pos_);
+    const char *end = doc_->_Ptr(pos_ + 1);
+    auto digits = [&p, end] {
+        const char *start = p;
+        while (p != end && *p >= '0' && *p <= '9') {
+            ++p;
+        }
+        return static_cast<size_t>(p - start);
+    };
+
+    if (*p == '-') {
+        ++p;
+    }
+    const char *integer = p;
+    size_t integer_digits = digits();
+    if (integer_digits == 0 || (integer_digits > 1 && *integer == '0')) {
+        return JsonType::kNull;
+    }
+
+    bool is_integer = true;
+    if (p != end && *p == '.') {
+        is_integer = false;
+        ++p;
+        if (digits() == 0) {
+            return JsonType::kNull;
+        }
+    }
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        is_integer = false;
+        ++p;
+        if (p != end && (*p == '+' || *p == '-')) {
+            ++p;
+        }
+        if (digits() == 0) {
+            return JsonType::kNull;
+        }
+    }
+
+    while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        ++p;
+    }
+    if (p != end) {
+        return JsonType::kNull;
+    }
+
+    if (!is_integer) {
+        return JsonType::kNumber;
+    }
+    if (integer_digits < 19) {
+        return JsonType::kInteger;
+    }
+
+    // larger integers become doubles
+    JsonValue value;
+    return ToValue(value) ? value.Type() : JsonType::kNull;
+}
+
+inline size_t LazyValue::Size() const {
+    size_t size = 0;
+    for (LazyIterator it = begin(); it != end(); ++it) {
+        ++size;
+    }
+    return size;
+}
+
+inline LazyValue LazyValue::operator[](std::string_view key) const {
+    if (!IsValid() || _Char() != '{') {
+        return LazyValue();
+    }
+
+    std::string buffer;
+    LazyValue found;
+    for (std::uint32_t pos = pos_ + 1; pos < doc_->matches_[pos_]; pos = doc_->_Skip(pos + 3) + 1) {
+        if (doc_->_Key(pos, buffer) == key) {
+            found = LazyValue(doc_, pos + 3);
+        }
+    }
+
+    return found;
+}
+
+inline LazyValue LazyValue::operator[](size_t index) const {
+    if (!IsValid() || _Char() != '[') {
+        return LazyValue();
+    }
+
+    for (LazyIterator it = begin(); it != end(); ++it) {
+        if (index-- == 0) {
+            return *it;
+        }
+    }
+
+    return LazyValue();
+}
+
+inline LazyValue LazyValue::At(std::string_view pointer) const {
+    std::vector<std::string> tokens;
+    if (!_ParseJsonPointer(pointer, tokens)) {
+        return LazyValue();
+    }
+
+    LazyValue value = *this;
+    for (const std::string &token : tokens) {
+        size_t index;
+        if (value.IsValid() && value._Char() == '[') {
+            value = _ParseJsonPointerIndex(token, index) ? value[index] : LazyValue();
+        } else {
+            value = value[std::string_view(token)];
+        }
+    }
+
+    return value;
+}
+
+inline LazyIterator LazyValue::begin() const {
+    if (!IsValid() || (_Char() != '[' && _Char() != '{')) {
+        return LazyIterator(doc_, 0, false);
+    }
+
+    // an empty container begins at its closing bracket
+    std::uint32_t close = doc_->matches_[pos_];
+    return LazyIterator(doc_, pos_ + 1 == close ? close : pos_ + 1, _Char() == '{');
+}
+
+inline LazyIterator LazyValue::end() const {
+    if (!IsValid() || (_Char() != '[' && _Char() != '{')) {
+        return LazyIterator(doc_, 0, false);
+    }
+
+    return LazyIterator(doc_, doc_->matches_[pos_], _Char() == '{');
+}
+
+inline bool LazyValue::ToValue(JsonValue &value, std::string *error) const {
+    if (!IsValid()) {
+        if (error != nullptr) {
+            *error = "no such value";
+        }
+        return false;
+    }
+
+    StructuralInputSource in(doc_->begin_, doc_->end_, doc_->index_, doc_->_Ptr(pos_));
+    ParseContext context(&value, nullptr, nullptr, doc_->options_);
+    if (!_Parse(context, in, error)) {
+        return false;
+    }
+
+    // a scalar has to end where the next token starts
+    in.SkipWhiteSpace();
+    if (in.Current() != doc_->_Ptr(doc_->_Skip(pos_))) {
+        if (error != nullptr) {
+            _SyntaxError(in, error);
+        }
+        return false;
+    }
+
+    return true;
+}
+
+inline std::string LazyIterator::Key() const {
+    std::string buffer;
+    std::string_view key = doc_->_Key(pos_, buffer);
+    return std::string(key);
+}
+
+inline LazyIterator &LazyIterator::operator++() {
+    std::uint32_t next = doc_->_Skip(is_object_ ? pos_ + 3 : pos_);
+    pos_ = doc_->_Char(next) == ',' ? next + 1 : next;
+    return *this;
+}
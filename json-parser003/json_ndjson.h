@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "json_parser.h"
+
+// Newline-delimited JSON (NDJSON, JSON Lines): one value per line. Raw newlines cannot appear
+// inside a JSON value, so every '\n' ends a record and the input can be cut into batches of lines
+// without parsing it. The batches are parsed on worker threads and handed back in input order.
+
+struct NdjsonOptions {
+    // Number of worker threads, 0 for one per hardware thread
+    unsigned threads = 0;
+    // A batch is the lines that start in this many bytes. With one thread too, a batch is parsed only
+    // once the records before it are delivered.
+    size_t batch_bytes = 1 << 20;
+    // Batches parsed ahead of the callback, which bounds the memory held by parsed values. 0 for
+    // twice the number of threads.
+    size_t max_batches_in_flight = 0;
+    ParseOptions parse;
+};
+
+// Reports line numbers and offsets of the whole input while parsing a single record
+class NdjsonRecordSource : public InputSource<const char *> {
+  public:
+    NdjsonRecordSource(const char *begin, const char *end, size_t line, size_t offset)
+        : InputSource<const char *>(begin, end), line_(line), offset_(offset) {
+    }
+
+    int Line() const noexcept {
+        return InputSource<const char *>::Line() + static_cast<int>(line_) - 1;
+    }
+
+    size_t Offset() const noexcept {
+        return InputSource<const char *>::Offset() + offset_;
+    }
+
+  private:
+    size_t line_;
+    size_t offset_;
+};
+
+struct _NdjsonRecord {
+    size_t line;
+    JsonValue value;
+    std::string error;
+};
+
+struct _NdjsonBatch {
+    const char *begin;
+    const char *end;
+    size_t first_line;
+    size_t first_offset;
+    std::vector<_NdjsonRecord> records;
+    bool done;
+    // Thrown while parsing, and rethrown when the batch is delivered
+    std::exception_ptr exception;
+};
+
+// Points batch at the lines that start in the next batch_bytes from cursor, and moves cursor and line
+// past them. begin is the start of the input.
+inline void _CutNdjsonBatch(const char *begin, const char *&cursor, const char *end, size_t batch_bytes, size_t &line,
+                            _NdjsonBatch &batch) {
+    const char *cut = cursor + std::min(batch_bytes, static_cast<size_t>(end - cursor));
+    const char *eol = static_cast<const char *>(std::memchr(cut, '\n', static_cast<size_t>(end - cut)));
+    batch.begin = cursor;
+    batch.end = eol == nullptr ? end : eol + 1;
+    batch.first_line = line;
+    batch.first_offset = static_cast<size_t>(cursor - begin);
+    batch.done = false;
+    batch.exception = nullptr;
+
+    line += static_cast<size_t>(std::count(batch.begin, batch.end, '\n'));
+    cursor = batch.end;
+}
+
+// Blank lines are skipped. Anything but whitespace after the value is an error.
+inline void _ParseNdjsonBatch(_NdjsonBatch &batch, const ParseOptions &options) {
+    size_t line = batch.first_line;
+    for (const char *p = batch.begin; p != batch.end; ++line) {
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(batch.end - p)));
+        const char *next = eol == nullptr ? batch.end : eol + 1;
+        if (eol == nullptr) {
+            eol = batch.end;
+        }
+
+        NdjsonRecordSource in(p, eol, line, batch.first_offset + static_cast<size_t>(p - batch.begin));
+        p = next;
+
+        in.SkipWhiteSpace();
+        if (in.GetChar() == NdjsonRecordSource::END_OF_INPUT) {
+            continue;
+        }
+        in.UnGetChar();
+
+        batch.records.push_back(_NdjsonRecord{line, JsonValue(), std::string()});
+        _NdjsonRecord &record = batch.records.back();
+        ParseContext context(&record.value, nullptr, nullptr, options);
+        if (!_Parse(context, in, &record.error)) {
+            continue;
+        }
+
+        in.SkipWhiteSpace();
+        if (in.GetChar() != NdjsonRecordSource::END_OF_INPUT) {
+            in.UnGetChar();
+            _SyntaxError(in, &record.error);
+        }
+    }
+}
+
+// Hands the records of a parsed batch to the callback. Returns false when the callback stops.
+template <typename Callback>
+inline bool _DeliverNdjsonBatch(_NdjsonBatch &batch, Callback &callback) {
+    if (batch.exception != nullptr) {
+        std::rethrow_exception(batch.exception);
+    }
+
+    for (_NdjsonRecord &record : batch.records) {
+        if (!callback(record.line, record.value, record.error)) {
+            return false;
+        }
+    }
+
+    batch.records.clear();
+    return true;
+}
+
+// Calls callback(line, value, error) for every non-blank line in input order; error is empty when
+// the line parsed. Returns false if the callback returned false, which stops the parse.
+template <typename Callback>
+bool ParseNdjson(const char *begin, const char *end, Callback callback, const NdjsonOptions &options = NdjsonOptions()) {
+    unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    if (threads == 1) {
+        // each batch is delivered before the next is parsed, so memory is bounded as with threads
+        _NdjsonBatch batch{begin, begin, 1, 0, {}, false, nullptr};
+        size_t line = 1;
+        for (const char *cursor = begin; cursor != end;) {
+            _CutNdjsonBatch(begin, cursor, end, options.batch_bytes, line, batch);
+            _ParseNdjsonBatch(batch, options.parse);
+            if (!_DeliverNdjsonBatch(batch, callback)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the symbol table is not thread-safe
+    ParseOptions parse_options = options.parse;
+    parse_options.symbols = nullptr;
+
+    size_t max_batches = options.max_batches_in_flight != 0 ? options.max_batches_in_flight : 2 * threads;
+    std::vector<_NdjsonBatch> slots(max_batches);
+
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable batch_done;
+    size_t produced = 0;
+    size_t next = 0;
+    bool stop = false;
+
+    auto worker = [&]() {
+#ifdef JSON_PARSE_STATS
+        // neither are the stats, so each worker counts its own
+        ParseStats stats;
+        ParseOptions worker_options = parse_options;
+        worker_options.stats = parse_options.stats != nullptr ? &stats : nullptr;
+#else
+        const ParseOptions &worker_options = parse_options;
+#endif
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [&] { return stop || next < produced; });
+            if (stop) {
+#ifdef JSON_PARSE_STATS
+                if (parse_options.stats != nullptr) {
+                    parse_options.stats->Merge(stats);
+                }
+#endif
+                return;
+            }
+
+            _NdjsonBatch &batch = slots[next++ % max_batches];
+            lock.unlock();
+
+            try {
+                _ParseNdjsonBatch(batch, worker_options);
+            } catch (...) {
+                batch.exception = std::current_exception();
+            }
+
+            lock.lock();
+            batch.done = true;
+            batch_done.notify_all();
+        }
+    };
+
+    // Stops and joins the workers however this function returns, an exception from the callback
+    // included, since destroying a joinable thread terminates the process
+    struct WorkerGuard {
+        std::mutex &mutex;
+        std::condition_variable &work_ready;
+        bool &stop;
+        std::vector<std::thread> workers;
+
+        ~WorkerGuard() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stop = true;
+            }
+            work_ready.notify_all();
+            for (std::thread &t : workers) {
+                t.join();
+            }
+        }
+    } guard{mutex, work_ready, stop, {}};
+    std::vector<std::thread> &workers = guard.workers;
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(worker);
+    }
+
+    // This thread cuts the batches, which also counts their lines, and delivers them in order
+    const char *cursor = begin;
+    size_t line = 1;
+    size_t consumed = 0;
+    while (true) {
+        while (produced < consumed + max_batches && cursor != end) {
+            _CutNdjsonBatch(begin, cursor, end, options.batch_bytes, line, slots[produced % max_batches]);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            ++produced;
+            work_ready.notify_one();
+        }
+
+        if (consumed == produced) {
+            break;
+        }
+
+        _NdjsonBatch &batch = slots[consumed % max_batches];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            batch_done.wait(lock, [&] { return batch.done; });
+        }
+
+        if (!_DeliverNdjsonBatch(batch, callback)) {
+            return false;
+        }
+        ++consumed;
+    }
+
+    return true;
+}
+
+// Appends the value of every non-blank line to values. Stops at the first invalid line and returns
+// its error message, or an empty string on success.
+inline std::string ParseNdjson(const std::string &input, std::vector<JsonValue> &values,
+                               const NdjsonOptions &options = NdjsonOptions()) {
+    std::string error;
+    ParseNdjson(
+        input.data(), input.data() + input.size(),
+        [&](size_t, JsonValue &value, const std::string &record_error) {
+            if (!record_error.empty()) {
+                error = record_error;
+                return false;
+            }
+
+            values.push_back(std::move(value));
+            return true;
+        },
+        options);
+    return error;
+}
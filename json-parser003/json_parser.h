@@ -1,25 +1,35 @@
 #pragma once
 
-#include <cinttypes>
-#include <errno.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <iterator>
 #include <limits>
 #include <sstream>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include "json_value.h"
 #include "input_source.h"
+#include "json_number.h"
+#include "json_stats.h"
+#include "structural_index.h"
 
 // RFC 8259 secion 7 Strings
 inline bool _IsControlCharacter(int ch) {
     return ch >= 0 && ch < ' ';
 }
 
-template <typename Iter>
-inline int _ParseQuadHex(InputSource<Iter> &in) {
+template <typename Source>
+inline int _ParseQuadHex(Source &in) {
     int unicode_char = 0;
 
     for (int i = 0; i < 4; ++i) {
         int hex = in.GetChar();
-        if (hex == InputSource<Iter>::END_OF_INPUT) {
+        if (hex == Source::END_OF_INPUT) {
             return -1;
         }
 
@@ -40,8 +50,8 @@ inline int _ParseQuadHex(InputSource<Iter> &in) {
     return unicode_char;
 }
 
-template <typename String, typename Iter>
-inline bool _ParseCodePoint(String &out, InputSource<Iter> &in) {
+template <typename String, typename Source>
+inline bool _ParseCodePoint(String &out, Source &in) {
     int unicode_char = _ParseQuadHex(in);
     if (unicode_char == -1) {
         return false;
@@ -99,11 +109,43 @@ inline bool _ParseCodePoint(String &out, InputSource<Iter> &in) {
     return true;
 }
 
-template <typename Iter>
-inline bool _ParseString(std::string &out, InputSource<Iter> &in) {
+// Copies a multibyte UTF-8 sequence whose lead byte has been read, rejecting an invalid one and
+// recording its offset in the source
+template <typename Source>
+inline bool _ParseUtf8Sequence(std::string &out, Source &in, int lead) {
+    size_t offset = in.Offset();
+    int length;
+    unsigned char low, high;
+    if (!_Utf8SequenceBounds(static_cast<unsigned char>(lead), length, low, high)) {
+        in.UnGetChar();
+        in.SetInvalidUtf8Offset(offset);
+        return false;
+    }
+
+    out.push_back(static_cast<char>(lead));
+    for (int i = 0; i < length; ++i) {
+        int ch = in.GetChar();
+        if (ch == Source::END_OF_INPUT || ch < low || ch > high) {
+            in.UnGetChar();
+            in.SetInvalidUtf8Offset(offset);
+            return false;
+        }
+
+        out.push_back(static_cast<char>(ch));
+        low = 0x80;
+        high = 0xbf;
+    }
+
+    return true;
+}
+
+template <typename Source>
+inline bool _ParseString(std::string &out, Source &in) {
     while (true) {
+        in.ReadStringRun(out);
+
         int ch = in.GetChar();
-        if (_IsControlCharacter(ch) || ch == InputSource<Iter>::END_OF_INPUT) {
+        if (_IsControlCharacter(ch) || ch == Source::END_OF_INPUT) {
             in.UnGetChar();
             return false;
         }
@@ -113,7 +155,7 @@ inline bool _ParseString(std::string &out, InputSource<Iter> &in) {
         }
 
         if (ch == '\\') {
-            if ((ch = in.GetChar()) == InputSource<Iter>::END_OF_INPUT) {
+            if ((ch = in.GetChar()) == Source::END_OF_INPUT) {
                 return false;
             }
 
@@ -150,6 +192,10 @@ inline bool _ParseString(std::string &out, InputSource<Iter> &in) {
             default:
                 return false;
             }
+        } else if (ch >= 0x80 && in.ValidatesUtf8()) {
+            if (!_ParseUtf8Sequence(out, in, ch)) {
+                return false;
+            }
         } else {
             out.push_back(static_cast<char>(ch));
         }
@@ -159,8 +205,8 @@ inline bool _ParseString(std::string &out, InputSource<Iter> &in) {
 }
 
 class ParseContext;
-template <typename Context, typename Iter>
-inline bool _ParseArray(Context &context, InputSource<Iter> &in) {
+template <typename Context, typename Source>
+inline bool _ParseArray(Context &context, Source &in) {
     if (!context.ParseArrayStart()) {
         return false;
     }
@@ -185,8 +231,8 @@ inline bool _ParseArray(Context &context, InputSource<Iter> &in) {
     return false;
 }
 
-template <typename Context, typename Iter>
-inline bool _ParseObject(Context &context, InputSource<Iter> &in) {
+template <typename Context, typename Source>
+inline bool _ParseObject(Context &context, Source &in) {
     if (!context.ParseObjectStart()) {
         return false;
     }
@@ -195,8 +241,9 @@ inline bool _ParseObject(Context &context, InputSource<Iter> &in) {
         return context.ParseObjectStop();
     }
 
+    std::string key;
     do {
-        std::string key;
+        key.clear();
         if (!in.Expect('"')) {
             return false;
         }
@@ -219,35 +266,146 @@ inline bool _ParseObject(Context &context, InputSource<Iter> &in) {
     return false;
 }
 
-template <typename Iter>
-inline std::string _ParseNumber(InputSource<Iter> &in) {
-    std::string num_string;
-    while (true) {
-        int ch = in.GetChar();
-        if ((ch >= '0' && ch <= '9') || ch == '+' || ch == '-' || ch == 'e' || ch == 'E') {
-            num_string.push_back(static_cast<char>(ch));
-        } else if (ch == '.') {
-            num_string.push_back('.');
-        } else {
+// Numbers longer than this are copied into a std::string for the strtod fallback
+constexpr size_t kMaxNumberText = 128;
+
+// RFC 8259 section 6 Numbers. The digits are accumulated while the grammar is checked; the text is
+// only kept for the rare doubles that need strtod.
+template <typename Context, typename Source>
+inline bool _ParseNumber(Context &context, Source &in) {
+    char text[kMaxNumberText];
+    size_t length = 0;
+    std::string long_text;
+    auto append = [&](int ch) {
+        if (length < kMaxNumberText - 1) {
+            text[length++] = static_cast<char>(ch);
+            return;
+        }
+
+        if (long_text.empty()) {
+            long_text.assign(text, length);
+        }
+        long_text.push_back(static_cast<char>(ch));
+    };
+
+    bool negative = false;
+    std::uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool truncated = false;
+    bool is_integer = true;
+
+    int ch = in.GetChar();
+    if (ch == '-') {
+        negative = true;
+        append(ch);
+        ch = in.GetChar();
+    }
+
+    if (ch == '0') {
+        append(ch);
+        ch = in.GetChar();
+    } else if (ch >= '1' && ch <= '9') {
+        do {
+            append(ch);
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (ch - '0');
+                ++digits;
+            } else {
+                truncated |= ch != '0';
+                ++exponent;
+            }
+            ch = in.GetChar();
+        } while (ch >= '0' && ch <= '9');
+    } else {
+        in.UnGetChar();
+        return false;
+    }
+
+    if (ch == '.') {
+        is_integer = false;
+        append(ch);
+        ch = in.GetChar();
+        if (!(ch >= '0' && ch <= '9')) {
             in.UnGetChar();
-            break;
+            return false;
+        }
+
+        do {
+            append(ch);
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (ch - '0');
+                // leading zeros are not significant
+                if (mantissa != 0) {
+                    ++digits;
+                }
+                --exponent;
+            } else {
+                truncated |= ch != '0';
+            }
+            ch = in.GetChar();
+        } while (ch >= '0' && ch <= '9');
+    }
+
+    if (ch == 'e' || ch == 'E') {
+        is_integer = false;
+        append(ch);
+        ch = in.GetChar();
+
+        bool negative_exponent = false;
+        if (ch == '+' || ch == '-') {
+            negative_exponent = ch == '-';
+            append(ch);
+            ch = in.GetChar();
         }
+
+        if (!(ch >= '0' && ch <= '9')) {
+            in.UnGetChar();
+            return false;
+        }
+
+        int exponent_value = 0;
+        do {
+            append(ch);
+            if (exponent_value < 100000) {
+                exponent_value = exponent_value * 10 + (ch - '0');
+            }
+            ch = in.GetChar();
+        } while (ch >= '0' && ch <= '9');
+
+        exponent += negative_exponent ? -exponent_value : exponent_value;
     }
 
-    return num_string;
-}
+    in.UnGetChar();
 
-bool _IsValidInt64(std::intmax_t value, const std::string &value_str, char *endp) {
-    if (!(value >= std::numeric_limits<std::int64_t>::min() && value <= std::numeric_limits<std::int64_t>::max())) {
-        return false;
+    // integers that fit in int64 stay integers, the others become doubles
+    if (is_integer && exponent == 0) {
+        constexpr std::uint64_t max_int64 = static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max());
+        if (!negative && mantissa <= max_int64) {
+            return context.SetInt64(static_cast<std::int64_t>(mantissa));
+        }
+        if (negative && mantissa <= max_int64 + 1) {
+            return context.SetInt64(static_cast<std::int64_t>(~mantissa + 1));
+        }
     }
 
-    const char *limit = value_str.c_str() + value_str.size();
-    return endp == limit;
+    double value;
+    if (_DecimalToDouble(mantissa, exponent, negative, truncated, value)) {
+        return context.SetNumber(value);
+    }
+
+    const char *str = text;
+    if (long_text.empty()) {
+        text[length] = '\0';
+    } else {
+        str = long_text.c_str();
+    }
+
+    return context.SetNumber(std::strtod(str, nullptr));
 }
 
-template <typename Context, typename Iter>
-inline bool _Parse(Context &context, InputSource<Iter> &in) {
+template <typename Context, typename Source>
+inline bool _Parse(Context &context, Source &in) {
     in.SkipWhiteSpace();
 
     int ch = in.GetChar();
@@ -276,39 +434,97 @@ inline bool _Parse(Context &context, InputSource<Iter> &in) {
     default:
         if ((ch >= '0' && ch <= '9') || ch == '-') {
             in.UnGetChar();
+            return _ParseNumber(context, in);
+        }
 
-            std::string num_string = _ParseNumber(in);
-            if (num_string.empty()) {
-                return false;
-            }
+        break;
+    }
 
-            errno = 0;
-            char *endp;
-            std::intmax_t ival = std::strtoimax(num_string.c_str(), &endp, 10);
-            if (errno == 0 && _IsValidInt64(ival, num_string, endp)) {
-                context.SetInt64(ival);
-                return true;
-            }
+    in.UnGetChar();
+    return false;
+}
 
-            double dval = std::strtod(num_string.c_str(), &endp);
-            if (endp == num_string.c_str() + num_string.size()) {
-                context.SetNumber(dval);
-                return true;
+constexpr size_t kMaxPairwiseKeys = 16;
+
+// Returns whether any of the count keys of an object comes again later in it, and then marks in keep
+// the last of each, whose value is the one a JsonObject parsed from the same text holds. Small objects
+// compare their keys pairwise, larger ones hash them.
+inline bool _DuplicateKeys(const std::string_view *keys, size_t count, std::vector<bool> &keep) {
+    if (count <= kMaxPairwiseKeys) {
+        bool found = false;
+        for (size_t i = 1; i < count && !found; ++i) {
+            for (size_t j = 0; j < i && !found; ++j) {
+                found = keys[i] == keys[j];
             }
-
+        }
+        if (!found) {
             return false;
         }
+    }
 
-        break;
+    std::unordered_map<std::string_view, size_t> last(count);
+    for (size_t i = 0; i < count; ++i) {
+        last[keys[i]] = i;
+    }
+    if (last.size() == count) {
+        return false;
     }
 
-    in.UnGetChar();
-    return false;
+    keep.assign(count, false);
+    for (size_t i = 0; i < count; ++i) {
+        keep[i] = last[keys[i]] == i;
+    }
+    return true;
 }
 
+struct ParseOptions {
+    // Strings without escapes in contiguous input point into the input instead of being copied. The
+    // parsed value is then only valid while the input buffer lives.
+    bool borrow_strings = false;
+    // A large top-level array in contiguous input is split and parsed on this many threads, 0 for one
+    // per hardware thread. JsonDocument always parses on one thread.
+    unsigned threads = 1;
+    // Object keys are interned in this table, which can be shared by many parses on one thread, and the
+    // parsed keys point into it, so it must outlive the value. Only a FlatObject can point to interned
+    // keys, so the table is not used without JSON_FLAT_OBJECT, nor when parsing on several threads.
+    SymbolTable *symbols = nullptr;
+    // Arrays and objects nested deeper than this are an error. ParseContext keeps its own stack
+    // instead of recursing, and so do copying, comparing, writing and converting a JsonValue, so this
+    // can be in the tens of thousands. The SAX, tape, compact and binding parsers recurse and keep
+    // their own limit of 100.
+    size_t max_depth = 100;
+    // Strings and keys that are not valid UTF-8 are an error. Without this, bytes above 0x7f are
+    // copied as they are.
+    bool validate_utf8 = false;
+    // ParseJsonFiltered skips the values outside its pointers in contiguous input by counting the
+    // brackets in the structural index, without checking what is between them. This is faster, but
+    // accepts some invalid JSON inside skipped values, so it is only for trusted input.
+    bool skip_unchecked = false;
+#ifdef JSON_PARSE_STATS
+    // Counts are added to this, which is not reset between parses
+    ParseStats *stats = nullptr;
+#endif
+};
+
 class ParseContext {
   public:
-    explicit ParseContext(JsonValue *value, size_t depth = DEFAULT_MAX_DEPTH) : value_(value), depth_(depth) {
+    explicit ParseContext(JsonValue *value, size_t depth = DEFAULT_MAX_DEPTH)
+        : ParseContext(value, nullptr, nullptr, DefaultOptions(), depth) {
+    }
+
+    // Strings, arrays and objects are allocated from resource. Strings are unescaped into buffer first.
+    ParseContext(JsonValue *value, std::pmr::memory_resource *resource, std::string *buffer, const ParseOptions &options)
+        : ParseContext(value, resource, buffer, options, options.max_depth) {
+    }
+
+    ParseContext(JsonValue *value, std::pmr::memory_resource *resource, std::string *buffer, const ParseOptions &options,
+                 size_t depth)
+        : value_(value), resource_(resource), buffer_(buffer), options_(&options), depth_(depth) {
+    }
+
+    static const ParseOptions &DefaultOptions() {
+        static const ParseOptions options;
+        return options;
     }
 
     bool SetNull() {
@@ -330,88 +546,629 @@ class ParseContext {
         return true;
     }
 
-    template <typename Iter>
-    bool ParseString(InputSource<Iter> &in) {
-        *value_ = JsonValue(JsonType::kString);
-        std::string &str = value_->Get<std::string>();
-        return _ParseString(str, in);
-    }
+    template <typename Source>
+    bool ParseString(Source &in) {
+        std::string_view view;
+        if (options_->borrow_strings && in.ReadPlainString(view)) {
+            *value_ = JsonValue::Borrow(view);
+            return true;
+        }
 
-    bool ParseArrayStart() {
-        if (depth_ == 0) {
+        if (resource_ == nullptr) {
+            // a short string is stored in the value and the buffer of a long one is moved to the heap
+            std::string str;
+            if (!_ParseString(str, in)) {
+                return false;
+            }
+
+            *value_ = JsonValue(std::move(str));
+            return true;
+        }
+
+        buffer_->clear();
+        if (!_ParseString(*buffer_, in)) {
             return false;
         }
 
-        --depth_;
-        *value_ = JsonValue(JsonType::kArray);
+        *value_ = JsonValue(std::string_view(*buffer_), resource_);
         return true;
     }
 
-    bool ParseArrayStop() {
-        ++depth_;
+    // Parses one value with an explicit stack of open arrays and objects instead of recursion, so the
+    // depth is not bounded by the C stack and no context is made per value
+    template <typename Source>
+    bool Parse(Source &in) {
+#ifdef JSON_PARSE_STATS
+        _StatsTimer timer(options_->stats, &ParseStats::parse_ns);
+        const char *start = _StatsPosition(in);
+#endif
+        JsonValue *root = value_;
+        bool validate_utf8 = in.ValidatesUtf8();
+        in.SetValidateUtf8(options_->validate_utf8);
+
+        bool ret = _ParseTree(in);
+#ifdef JSON_PARSE_STATS
+        if (options_->stats != nullptr && start != nullptr) {
+            options_->stats->bytes += static_cast<std::uint64_t>(_StatsPosition(in) - start);
+        }
+#endif
+        value_ = root;
+        in.SetValidateUtf8(validate_utf8);
+        return ret;
+    }
+
+  private:
+    static constexpr size_t DEFAULT_MAX_DEPTH = 100;
+
+    struct Frame {
+        JsonValue *container;
+        bool is_object;
+        const SymbolTable::Shape *shape;
+    };
+
+    // The shape of a new object, nullptr when its keys are not interned. A std::map copies its keys
+    // anyway, so interning them would only cost time.
+    const SymbolTable::Shape *_RootShape() const {
+#ifdef JSON_FLAT_OBJECT
+        return options_->symbols != nullptr ? options_->symbols->Root() : nullptr;
+#else
+        return nullptr;
+#endif
+    }
+
+    template <typename Source>
+    bool _ParseTree(Source &in) {
+        std::vector<Frame> stack;
+        std::string key;
+        while (true) {
+            in.SkipWhiteSpace();
+
+            int ch = in.GetChar();
+#ifdef JSON_PARSE_STATS
+            const char *start = _StatsPosition(in);
+#endif
+            switch (ch) {
+            case 'n':
+                if (!in.Match("ull")) {
+                    return false;
+                }
+                *value_ = JsonValue();
+                break;
+            case 't':
+                if (!in.Match("rue")) {
+                    return false;
+                }
+                *value_ = JsonValue(true);
+                break;
+            case 'f':
+                if (!in.Match("alse")) {
+                    return false;
+                }
+                *value_ = JsonValue(false);
+                break;
+            case '"':
+                if (!ParseString(in)) {
+                    return false;
+                }
+                break;
+            case '[':
+            case '{': {
+                if (stack.size() >= depth_) {
+                    return false;
+                }
+
+                bool is_object = ch == '{';
+                *value_ = JsonValue(is_object ? JsonType::kObject : JsonType::kArray, resource_);
+                if (in.Expect(is_object ? '}' : ']')) {
+                    break;
+                }
+
+#ifdef JSON_PARSE_STATS
+                _CountValue(in, nullptr, stack.size());
+#endif
+                if (stack.empty()) {
+                    stack.reserve(std::min<size_t>(depth_, 64));
+                }
+                stack.push_back(Frame{value_, is_object, _RootShape()});
+                if (is_object ? !_ParseKey(in, stack.back(), key) : !_ParseElement(stack.back())) {
+                    return false;
+                }
+                continue;
+            }
+            default:
+                if ((ch >= '0' && ch <= '9') || ch == '-') {
+                    in.UnGetChar();
+                    if (!_ParseNumber(*this, in)) {
+                        return false;
+                    }
+                    break;
+                }
+
+                in.UnGetChar();
+                return false;
+            }
+
+#ifdef JSON_PARSE_STATS
+            _CountValue(in, start, stack.size());
+#endif
+            // the value is complete, and so are the containers it closes
+            while (true) {
+                if (stack.empty()) {
+                    return true;
+                }
+
+                Frame &frame = stack.back();
+                if (in.Expect(',')) {
+                    if (frame.is_object ? !_ParseKey(in, frame, key) : !_ParseElement(frame)) {
+                        return false;
+                    }
+                    break;
+                }
+                if (!in.Expect(frame.is_object ? '}' : ']')) {
+                    return false;
+                }
+                stack.pop_back();
+            }
+        }
+    }
+
+    // Appends an element to the array of frame and points value_ at it
+    bool _ParseElement(Frame &frame) {
+        JsonArray &array = frame.container->Get<JsonArray>();
+#ifdef JSON_PARSE_STATS
+        bool grows = array.size() == array.capacity();
+#endif
+        array.emplace_back();
+        value_ = &array.back();
+#ifdef JSON_PARSE_STATS
+        if (options_->stats != nullptr && grows) {
+            _EstimateAllocation(*options_->stats, array.capacity() * sizeof(JsonValue));
+        }
+#endif
         return true;
     }
 
-    template <typename Iter>
-    bool ParseArrayItem(InputSource<Iter> &in, size_t index) {
-        JsonArray &array_value = value_->Get<JsonArray>();
-        array_value.push_back(JsonValue());
+    // Reads a key and its colon, adds the member to the object of frame and points value_ at it
+    template <typename Source>
+    bool _ParseKey(Source &in, Frame &frame, std::string &key) {
+        key.clear();
+        if (!in.Expect('"') || !_ReadString(key, in) || !in.Expect(':')) {
+            return false;
+        }
 
-        ParseContext context(&array_value.back(), depth_);
-        return _Parse(context, in);
+        JsonObject &object = frame.container->Get<JsonObject>();
+#ifdef JSON_PARSE_STATS
+        size_t capacity = _ObjectCapacity(object);
+        size_t size = object.size();
+#endif
+        if (frame.shape != nullptr) {
+            frame.shape = options_->symbols->Next(frame.shape, key);
+        }
+        if (frame.shape != nullptr) {
+            value_ = &_InternedObjectMember(object, frame.shape->key, *options_->symbols);
+        } else {
+            value_ = &_ObjectMember(object, key);
+        }
+#ifdef JSON_PARSE_STATS
+        // a duplicate key adds nothing
+        if (options_->stats != nullptr && object.size() != size) {
+            _EstimateMember(*options_->stats, object, capacity, size, key, frame.shape != nullptr);
+        }
+#endif
+        return true;
     }
 
-    bool ParseObjectStart() {
-        if (depth_ == 0) {
+    // _ParseString, which also counts a string with escapes
+    template <typename Source>
+    bool _ReadString(std::string &out, Source &in) {
+#ifdef JSON_PARSE_STATS
+        const char *start = _StatsPosition(in);
+        if (!_ParseString(out, in)) {
             return false;
         }
+        if (options_->stats != nullptr && start != nullptr && static_cast<size_t>(_StatsPosition(in) - start) != out.size() + 1) {
+            ++options_->stats->escaped_strings;
+        }
+        return true;
+#else
+        return _ParseString(out, in);
+#endif
+    }
+
+#ifdef JSON_PARSE_STATS
+    // The arrays and objects that hold the values of this context
+    size_t _Level() const noexcept {
+        return options_->max_depth > depth_ ? options_->max_depth - depth_ : 0;
+    }
+
+    // Counts the value just made at value_ inside open containers of the stack. start is where the
+    // body of a string begins.
+    template <typename Source>
+    void _CountValue(Source &in, const char *start, size_t open) {
+        ParseStats *stats = options_->stats;
+        if (stats == nullptr) {
+            return;
+        }
+
+        JsonType type = value_->Type();
+        ++stats->values[static_cast<size_t>(type)];
+        if (type == JsonType::kArray || type == JsonType::kObject) {
+            stats->max_depth = std::max<std::uint64_t>(stats->max_depth, _Level() + open + 1);
+            _EstimateAllocation(*stats, type == JsonType::kArray ? sizeof(JsonArray) : sizeof(JsonObject));
+        } else if (type == JsonType::kString) {
+            // the body of a plain string is followed by its quote
+            size_t length = value_->GetStringView().size();
+            bool escaped = start != nullptr && static_cast<size_t>(_StatsPosition(in) - start) != length + 1;
+            stats->escaped_strings += escaped;
+            if ((options_->borrow_strings && start != nullptr && !escaped) || length <= JsonValue::kInlineCapacity) {
+                return;
+            }
+
+            if (resource_ != nullptr) {
+                _EstimateAllocation(*stats, length);
+            } else {
+                _EstimateHeapString(*stats, value_->Get<std::string>());
+            }
+        }
+    }
+#endif
+
+    JsonValue *value_;
+    std::pmr::memory_resource *resource_;
+    std::string *buffer_;
+    const ParseOptions *options_;
+    size_t depth_;
+};
+
+// A JsonValue is built without recursion. ParseContext has no per-item callbacks, so this is the
+// only way to parse into it.
+template <typename Source>
+inline bool _Parse(ParseContext &context, Source &in) {
+    return context.Parse(in);
+}
+
+// Describes the error at the current position with the rest of its line
+template <typename Source>
+inline void _SyntaxError(Source &in, std::string *error) {
+    std::stringstream ss;
+    if (in.InvalidUtf8Offset() != Source::NO_OFFSET) {
+        ss << "invalid UTF-8 at byte offset " << in.InvalidUtf8Offset() << ", line " << in.Line() << " near: ";
+    } else {
+        ss << "syntax error at line " << in.Line() << " near: ";
+    }
+    *error = ss.str();
+
+    while (true) {
+        int ch = in.GetChar();
+        if (ch == Source::END_OF_INPUT || ch == '\n') {
+            break;
+        }
+
+        if (!_IsControlCharacter(ch)) {
+            error->push_back(static_cast<int>(ch));
+        }
+    }
+}
+
+template <typename Context, typename Source>
+inline bool _Parse(Context &context, Source &in, std::string *error) {
+    bool ret = _Parse(context, in);
+    if (!ret && error != nullptr) {
+        _SyntaxError(in, error);
+    }
+
+    return ret;
+}
+
+template <typename Context, typename Iter>
+inline Iter _Parse(Context &context, const Iter &begin, const Iter &end, std::string *error) {
+    InputSource<Iter> in(begin, end);
+    _Parse(context, in, error);
+    return in.Current();
+}
+
+// Contiguous input goes through the pointer InputSource. A sequential parse does not go through the
+// structural index: building values costs the same from either source, so stage 1 would only add its
+// own time.
+template <typename Context>
+inline const char *_ParseContiguous(Context &context, const char *begin, const char *end, std::string *error) {
+    return _Parse(context, begin, end, error);
+}
+
+// Context for _Parse that only consumes its input, for sources without a faster way to skip
+class SkipContext {
+  public:
+    SkipContext(std::string *buffer, size_t depth) : buffer_(buffer), depth_(depth) {
+    }
+
+    bool SetNull() {
+        return true;
+    }
+
+    bool SetBool(bool) {
+        return true;
+    }
+
+    bool SetNumber(double) {
+        return true;
+    }
+
+    bool SetInt64(std::int64_t) {
+        return true;
+    }
+
+    template <typename Source>
+    bool ParseString(Source &in) {
+        std::string_view view;
+        if (in.ReadPlainString(view)) {
+            return true;
+        }
+
+        buffer_->clear();
+        return _ParseString(*buffer_, in);
+    }
+
+    bool ParseArrayStart() {
+        return _Open();
+    }
+
+    template <typename Source>
+    bool ParseArrayItem(Source &in, size_t) {
+        SkipContext context(buffer_, depth_);
+        return _Parse(context, in);
+    }
 
-        *value_ = JsonValue(JsonType::kObject);
+    bool ParseArrayStop() {
+        ++depth_;
         return true;
     }
 
-    template <typename Iter>
-    bool ParseObjectItem(InputSource<Iter> &in, const std::string &key) {
-        JsonObject &object_value = value_->Get<JsonObject>();
-        ParseContext context(&object_value[key], depth_);
+    bool ParseObjectStart() {
+        return _Open();
+    }
+
+    template <typename Source>
+    bool ParseObjectItem(Source &in, const std::string &) {
+        SkipContext context(buffer_, depth_);
         return _Parse(context, in);
     }
 
     bool ParseObjectStop() {
-        --depth_;
+        ++depth_;
         return true;
     }
 
   private:
-    static constexpr size_t DEFAULT_MAX_DEPTH = 100;
+    bool _Open() {
+        if (depth_ == 0) {
+            return false;
+        }
 
-    JsonValue *value_;
+        --depth_;
+        return true;
+    }
+
+    std::string *buffer_;
     size_t depth_;
 };
 
-template <typename Iter>
-inline Iter _Parse(ParseContext &context, const Iter &begin, const Iter &end, std::string *error) {
-    InputSource<Iter> in(begin, end);
+// Consumes one value without building it, checking it as the other parsers would. With
+// options.skip_unchecked the structural index lets contiguous input skip a value by counting
+// brackets, which does not check what is inside.
+template <typename Source>
+inline bool _SkipValue(Source &in, std::string &buffer, size_t depth, const ParseOptions &) {
+    SkipContext context(&buffer, depth);
+    return _Parse(context, in);
+}
 
-    bool ret = _Parse(context, in);
-    if (!ret && error != nullptr) {
-        std::stringstream ss;
-        ss << "syntax error at line " << in.Line() << " near: ";
-        *error = ss.str();
+inline bool _SkipValue(StructuralInputSource &in, std::string &buffer, size_t depth, const ParseOptions &options) {
+    if (options.skip_unchecked) {
+        return in.SkipValue();
+    }
 
-        while (true) {
-            int ch = in.GetChar();
-            if (ch == InputSource<Iter>::END_OF_INPUT || ch == '\n') {
-                break;
+    SkipContext context(&buffer, depth);
+    return _Parse(context, in);
+}
+
+// Each thread of the parallel parser gets at least this much input
+constexpr size_t kMinParallelBytes = 64 * 1024;
+
+// Finds where a top-level array can be cut into at most chunks slices of whole elements. The index
+// already tells which characters are outside strings, so only the nesting has to be tracked.
+// splits gets the opening bracket, the commas to cut at and the closing bracket.
+inline bool _SplitTopLevelArray(const char *begin, const char *end, const StructuralIndex &index, size_t chunks,
+                                std::vector<const char *> &splits) {
+    const std::vector<std::uint32_t> &positions = index.Positions();
+    if (chunks < 2 || positions.empty() || begin[positions[0]] != '[') {
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(end - begin);
+    splits.assign(1, begin + positions[0]);
+
+    int depth = 0;
+    for (std::uint32_t offset : positions) {
+        switch (begin[offset]) {
+        case '[':
+        case '{':
+            ++depth;
+            break;
+        case ']':
+        case '}':
+            if (--depth == 0) {
+                splits.push_back(begin + offset);
+                return splits.size() > 2;
+            }
+            break;
+        case ',':
+            if (depth == 1 && offset >= splits.size() * size / chunks && splits.size() < chunks) {
+                splits.push_back(begin + offset);
+            }
+            break;
+        }
+    }
+
+    // unbalanced, the sequential parser reports the error
+    return false;
+}
+
+// Parses the elements between two splits into an array of their own
+template <typename Source>
+inline bool _ParseArraySlice(JsonValue &slice, Source &in, const char *stop, const ParseOptions &options,
+                             std::string *error) {
+    if (options.max_depth == 0) {
+        _SyntaxError(in, error);
+        return false;
+    }
+
+    slice = JsonValue(JsonType::kArray);
+    JsonArray &array = slice.Get<JsonArray>();
+    do {
+        // the elements are one level below the array the slices stand in for
+        array.push_back(JsonValue());
+        ParseContext context(&array.back(), nullptr, nullptr, options, options.max_depth - 1);
+        if (!context.Parse(in)) {
+            _SyntaxError(in, error);
+            return false;
+        }
+
+        in.SkipWhiteSpace();
+    } while (in.Current() != stop && in.Expect(','));
+
+    if (in.Current() != stop) {
+        _SyntaxError(in, error);
+        return false;
+    }
+
+    return true;
+}
+
+// Joins the threads that are still joinable however the scope that started them is left, since
+// destroying a joinable thread terminates the process
+struct _JoinGuard {
+    std::vector<std::thread> &threads;
+
+    ~_JoinGuard() {
+        for (std::thread &t : threads) {
+            if (t.joinable()) {
+                t.join();
             }
+        }
+    }
+};
 
-            if (!_IsControlCharacter(ch)) {
-                error->push_back(static_cast<int>(ch));
+inline const char *_ParseParallel(const char *begin, const char *end, JsonValue &value, std::string *error,
+                                  const ParseOptions &options) {
+    ParseContext context(&value, nullptr, nullptr, options);
+    StructuralIndex index;
+#ifdef JSON_PARSE_STATS
+    _StatsTimer timer(options.stats, &ParseStats::index_ns);
+    bool indexed = StructuralIndex::IsSupported() && index.Build(begin, end);
+    timer.Stop();
+#else
+    bool indexed = StructuralIndex::IsSupported() && index.Build(begin, end);
+#endif
+    if (!indexed) {
+        return _Parse(context, begin, end, error);
+    }
+
+    unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    size_t chunks = std::min<size_t>(threads, static_cast<size_t>(end - begin) / kMinParallelBytes);
+    std::vector<const char *> splits;
+    if (!_SplitTopLevelArray(begin, end, index, chunks, splits)) {
+        StructuralInputSource in(begin, end, index);
+        _Parse(context, in, error);
+        return in.Current();
+    }
+
+    // the symbol table is not thread-safe
+    ParseOptions slice_options = options;
+    slice_options.symbols = nullptr;
+
+    size_t num_slices = splits.size() - 1;
+    std::vector<JsonValue> slices(num_slices);
+    std::vector<std::string> errors(num_slices);
+    std::vector<const char *> stopped(num_slices);
+    std::vector<char> ok(num_slices);
+    // Thrown by a slice, such as bad_alloc; nothing would catch it on a worker thread
+    std::vector<std::exception_ptr> exceptions(num_slices);
+#ifdef JSON_PARSE_STATS
+    // and neither are the stats, so each slice counts its own
+    std::vector<ParseStats> slice_stats(num_slices);
+#endif
+    auto parse_slice = [&](size_t i) {
+        try {
+            StructuralInputSource in(begin, end, index, splits[i] + 1);
+#ifdef JSON_PARSE_STATS
+            ParseOptions stats_options = slice_options;
+            stats_options.stats = options.stats != nullptr ? &slice_stats[i] : nullptr;
+            ok[i] = _ParseArraySlice(slices[i], in, splits[i + 1], stats_options, &errors[i]);
+#else
+            ok[i] = _ParseArraySlice(slices[i], in, splits[i + 1], slice_options, &errors[i]);
+#endif
+            stopped[i] = in.Current();
+        } catch (...) {
+            exceptions[i] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    {
+        _JoinGuard guard{workers};
+        for (size_t i = 1; i < num_slices; ++i) {
+            workers.emplace_back(parse_slice, i);
+        }
+        parse_slice(0);
+    }
+    for (const std::exception_ptr &exception : exceptions) {
+        if (exception != nullptr) {
+            std::rethrow_exception(exception);
+        }
+    }
+#ifdef JSON_PARSE_STATS
+    if (options.stats != nullptr) {
+        for (const ParseStats &stats : slice_stats) {
+            options.stats->Merge(stats);
+        }
+    }
+#endif
+
+    // the first error in the input is the one the sequential parser would report
+    for (size_t i = 0; i < num_slices; ++i) {
+        if (!ok[i]) {
+            if (error != nullptr) {
+                *error = std::move(errors[i]);
             }
+            return stopped[i];
         }
     }
 
-    return in.Current();
+#ifdef JSON_PARSE_STATS
+    _StatsTimer merge_timer(options.stats, &ParseStats::merge_ns);
+#endif
+    size_t size = 0;
+    for (const JsonValue &slice : slices) {
+        size += slice.Get<JsonArray>().size();
+    }
+
+    value = JsonValue(JsonType::kArray);
+    JsonArray &array = value.Get<JsonArray>();
+    array.reserve(size);
+#ifdef JSON_PARSE_STATS
+    // the slices stand in for the array, whose elements are one level down
+    if (options.stats != nullptr) {
+        ++options.stats->values[static_cast<size_t>(JsonType::kArray)];
+        options.stats->max_depth = std::max<std::uint64_t>(options.stats->max_depth, 1);
+        _EstimateAllocation(*options.stats, sizeof(JsonArray));
+        _EstimateAllocation(*options.stats, array.capacity() * sizeof(JsonValue));
+    }
+#endif
+    for (JsonValue &slice : slices) {
+        JsonArray &elements = slice.Get<JsonArray>();
+        std::move(elements.begin(), elements.end(), std::back_inserter(array));
+    }
+
+    return splits.back() + 1;
 }
 
 template <typename Iter>
@@ -420,8 +1177,19 @@ Iter ParseJson(const Iter &begin, const Iter &end, JsonValue &value, std::string
     return _Parse(context, begin, end, error);
 }
 
-inline std::string ParseJson(const std::string &input, JsonValue &value) {
+inline const char *ParseJson(const char *begin, const char *end, JsonValue &value, std::string *error,
+                             const ParseOptions &options = ParseContext::DefaultOptions()) {
+    if (options.threads != 1) {
+        return _ParseParallel(begin, end, value, error, options);
+    }
+
+    ParseContext context(&value, nullptr, nullptr, options);
+    return _ParseContiguous(context, begin, end, error);
+}
+
+inline std::string ParseJson(const std::string &input, JsonValue &value,
+                             const ParseOptions &options = ParseContext::DefaultOptions()) {
     std::string error;
-    ParseJson(input.begin(), input.end(), value, &error);
+    ParseJson(input.data(), input.data() + input.size(), value, &error, options);
     return error;
 }
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// RFC 6901 JSON Pointer: "" is the whole document and "/a/0" is element 0 of member "a". In a
+// reference token "~1" stands for '/' and "~0" for '~'.
+inline bool _ParseJsonPointer(std::string_view pointer, std::vector<std::string> &tokens) {
+    tokens.clear();
+    if (pointer.empty()) {
+        return true;
+    }
+    if (pointer[0] != '/') {
+        return false;
+    }
+
+    for (size_t i = 0; i < pointer.size();) {
+        ++i;
+        tokens.emplace_back();
+        std::string &token = tokens.back();
+        for (; i < pointer.size() && pointer[i] != '/'; ++i) {
+            if (pointer[i] != '~') {
+                token.push_back(pointer[i]);
+                continue;
+            }
+
+            if (i + 1 == pointer.size() || (pointer[i + 1] != '0' && pointer[i + 1] != '1')) {
+                return false;
+            }
+            token.push_back(pointer[++i] == '0' ? '~' : '/');
+        }
+    }
+
+    return true;
+}
+
+// An array index token is "0" or digits without a leading zero
+inline bool _ParseJsonPointerIndex(const std::string &token, size_t &index) {
+    if (token.empty() || token.size() > 18 || (token[0] == '0' && token.size() > 1)) {
+        return false;
+    }
+
+    index = 0;
+    for (char ch : token) {
+        if (ch < '0' || ch > '9') {
+            return false;
+        }
+        index = index * 10 + static_cast<size_t>(ch - '0');
+    }
+
+    return true;
+}
@@ -0,0 +1,405 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_parser.h"
+#include "json_sax.h"
+
+// Parser for input that arrives in chunks. Feed() takes the chunks in order and Finish() marks the
+// end of the document; the events of a SaxHandler are emitted as soon as each token is complete.
+//
+// Unlike _Parse, the parser is an explicit state machine, so a chunk can end anywhere: inside a
+// string, an escape sequence, a surrogate pair, a number or a literal. Only the unfinished token is
+// kept between chunks, never the whole input.
+template <typename Handler>
+class PushParser {
+  public:
+    explicit PushParser(Handler &handler, size_t depth = DEFAULT_MAX_DEPTH)
+        : handler_(&handler), max_depth_(depth), state_(State::kValue), is_key_(false), literal_(nullptr),
+          literal_pos_(0), escape_len_(0), line_(1) {
+    }
+
+    // Returns false once the input is invalid or a handler has stopped the parse
+    bool Feed(const char *data, size_t size) {
+        if (state_ == State::kError) {
+            return false;
+        }
+
+        const char *p = data;
+        const char *end = data + size;
+        while (p != end) {
+            const char *start = p;
+            if (!_Step(p, end)) {
+                return _Fail(data, start, end);
+            }
+        }
+
+        line_ += static_cast<int>(std::count(data, end, '\n'));
+        return true;
+    }
+
+    bool Feed(std::string_view chunk) {
+        return Feed(chunk.data(), chunk.size());
+    }
+
+    // Completes a number at the end of the input and checks that the document is complete
+    bool Finish() {
+        if (state_ == State::kNumber && !_FinishNumber()) {
+            return _Fail(nullptr, nullptr, nullptr);
+        }
+        if (state_ != State::kDone) {
+            return _Fail(nullptr, nullptr, nullptr);
+        }
+
+        return true;
+    }
+
+    const std::string &Error() const noexcept {
+        return error_;
+    }
+
+  private:
+    enum class State : std::uint8_t {
+        kValue,
+        kFirstArrayValue,
+        kFirstKey,
+        kKey,
+        kColon,
+        kAfterValue,
+        kString,
+        kEscape,
+        kUnicode,
+        kLiteral,
+        kNumber,
+        kDone,
+        kError,
+    };
+
+    static constexpr size_t DEFAULT_MAX_DEPTH = 100;
+
+    static bool _IsWhiteSpace(char ch) {
+        return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+    }
+
+    static bool _IsNumberChar(char ch) {
+        return (ch >= '0' && ch <= '9') || ch == '-' || ch == '+' || ch == '.' || ch == 'e' || ch == 'E';
+    }
+
+    // Consumes input from p for the current state and returns false on an error
+    bool _Step(const char *&p, const char *end) {
+        switch (state_) {
+        case State::kValue:
+        case State::kFirstArrayValue:
+        case State::kFirstKey:
+        case State::kKey:
+        case State::kColon:
+        case State::kAfterValue:
+        case State::kDone:
+            if (_IsWhiteSpace(*p)) {
+                do {
+                    ++p;
+                } while (p != end && _IsWhiteSpace(*p));
+                return true;
+            }
+
+            return _Structural(p);
+        case State::kString:
+            return _StringRun(p, end);
+        case State::kEscape:
+            return _Escape(*p++);
+        case State::kUnicode:
+            escape_[escape_len_++] = *p++;
+            return _Unicode();
+        case State::kLiteral:
+            if (*p != literal_[literal_pos_]) {
+                return false;
+            }
+
+            ++p;
+            if (literal_[++literal_pos_] == '\0') {
+                return _EmitLiteral() && _EndValue();
+            }
+            return true;
+        case State::kNumber: {
+            const char *q = std::find_if_not(p, end, _IsNumberChar);
+            number_.append(p, q);
+            p = q;
+            return p == end || _FinishNumber();
+        }
+        case State::kError:
+            break;
+        }
+
+        return false;
+    }
+
+    // Handles the non-whitespace character at p between tokens
+    bool _Structural(const char *&p) {
+        char ch = *p++;
+        switch (state_) {
+        case State::kFirstArrayValue:
+            if (ch == ']') {
+                return _EndContainer('[');
+            }
+            [[fallthrough]];
+        case State::kValue:
+            return _StartValue(ch);
+        case State::kFirstKey:
+            if (ch == '}') {
+                return _EndContainer('{');
+            }
+            [[fallthrough]];
+        case State::kKey:
+            if (ch != '"') {
+                return false;
+            }
+
+            ++counts_.back();
+            _StartString(true);
+            return true;
+        case State::kColon:
+            if (ch != ':') {
+                return false;
+            }
+
+            state_ = State::kValue;
+            return true;
+        case State::kAfterValue:
+            if (ch == ',') {
+                state_ = containers_.back() == '[' ? State::kValue : State::kKey;
+                return true;
+            }
+            if (ch == ']' || ch == '}') {
+                return _EndContainer(ch == ']' ? '[' : '{');
+            }
+            return false;
+        default:
+            // only whitespace may follow the document
+            return false;
+        }
+    }
+
+    bool _StartValue(char ch) {
+        if (!containers_.empty() && containers_.back() == '[') {
+            ++counts_.back();
+        }
+
+        switch (ch) {
+        case '"':
+            _StartString(false);
+            return true;
+        case '[':
+        case '{':
+            if (containers_.size() == max_depth_) {
+                return false;
+            }
+
+            containers_.push_back(ch);
+            counts_.push_back(0);
+            state_ = ch == '[' ? State::kFirstArrayValue : State::kFirstKey;
+            return ch == '[' ? handler_->OnStartArray() : handler_->OnStartObject();
+        case 't':
+            return _StartLiteral("true");
+        case 'f':
+            return _StartLiteral("false");
+        case 'n':
+            return _StartLiteral("null");
+        default:
+            if ((ch >= '0' && ch <= '9') || ch == '-') {
+                number_.assign(1, ch);
+                state_ = State::kNumber;
+                return true;
+            }
+
+            return false;
+        }
+    }
+
+    bool _EndContainer(char open) {
+        if (containers_.back() != open) {
+            return false;
+        }
+
+        size_t count = counts_.back();
+        containers_.pop_back();
+        counts_.pop_back();
+        if (!(open == '[' ? handler_->OnEndArray(count) : handler_->OnEndObject(count))) {
+            return false;
+        }
+
+        return _EndValue();
+    }
+
+    bool _EndValue() {
+        state_ = containers_.empty() ? State::kDone : State::kAfterValue;
+        return true;
+    }
+
+    void _StartString(bool is_key) {
+        is_key_ = is_key;
+        string_.clear();
+        state_ = State::kString;
+    }
+
+    // Strings that end in the chunk where they start are passed to the handler without a copy
+    bool _StringRun(const char *&p, const char *end) {
+        const char *q = _ScanPlainString(p, end);
+        if (q == end) {
+            string_.append(p, q);
+            p = q;
+            return true;
+        }
+
+        if (*q == '\\') {
+            string_.append(p, q);
+            p = q + 1;
+            state_ = State::kEscape;
+            return true;
+        }
+        if (*q != '"') {
+            return false;
+        }
+
+        std::string_view str(p, static_cast<size_t>(q - p));
+        if (!string_.empty()) {
+            string_.append(p, q);
+            str = string_;
+        }
+        p = q + 1;
+
+        if (is_key_) {
+            state_ = State::kColon;
+            return handler_->OnKey(str);
+        }
+
+        return handler_->OnString(str) && _EndValue();
+    }
+
+    bool _Escape(char ch) {
+        state_ = State::kString;
+        switch (ch) {
+        case '"':
+        case '\\':
+        case '/':
+            string_.push_back(ch);
+            return true;
+        case 'b':
+            string_.push_back('\b');
+            return true;
+        case 'f':
+            string_.push_back('\f');
+            return true;
+        case 'n':
+            string_.push_back('\n');
+            return true;
+        case 'r':
+            string_.push_back('\r');
+            return true;
+        case 't':
+            string_.push_back('\t');
+            return true;
+        case 'u':
+            escape_len_ = 0;
+            state_ = State::kUnicode;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Collects the four hex digits after \u, and the \uXXXX that follows a high surrogate, then
+    // decodes them like _ParseString does
+    bool _Unicode() {
+        if (escape_len_ == 4) {
+            InputSource<const char *> in(escape_, escape_ + 4);
+            int unicode_char = _ParseQuadHex(in);
+            if (unicode_char == -1) {
+                return false;
+            }
+            if (unicode_char >= 0xd800 && unicode_char <= 0xdbff) {
+                return true;
+            }
+        } else if (escape_len_ != sizeof(escape_)) {
+            return true;
+        }
+
+        InputSource<const char *> in(escape_, escape_ + escape_len_);
+        if (!_ParseCodePoint(string_, in)) {
+            return false;
+        }
+
+        state_ = State::kString;
+        return true;
+    }
+
+    bool _StartLiteral(const char *literal) {
+        literal_ = literal;
+        literal_pos_ = 1;
+        state_ = State::kLiteral;
+        return true;
+    }
+
+    bool _EmitLiteral() {
+        switch (literal_[0]) {
+        case 't':
+            return handler_->OnBool(true);
+        case 'f':
+            return handler_->OnBool(false);
+        default:
+            return handler_->OnNull();
+        }
+    }
+
+    // The number characters have been collected, so the grammar check and the conversion are the
+    // ones of _ParseNumber
+    bool _FinishNumber() {
+        const char *begin = number_.data();
+        const char *end = begin + number_.size();
+        InputSource<const char *> in(begin, end);
+        SaxContext<Handler> context(handler_, &string_);
+        if (!_ParseNumber(context, in) || in.Current() != end) {
+            return false;
+        }
+
+        return _EndValue();
+    }
+
+    bool _Fail(const char *data, const char *p, const char *end) {
+        state_ = State::kError;
+
+        std::stringstream ss;
+        ss << "syntax error at line " << line_ + std::count(data, p, '\n') << " near: ";
+        error_ = ss.str();
+        for (; p != end && *p != '\n'; ++p) {
+            if (!_IsControlCharacter(*p)) {
+                error_.push_back(*p);
+            }
+        }
+
+        return false;
+    }
+
+    Handler *handler_;
+    size_t max_depth_;
+    State state_;
+
+    // '[' or '{' for each open container, and the number of elements or members seen in it
+    std::vector<char> containers_;
+    std::vector<size_t> counts_;
+
+    bool is_key_;
+    std::string string_;
+    std::string number_;
+    const char *literal_;
+    size_t literal_pos_;
+    char escape_[10];
+    size_t escape_len_;
+
+    int line_;
+    std::string error_;
+};
@@ -0,0 +1,287 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_parser.h"
+
+// Event handler for ParseSax. The parser calls these in document order and builds no JsonValue.
+// Returning false from any of them stops the parse with a syntax error at the current position.
+//
+// Views passed to OnString and OnKey are only valid during the call. Derive from SaxHandler and
+// redefine only the events you need; the calls are resolved statically, so no virtual is needed.
+class SaxHandler {
+  public:
+    bool OnNull() {
+        return true;
+    }
+    bool OnBool(bool) {
+        return true;
+    }
+    bool OnInt64(std::int64_t) {
+        return true;
+    }
+    bool OnDouble(double) {
+        return true;
+    }
+    bool OnString(std::string_view) {
+        return true;
+    }
+    bool OnKey(std::string_view) {
+        return true;
+    }
+    bool OnStartArray() {
+        return true;
+    }
+    bool OnEndArray(size_t) {
+        return true;
+    }
+    bool OnStartObject() {
+        return true;
+    }
+    bool OnEndObject(size_t) {
+        return true;
+    }
+};
+
+// Accepts every event, so parsing only checks the syntax
+class ValidationHandler : public SaxHandler {};
+
+// Counts the values of each type and the object keys
+class CountingHandler : public SaxHandler {
+  public:
+    bool OnNull() {
+        ++nulls;
+        return true;
+    }
+    bool OnBool(bool) {
+        ++booleans;
+        return true;
+    }
+    bool OnInt64(std::int64_t) {
+        ++integers;
+        return true;
+    }
+    bool OnDouble(double) {
+        ++numbers;
+        return true;
+    }
+    bool OnString(std::string_view) {
+        ++strings;
+        return true;
+    }
+    bool OnKey(std::string_view) {
+        ++keys;
+        return true;
+    }
+    bool OnStartArray() {
+        ++arrays;
+        return true;
+    }
+    bool OnStartObject() {
+        ++objects;
+        return true;
+    }
+
+    size_t nulls = 0;
+    size_t booleans = 0;
+    size_t integers = 0;
+    size_t numbers = 0;
+    size_t strings = 0;
+    size_t keys = 0;
+    size_t arrays = 0;
+    size_t objects = 0;
+};
+
+// Builds a JsonValue from the events, for parsers that only emit events such as PushParser
+class ValueBuilder : public SaxHandler {
+  public:
+    explicit ValueBuilder(JsonValue &root) : root_(&root) {
+    }
+
+    bool OnNull() {
+        *_NextValue() = JsonValue();
+        return true;
+    }
+    bool OnBool(bool value) {
+        *_NextValue() = JsonValue(value);
+        return true;
+    }
+    bool OnInt64(std::int64_t value) {
+        *_NextValue() = JsonValue(value);
+        return true;
+    }
+    bool OnDouble(double value) {
+        *_NextValue() = JsonValue(value);
+        return true;
+    }
+    bool OnString(std::string_view value) {
+        *_NextValue() = JsonValue(std::string(value));
+        return true;
+    }
+    bool OnKey(std::string_view key) {
+        key_.assign(key);
+        return true;
+    }
+    bool OnStartArray() {
+        JsonValue *value = _NextValue();
+        *value = JsonValue(JsonType::kArray);
+        stack_.push_back(value);
+        return true;
+    }
+    bool OnEndArray(size_t) {
+        stack_.pop_back();
+        return true;
+    }
+    bool OnStartObject() {
+        JsonValue *value = _NextValue();
+        *value = JsonValue(JsonType::kObject);
+        stack_.push_back(value);
+        return true;
+    }
+    bool OnEndObject(size_t) {
+        stack_.pop_back();
+        return true;
+    }
+
+  private:
+    // Containers only grow at the innermost level, so the pointers on the stack stay valid
+    JsonValue *_NextValue() {
+        if (stack_.empty()) {
+            return root_;
+        }
+
+        JsonValue *container = stack_.back();
+        if (container->IsArray()) {
+            JsonArray &array = container->Get<JsonArray>();
+            array.push_back(JsonValue());
+            return &array.back();
+        }
+
+        return &_ObjectMember(container->Get<JsonObject>(), key_);
+    }
+
+    JsonValue *root_;
+    std::vector<JsonValue *> stack_;
+    std::string key_;
+};
+
+// Context for _Parse that forwards every value to a handler. One context is made per array or
+// object so that the element count is at hand when it closes.
+template <typename Handler>
+class SaxContext {
+  public:
+    explicit SaxContext(Handler *handler, std::string *buffer, size_t depth = DEFAULT_MAX_DEPTH)
+        : handler_(handler), buffer_(buffer), depth_(depth), count_(0) {
+    }
+
+    bool SetNull() {
+        return handler_->OnNull();
+    }
+
+    bool SetBool(bool value) {
+        return handler_->OnBool(value);
+    }
+
+    bool SetNumber(double value) {
+        return handler_->OnDouble(value);
+    }
+
+    bool SetInt64(std::int64_t value) {
+        return handler_->OnInt64(value);
+    }
+
+    template <typename Source>
+    bool ParseString(Source &in) {
+        std::string_view view;
+        if (in.ReadPlainString(view)) {
+            return handler_->OnString(view);
+        }
+
+        buffer_->clear();
+        if (!_ParseString(*buffer_, in)) {
+            return false;
+        }
+
+        return handler_->OnString(*buffer_);
+    }
+
+    bool ParseArrayStart() {
+        if (depth_ == 0) {
+            return false;
+        }
+
+        --depth_;
+        return handler_->OnStartArray();
+    }
+
+    bool ParseArrayStop() {
+        ++depth_;
+        return handler_->OnEndArray(count_);
+    }
+
+    template <typename Source>
+    bool ParseArrayItem(Source &in, size_t index) {
+        count_ = index + 1;
+
+        SaxContext context(handler_, buffer_, depth_);
+        return _Parse(context, in);
+    }
+
+    bool ParseObjectStart() {
+        if (depth_ == 0) {
+            return false;
+        }
+
+        --depth_;
+        return handler_->OnStartObject();
+    }
+
+    template <typename Source>
+    bool ParseObjectItem(Source &in, const std::string &key) {
+        ++count_;
+        if (!handler_->OnKey(key)) {
+            return false;
+        }
+
+        SaxContext context(handler_, buffer_, depth_);
+        return _Parse(context, in);
+    }
+
+    bool ParseObjectStop() {
+        ++depth_;
+        return handler_->OnEndObject(count_);
+    }
+
+  private:
+    static constexpr size_t DEFAULT_MAX_DEPTH = 100;
+
+    Handler *handler_;
+    std::string *buffer_;
+    size_t depth_;
+    size_t count_;
+};
+
+template <typename Iter, typename Handler>
+Iter ParseSax(const Iter &begin, const Iter &end, Handler &handler, std::string *error) {
+    std::string buffer;
+    SaxContext<Handler> context(&handler, &buffer);
+    return _Parse(context, begin, end, error);
+}
+
+template <typename Handler>
+const char *ParseSax(const char *begin, const char *end, Handler &handler, std::string *error) {
+    std::string buffer;
+    SaxContext<Handler> context(&handler, &buffer);
+    return _ParseContiguous(context, begin, end, error);
+}
+
+// Returns the error message, which is empty on success
+template <typename Handler>
+std::string ParseSax(const std::string &input, Handler &handler) {
+    std::string error;
+    ParseSax(input.data(), input.data() + input.size(), handler, &error);
+    return error;
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json_file.h"
+#include "json_tape.h"
+#include "json_writer.h"
+
+// A TapeDocument saved to a file that is mapped and read in place. The tape refers to values by
+// index and to strings by offset, so the file needs no fixups. Opening it checks the header and
+// walks the tape once, so that a damaged file is rejected rather than read out of bounds; a trusted
+// open reads the header and nothing else, and the pages of the tape are faulted in as values are
+// visited.
+//
+// The file is a 32-byte header, the tape and the string buffer, in the byte order of the machine
+// that wrote it.
+
+constexpr char kSnapshotMagic[8] = {'J', 'S', 'O', 'N', 'S', 'N', 'A', 'P'};
+constexpr std::uint32_t kSnapshotVersion = 1;
+// Reads back as another value when the byte order differs
+constexpr std::uint32_t kSnapshotByteOrder = 0x01020304;
+
+struct _SnapshotHeader {
+    char magic[8];
+    std::uint32_t byte_order;
+    std::uint32_t version;
+    // In words
+    std::uint64_t tape_size;
+    std::uint64_t strings_size;
+};
+
+static_assert(sizeof(_SnapshotHeader) == 32, "the tape must stay 8-byte aligned");
+
+template <typename Sink>
+void WriteSnapshot(const TapeDocument &doc, Sink &sink) {
+    _SnapshotHeader header;
+    std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+    header.byte_order = kSnapshotByteOrder;
+    header.version = kSnapshotVersion;
+    header.tape_size = doc.Tape().size();
+    header.strings_size = doc.Strings().size();
+
+    sink.Write(reinterpret_cast<const char *>(&header), sizeof(header));
+    sink.Write(reinterpret_cast<const char *>(doc.Tape().data()), doc.Tape().size() * sizeof(std::uint64_t));
+    sink.Write(doc.Strings().data(), doc.Strings().size());
+}
+
+// Syncs the directory that holds path, which makes a rename in it durable
+inline std::string _SyncParentDirectory(const std::string &path) {
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return "cannot open " + dir + ": " + std::strerror(errno);
+    }
+
+    std::string error = ::fsync(fd) == 0 ? "" : "cannot sync " + dir + ": " + std::strerror(errno);
+    ::close(fd);
+    return error;
+}
+
+// Writes the snapshot to a new temporary file next to path, syncs it and renames it over path, then
+// syncs the directory. Processes that have the old snapshot mapped keep reading it, concurrent writers
+// do not share a temporary file, and after a crash path holds either the old or the new snapshot.
+// Returns the error message, which is empty on success.
+inline std::string WriteSnapshotFile(const std::string &path, const TapeDocument &doc) {
+    std::string tmp_path = path + ".XXXXXX";
+    int fd = ::mkostemp(&tmp_path[0], O_CLOEXEC);
+    if (fd < 0) {
+        return "cannot create " + tmp_path + ": " + std::strerror(errno);
+    }
+
+    std::string error;
+    // mkostemp makes the file private to its owner, while a snapshot is meant to be shared
+    if (::fchmod(fd, 0644) != 0) {
+        error = "cannot chmod " + tmp_path + ": " + std::strerror(errno);
+    }
+
+    if (error.empty()) {
+        FileSink sink(fd);
+        WriteSnapshot(doc, sink);
+        if (!sink.Flush()) {
+            error = "cannot write " + tmp_path + ": " + std::strerror(errno);
+        }
+    }
+    if (error.empty() && ::fsync(fd) != 0) {
+        error = "cannot sync " + tmp_path + ": " + std::strerror(errno);
+    }
+    ::close(fd);
+
+    if (error.empty() && ::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        error = "cannot rename " + tmp_path + ": " + std::strerror(errno);
+    }
+    if (!error.empty()) {
+        ::unlink(tmp_path.c_str());
+        return error;
+    }
+
+    return _SyncParentDirectory(path);
+}
+
+inline std::string WriteSnapshotFile(const std::string &path, const JsonValue &value) {
+    TapeDocument doc;
+    doc.Assign(value);
+    return WriteSnapshotFile(path, doc);
+}
+
+// A snapshot opened for reading
+class JsonSnapshot {
+  public:
+    JsonSnapshot() : tape_(nullptr), strings_(nullptr), tape_size_(0) {
+    }
+
+    JsonSnapshot(const JsonSnapshot &) = delete;
+    JsonSnapshot &operator=(const JsonSnapshot &) = delete;
+
+    // Maps the file at path and checks the whole tape. Returns the error message, which is empty on
+    // success.
+    std::string Open(const std::string &path) {
+        return _Open(path, false);
+    }
+
+    // Reads a snapshot that is already in memory, which must be 8-byte aligned and outlive this object
+    std::string Open(const char *data, size_t size) {
+        return _Open(data, size, false);
+    }
+
+    // Like Open, but only the header and the extent of the root value are checked, so the file must
+    // have been written by WriteSnapshot and not changed since. A damaged file makes TapeValue read
+    // outside the mapping.
+    std::string OpenTrusted(const std::string &path) {
+        return _Open(path, true);
+    }
+
+    std::string OpenTrusted(const char *data, size_t size) {
+        return _Open(data, size, true);
+    }
+
+    // Invalid when nothing is open or the snapshot was written from a failed parse
+    TapeValue Root() const {
+        return tape_size_ == 0 ? TapeValue() : TapeValue(tape_, strings_, 0);
+    }
+
+  private:
+    std::string _Open(const std::string &path, bool trusted) {
+        _Reset();
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return "cannot open " + path + ": " + std::strerror(errno);
+        }
+
+        // lookups jump around the tape, so the kernel should not assume a sequential read
+        std::string error;
+        bool mapped = file_.Open(fd, &error, MADV_NORMAL);
+        ::close(fd);
+        if (!mapped) {
+            return error.empty() ? "cannot map " + path : error;
+        }
+
+        error = _Open(file_.Data(), file_.Size(), trusted);
+        if (!error.empty()) {
+            file_.Close();
+        }
+        return error;
+    }
+
+    std::string _Open(const char *data, size_t size, bool trusted) {
+        tape_ = nullptr;
+        strings_ = nullptr;
+        tape_size_ = 0;
+
+        _SnapshotHeader header;
+        if (size < sizeof(header)) {
+            return "not a JSON snapshot";
+        }
+
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, kSnapshotMagic, sizeof(header.magic)) != 0) {
+            return "not a JSON snapshot";
+        }
+        if (header.byte_order != kSnapshotByteOrder) {
+            return "snapshot written with another byte order";
+        }
+        if (header.version != kSnapshotVersion) {
+            return "unsupported snapshot version " + std::to_string(header.version);
+        }
+
+        size_t body = size - sizeof(header);
+        if (header.tape_size > std::numeric_limits<std::uint32_t>::max() || header.tape_size > body / sizeof(std::uint64_t) ||
+            header.strings_size != body - header.tape_size * sizeof(std::uint64_t)) {
+            return "truncated snapshot";
+        }
+        if (reinterpret_cast<std::uintptr_t>(data) % alignof(std::uint64_t) != 0) {
+            return "snapshot is not aligned";
+        }
+
+        const std::uint64_t *tape = reinterpret_cast<const std::uint64_t *>(data + sizeof(header));
+        const char *strings = data + sizeof(header) + header.tape_size * sizeof(std::uint64_t);
+        if (header.tape_size > 0) {
+            bool valid = trusted ? TapeValue(tape, nullptr, 0)._End() == header.tape_size
+                                 : _TapeIsValid(tape, header.tape_size, strings, header.strings_size);
+            if (!valid) {
+                return "corrupt snapshot";
+            }
+        }
+
+        tape_ = tape;
+        strings_ = strings;
+        tape_size_ = static_cast<std::uint32_t>(header.tape_size);
+        return "";
+    }
+
+    void _Reset() {
+        file_.Close();
+        tape_ = nullptr;
+        strings_ = nullptr;
+        tape_size_ = 0;
+    }
+
+    MappedFile file_;
+    const std::uint64_t *tape_;
+    const char *strings_;
+    std::uint32_t tape_size_;
+};
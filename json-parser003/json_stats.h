@@ -0,0 +1,141 @@
+#pragma once
+
+// Define JSON_PARSE_STATS to let ParseOptions::stats collect what a parse with ParseContext costs.
+// Without it none of this exists and the parser has no instrumentation at all.
+#ifdef JSON_PARSE_STATS
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "input_source.h"
+#include "json_value.h"
+
+struct ParseStats {
+    // Contiguous input read for the parsed values
+    std::uint64_t bytes = 0;
+    // Indexed by JsonType
+    std::uint64_t values[7] = {};
+    // Strings and keys with escapes, in contiguous input
+    std::uint64_t escaped_strings = 0;
+    // Of nested arrays and objects, 1 for a top-level one
+    std::uint64_t max_depth = 0;
+    // Estimated from the sizes and capacities of the strings, containers and members the parser makes,
+    // from the heap or the arena, not counted at the allocator: heap strings bypass any memory resource.
+    // Allocator overhead and the hash index of a FlatObject are left out.
+    std::uint64_t estimated_allocations = 0;
+    std::uint64_t estimated_bytes = 0;
+    // Nanoseconds building the structural index, building values and joining the slices of a parallel
+    // parse. Time on several threads is summed.
+    std::uint64_t index_ns = 0;
+    std::uint64_t parse_ns = 0;
+    std::uint64_t merge_ns = 0;
+
+    std::uint64_t Values(JsonType type) const noexcept {
+        return values[static_cast<size_t>(type)];
+    }
+
+    // Adds the counts of a parse on another thread
+    void Merge(const ParseStats &other) noexcept {
+        bytes += other.bytes;
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+            values[i] += other.values[i];
+        }
+        escaped_strings += other.escaped_strings;
+        max_depth = std::max(max_depth, other.max_depth);
+        estimated_allocations += other.estimated_allocations;
+        estimated_bytes += other.estimated_bytes;
+        index_ns += other.index_ns;
+        parse_ns += other.parse_ns;
+        merge_ns += other.merge_ns;
+    }
+};
+
+// Adds the time until it is stopped or destroyed to a field of stats, which may be nullptr
+class _StatsTimer {
+  public:
+    _StatsTimer(ParseStats *stats, std::uint64_t ParseStats::*field)
+        : stats_(stats), field_(field) {
+        if (stats_ != nullptr) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    _StatsTimer(const _StatsTimer &) = delete;
+    _StatsTimer &operator=(const _StatsTimer &) = delete;
+
+    ~_StatsTimer() {
+        Stop();
+    }
+
+    void Stop() {
+        if (stats_ != nullptr) {
+            auto elapsed = std::chrono::steady_clock::now() - start_;
+            stats_->*field_ += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            stats_ = nullptr;
+        }
+    }
+
+  private:
+    ParseStats *stats_;
+    std::uint64_t ParseStats::*field_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// The cursor of a contiguous source, nullptr for the others
+template <typename Source>
+inline const char *_StatsPosition(const Source &in) {
+    if constexpr (std::is_base_of<InputSource<const char *>, Source>::value) {
+        return in.Position();
+    } else {
+        return nullptr;
+    }
+}
+
+inline void _EstimateAllocation(ParseStats &stats, size_t bytes) {
+    ++stats.estimated_allocations;
+    stats.estimated_bytes += bytes;
+}
+
+// A std::string made with new, and its characters when they do not fit in the string itself
+inline void _EstimateHeapString(ParseStats &stats, const std::string &str) {
+    _EstimateAllocation(stats, sizeof(std::string));
+    if (str.capacity() > std::string().capacity()) {
+        _EstimateAllocation(stats, str.capacity() + 1);
+    }
+}
+
+inline size_t _ObjectCapacity(const JsonObject &object) {
+#ifdef JSON_FLAT_OBJECT
+    return object.capacity();
+#else
+    (void)object;
+    return 0;
+#endif
+}
+
+// A member was added to an object whose storage was full when capacity equals the old size
+inline void _EstimateMember(ParseStats &stats, const JsonObject &object, size_t capacity, size_t size, std::string_view key,
+                         bool interned) {
+#ifdef JSON_FLAT_OBJECT
+    if (capacity == size) {
+        _EstimateAllocation(stats, object.capacity() * sizeof(JsonObject::value_type));
+    }
+    if (!interned && !key.empty()) {
+        _EstimateAllocation(stats, key.size());
+    }
+#else
+    (void)object, (void)capacity, (void)size, (void)interned;
+    // a red-black tree node has a color and three links before the member
+    _EstimateAllocation(stats, sizeof(JsonObject::value_type) + 4 * sizeof(void *));
+    if (key.size() > std::pmr::string().capacity()) {
+        _EstimateAllocation(stats, key.size() + 1);
+    }
+#endif
+}
+
+#endif
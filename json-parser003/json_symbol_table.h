@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Object keys interned once and shared by every object parsed with the table, across documents.
+//
+// The table also records the shapes of the objects, a shape being the sequence of keys an object
+// has seen so far. Records with the same layout walk the same path through the shapes, so the next
+// key is usually found by comparing it with the one key that followed last time, without hashing.
+// A shape with many children looks them up in a hash table instead. Once the table holds max_shapes
+// shapes it records no more, so records with ever new keys cannot make it grow without bound.
+//
+// The table is not thread-safe. Values whose keys were interned only stay valid while it lives.
+class SymbolTable {
+  public:
+    struct Shape {
+        // The last key of the sequence, interned; empty for the root
+        std::string_view key;
+        size_t size;
+        const Shape *parent;
+        std::vector<Shape *> children;
+        // The children by key, once there are more than kMaxLinearChildren
+        std::unordered_map<std::string_view, Shape *> index;
+    };
+
+    static constexpr size_t kMaxLinearChildren = 8;
+    static constexpr size_t kDefaultMaxShapes = 65536;
+
+    explicit SymbolTable(size_t max_shapes = kDefaultMaxShapes)
+        : max_shapes_(max_shapes), root_{std::string_view(), 0, nullptr, {}, {}} {
+    }
+
+    SymbolTable(const SymbolTable &) = delete;
+    SymbolTable &operator=(const SymbolTable &) = delete;
+
+    std::string_view Intern(std::string_view key) {
+        auto it = keys_.find(key);
+        if (it != keys_.end()) {
+            return *it;
+        }
+
+        char *chars = static_cast<char *>(arena_.allocate(key.size() + 1, 1));
+        std::memcpy(chars, key.data(), key.size());
+        chars[key.size()] = '\0';
+
+        std::string_view interned(chars, key.size());
+        keys_.insert(interned);
+        return interned;
+    }
+
+    // The shape of an object with no keys
+    const Shape *Root() const noexcept {
+        return &root_;
+    }
+
+    // Returns the shape reached by adding key to shape, or nullptr when it is new and the table is full
+    const Shape *Next(const Shape *shape, std::string_view key) {
+        // the table owns every shape, so this only drops the constness it added
+        Shape *from = const_cast<Shape *>(shape);
+        if (from->index.empty()) {
+            for (Shape *child : from->children) {
+                if (child->key == key) {
+                    return child;
+                }
+            }
+        } else {
+            auto it = from->index.find(key);
+            if (it != from->index.end()) {
+                return it->second;
+            }
+        }
+
+        if (shapes_.size() >= max_shapes_) {
+            return nullptr;
+        }
+
+        shapes_.push_back(Shape{Intern(key), from->size + 1, from, {}, {}});
+        Shape *child = &shapes_.back();
+        from->children.push_back(child);
+        if (!from->index.empty()) {
+            from->index.emplace(child->key, child);
+        } else if (from->children.size() > kMaxLinearChildren) {
+            for (Shape *sibling : from->children) {
+                from->index.emplace(sibling->key, sibling);
+            }
+        }
+        return child;
+    }
+
+    size_t NumKeys() const noexcept {
+        return keys_.size();
+    }
+
+    size_t NumShapes() const noexcept {
+        return shapes_.size();
+    }
+
+  private:
+    size_t max_shapes_;
+    std::pmr::monotonic_buffer_resource arena_;
+    std::unordered_set<std::string_view> keys_;
+    // deque, so that the shapes do not move
+    std::deque<Shape> shapes_;
+    Shape root_;
+};
@@ -0,0 +1,777 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "json_parser.h"
+
+// A read-only document in two contiguous buffers: a tape of 64-bit words in document order, and
+// the unescaped strings.
+//
+// The top 8 bits of a word are its kind, one of n t f l d " [ ] { }, and the low 56 bits its
+// payload:
+//   n t f    null, true, false; no payload
+//   l d      int64 or double; the next word holds its bits
+//   "        string or key; the offset in the string buffer of a 32-bit length, the bytes and a NUL
+//   [ {      bits 0-31 the index just past the matching ] or }, bits 32-55 the number of elements
+//            or members, saturated at kMaxTapeCount
+//   ] }      the index of the matching [ or {
+// An object holds a key word before each value.
+class TapeDocument;
+
+constexpr std::uint64_t kMaxTapeCount = 0xffffff;
+
+inline std::uint64_t _TapeWord(char kind, std::uint64_t payload) {
+    return (static_cast<std::uint64_t>(static_cast<unsigned char>(kind)) << 56) | payload;
+}
+
+inline char _TapeKind(std::uint64_t word) {
+    return static_cast<char>(word >> 56);
+}
+
+inline std::uint64_t _TapePayload(std::uint64_t word) {
+    return word & ((std::uint64_t(1) << 56) - 1);
+}
+
+// The index just past the value at index
+inline size_t _TapeSkip(const std::uint64_t *tape, size_t index) {
+    switch (_TapeKind(tape[index])) {
+    case '[':
+    case '{':
+        return static_cast<std::uint32_t>(tape[index]);
+    case 'l':
+    case 'd':
+        return index + 2;
+    default:
+        return index + 1;
+    }
+}
+
+inline std::string_view _TapeString(const char *strings, std::uint64_t word) {
+    const char *p = strings + _TapePayload(word);
+    std::uint32_t length;
+    std::memcpy(&length, p, sizeof(length));
+    return std::string_view(p + sizeof(length), length);
+}
+
+// Appends a string word and room for the length of the string, which _TapeFinishString fills in once
+// the bytes are appended
+inline size_t _TapeStartString(std::vector<std::uint64_t> &tape, std::string &strings) {
+    size_t offset = strings.size();
+    tape.push_back(_TapeWord('"', offset));
+    strings.append(sizeof(std::uint32_t), '\0');
+    return offset;
+}
+
+inline void _TapeFinishString(std::string &strings, size_t offset) {
+    std::uint32_t length = static_cast<std::uint32_t>(strings.size() - offset - sizeof(std::uint32_t));
+    std::memcpy(&strings[offset], &length, sizeof(length));
+    strings.push_back('\0');
+}
+
+// Appends the closing word of the array or object opened at start and links the opening word to it
+inline void _TapeClose(std::vector<std::uint64_t> &tape, char kind, size_t start, size_t count) {
+    tape.push_back(_TapeWord(kind, start));
+
+    std::uint64_t saturated = count < kMaxTapeCount ? count : kMaxTapeCount;
+    tape[start] = _TapeWord(_TapeKind(tape[start]), (saturated << 32) | tape.size());
+}
+
+// Checks a tape from outside the process, such as a snapshot file, in one pass: every word has a known
+// kind, every array and object is linked both ways to its closing word and holds the number of values
+// its opening word gives, objects alternate keys and values, every string lies inside the strings_size
+// bytes of strings, and the tape is exactly one value. A TapeValue reads nothing outside a tape that
+// passes.
+inline bool _TapeIsValid(const std::uint64_t *tape, size_t tape_size, const char *strings, size_t strings_size) {
+    struct Container {
+        size_t start;
+        size_t values;
+    };
+    std::vector<Container> open;
+    size_t roots = 0;
+    for (size_t i = 0; i < tape_size;) {
+        char kind = _TapeKind(tape[i]);
+        std::uint64_t payload = _TapePayload(tape[i]);
+        if (!open.empty() && _TapeKind(tape[open.back().start]) == '{' && open.back().values % 2 == 0 && kind != '"' &&
+            kind != '}') {
+            return false;
+        }
+
+        switch (kind) {
+        case 'n':
+        case 't':
+        case 'f':
+            ++i;
+            break;
+        case 'l':
+        case 'd':
+            if (tape_size - i < 2) {
+                return false;
+            }
+            i += 2;
+            break;
+        case '"': {
+            std::uint32_t length;
+            if (payload > strings_size || strings_size - payload < sizeof(length) + 1) {
+                return false;
+            }
+            std::memcpy(&length, strings + payload, sizeof(length));
+            if (strings_size - payload - sizeof(length) - 1 < length || strings[payload + sizeof(length) + length] != '\0') {
+                return false;
+            }
+            ++i;
+            break;
+        }
+        case '[':
+        case '{':
+            open.push_back(Container{i, 0});
+            ++i;
+            continue;
+        case ']':
+        case '}': {
+            if (open.empty()) {
+                return false;
+            }
+
+            Container container = open.back();
+            open.pop_back();
+            std::uint64_t start = _TapePayload(tape[container.start]);
+            size_t count = kind == '}' ? container.values / 2 : container.values;
+            if (_TapeKind(tape[container.start]) != (kind == ']' ? '[' : '{') || payload != container.start ||
+                (start & 0xffffffff) != i + 1 || (kind == '}' && container.values % 2 != 0) ||
+                (start >> 32) != std::min<std::uint64_t>(count, kMaxTapeCount)) {
+                return false;
+            }
+            ++i;
+            break;
+        }
+        default:
+            return false;
+        }
+
+        // a value ended
+        if (!open.empty()) {
+            ++open.back().values;
+        } else if (++roots > 1) {
+            return false;
+        }
+    }
+
+    return open.empty() && roots == 1;
+}
+
+// Removes the members of the object opened at start whose key comes again later in it, as parsing into
+// a JsonObject keeps the last value of a key, and returns the number of members left. The members
+// after a removed one move down, and the indices in the arrays and objects among them with them. The
+// removed keys and strings stay in the string buffer.
+inline size_t _TapeRemoveDuplicateKeys(std::vector<std::uint64_t> &tape, const std::string &strings, size_t start,
+                                       size_t count) {
+    std::string_view small[kMaxPairwiseKeys];
+    std::vector<std::string_view> large;
+    std::string_view *keys = small;
+    if (count > kMaxPairwiseKeys) {
+        large.resize(count);
+        keys = large.data();
+    }
+
+    size_t members = 0;
+    for (size_t i = start + 1; i != tape.size(); i = _TapeSkip(tape.data(), i + 1)) {
+        keys[members++] = _TapeString(strings.data(), tape[i]);
+    }
+
+    std::vector<bool> keep;
+    if (!_DuplicateKeys(keys, members, keep)) {
+        return count;
+    }
+
+    size_t out = start + 1;
+    size_t kept = 0;
+    for (size_t i = start + 1, member = 0; i != tape.size(); ++member) {
+        size_t end = _TapeSkip(tape.data(), i + 1);
+        if (keep[member]) {
+            size_t shift = i - out;
+            for (size_t j = i; shift != 0 && j != end;) {
+                std::uint64_t word = tape[j];
+                char kind = _TapeKind(word);
+                // the indices in these words are all past i, so subtracting shift cannot borrow from the
+                // kind or the count
+                if (kind == '[' || kind == '{' || kind == ']' || kind == '}') {
+                    word -= shift;
+                }
+                tape[j - shift] = word;
+                if (kind == 'l' || kind == 'd') {
+                    tape[j + 1 - shift] = tape[j + 1];
+                    ++j;
+                }
+                ++j;
+            }
+            out += end - i;
+            ++kept;
+        }
+        i = end;
+    }
+
+    tape.resize(out);
+    return kept;
+}
+
+class TapeArrayIterator;
+class TapeObjectIterator;
+
+// Cursor on a value of a TapeDocument. The getters check the type like JsonValue::Get.
+class TapeValue {
+  public:
+    TapeValue() : tape_(nullptr), strings_(nullptr), index_(0) {
+    }
+
+    bool IsValid() const noexcept {
+        return tape_ != nullptr;
+    }
+
+    JsonType Type() const;
+
+    bool GetBool() const;
+    std::int64_t GetInt64() const;
+    // Integers are converted
+    double GetDouble() const;
+    std::string_view GetString() const;
+
+    // Elements of an array or members of an object
+    size_t Size() const;
+
+    // Invalid when there is no such member or element
+    TapeValue operator[](std::string_view key) const;
+    TapeValue operator[](size_t index) const;
+
+    // The value after this one, skipping a whole array or object in one step
+    TapeValue Next() const {
+        return TapeValue(tape_, strings_, _End());
+    }
+
+    TapeArrayIterator Elements() const;
+    TapeObjectIterator Members() const;
+
+    bool ToValue(JsonValue &value) const;
+
+  private:
+    friend class TapeDocument;
+    friend class JsonSnapshot;
+    friend class TapeArrayIterator;
+    friend class TapeObjectIterator;
+
+    TapeValue(const std::uint64_t *tape, const char *strings, std::uint32_t index) : tape_(tape), strings_(strings), index_(index) {
+    }
+
+    char _Kind() const {
+        return _TapeKind(tape_[index_]);
+    }
+
+    // The index just past this value
+    std::uint32_t _End() const {
+        return static_cast<std::uint32_t>(_TapeSkip(tape_, index_));
+    }
+
+    const std::uint64_t *tape_;
+    const char *strings_;
+    std::uint32_t index_;
+};
+
+// Iterates the elements of an array: while (it.Valid()) { use *it; ++it; }
+class TapeArrayIterator {
+  public:
+    bool Valid() const noexcept {
+        return value_.IsValid() && value_._Kind() != ']';
+    }
+
+    TapeValue operator*() const {
+        return value_;
+    }
+
+    TapeArrayIterator &operator++() {
+        value_ = value_.Next();
+        return *this;
+    }
+
+  private:
+    friend class TapeValue;
+
+    explicit TapeArrayIterator(TapeValue value) : value_(value) {
+    }
+
+    TapeValue value_;
+};
+
+// Iterates the members of an object, each a key followed by its value
+class TapeObjectIterator {
+  public:
+    bool Valid() const noexcept {
+        return key_.IsValid() && key_._Kind() != '}';
+    }
+
+    std::string_view Key() const {
+        return key_.GetString();
+    }
+
+    TapeValue Value() const {
+        return key_.Next();
+    }
+
+    TapeObjectIterator &operator++() {
+        key_ = Value().Next();
+        return *this;
+    }
+
+  private:
+    friend class TapeValue;
+
+    explicit TapeObjectIterator(TapeValue key) : key_(key) {
+    }
+
+    TapeValue key_;
+};
+
+// Context for _Parse that appends to a tape. One context is made per array or object, which keeps
+// the index of its opening word.
+class TapeContext {
+  public:
+    TapeContext(std::vector<std::uint64_t> *tape, std::string *strings, size_t depth = DEFAULT_MAX_DEPTH)
+        : tape_(tape), strings_(strings), depth_(depth), start_(0), count_(0) {
+    }
+
+    bool SetNull() {
+        tape_->push_back(_TapeWord('n', 0));
+        return true;
+    }
+
+    bool SetBool(bool value) {
+        tape_->push_back(_TapeWord(value ? 't' : 'f', 0));
+        return true;
+    }
+
+    bool SetNumber(double value) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        tape_->push_back(_TapeWord('d', 0));
+        tape_->push_back(bits);
+        return true;
+    }
+
+    bool SetInt64(std::int64_t value) {
+        tape_->push_back(_TapeWord('l', 0));
+        tape_->push_back(static_cast<std::uint64_t>(value));
+        return true;
+    }
+
+    // The string is unescaped straight into the string buffer, after room for its length
+    template <typename Source>
+    bool ParseString(Source &in) {
+        size_t offset = _StartString();
+        std::string_view view;
+        if (in.ReadPlainString(view)) {
+            strings_->append(view);
+        } else if (!_ParseString(*strings_, in)) {
+            return false;
+        }
+
+        _FinishString(offset);
+        return true;
+    }
+
+    bool ParseArrayStart() {
+        return _Open('[');
+    }
+
+    template <typename Source>
+    bool ParseArrayItem(Source &in, size_t index) {
+        count_ = index + 1;
+
+        TapeContext context(tape_, strings_, depth_);
+        return _Parse(context, in);
+    }
+
+    bool ParseArrayStop() {
+        _Close(']');
+        return true;
+    }
+
+    bool ParseObjectStart() {
+        return _Open('{');
+    }
+
+    template <typename Source>
+    bool ParseObjectItem(Source &in, const std::string &key) {
+        ++count_;
+        size_t offset = _StartString();
+        strings_->append(key);
+        _FinishString(offset);
+
+        TapeContext context(tape_, strings_, depth_);
+        return _Parse(context, in);
+    }
+
+    bool ParseObjectStop() {
+        _Close('}');
+        return true;
+    }
+
+  private:
+    static constexpr size_t DEFAULT_MAX_DEPTH = 100;
+
+    size_t _StartString() {
+        return _TapeStartString(*tape_, *strings_);
+    }
+
+    void _FinishString(size_t offset) {
+        _TapeFinishString(*strings_, offset);
+    }
+
+    bool _Open(char kind) {
+        if (depth_ == 0) {
+            return false;
+        }
+
+        --depth_;
+        start_ = tape_->size();
+        tape_->push_back(_TapeWord(kind, 0));
+        return true;
+    }
+
+    void _Close(char kind) {
+        ++depth_;
+        if (kind == '}' && count_ > 1) {
+            count_ = _TapeRemoveDuplicateKeys(*tape_, *strings_, start_, count_);
+        }
+        _TapeClose(*tape_, kind, start_, count_);
+    }
+
+    std::vector<std::uint64_t> *tape_;
+    std::string *strings_;
+    size_t depth_;
+    size_t start_;
+    size_t count_;
+};
+
+class TapeDocument {
+  public:
+    template <typename Iter>
+    Iter Parse(const Iter &begin, const Iter &end, std::string *error) {
+        _Reset();
+        TapeContext context(&tape_, &strings_);
+        std::string message;
+        Iter ret = _Parse(context, begin, end, &message);
+        _Finish(message.empty());
+        if (error != nullptr) {
+            *error = std::move(message);
+        }
+        return ret;
+    }
+
+    const char *Parse(const char *begin, const char *end, std::string *error) {
+        _Reset();
+        TapeContext context(&tape_, &strings_);
+        std::string message;
+        const char *ret = _ParseContiguous(context, begin, end, &message);
+        _Finish(message.empty());
+        if (error != nullptr) {
+            *error = std::move(message);
+        }
+        return ret;
+    }
+
+    // Returns the error message, which is empty on success
+    std::string Parse(const std::string &input) {
+        std::string error;
+        Parse(input.data(), input.data() + input.size(), &error);
+        return error;
+    }
+
+    // Builds the tape of value, the inverse of TapeValue::ToValue
+    void Assign(const JsonValue &value) {
+        _Reset();
+        _Append(value);
+        _Finish(true);
+    }
+
+    // Invalid when the last parse failed
+    TapeValue Root() const {
+        return tape_.empty() ? TapeValue() : TapeValue(tape_.data(), strings_.data(), 0);
+    }
+
+    const std::vector<std::uint64_t> &Tape() const noexcept {
+        return tape_;
+    }
+
+    const std::string &Strings() const noexcept {
+        return strings_;
+    }
+
+  private:
+    void _Reset() {
+        tape_.clear();
+        strings_.clear();
+    }
+
+    // Nested arrays and objects are appended from a stack instead of recursively
+    void _Append(const JsonValue &root) {
+        struct Frame {
+            const JsonValue *value;
+            size_t start;
+            JsonArray::const_iterator element;
+            JsonObject::const_iterator member;
+        };
+
+        std::vector<Frame> stack;
+        const JsonValue *value = &root;
+        while (true) {
+            if (value != nullptr) {
+                if (value->IsArray()) {
+                    stack.push_back({value, tape_.size(), value->Get<JsonArray>().begin(), JsonObject::const_iterator()});
+                    tape_.push_back(_TapeWord('[', 0));
+                } else if (value->IsObject()) {
+                    stack.push_back({value, tape_.size(), JsonArray::const_iterator(), value->Get<JsonObject>().begin()});
+                    tape_.push_back(_TapeWord('{', 0));
+                } else {
+                    _AppendScalar(*value);
+                }
+                value = nullptr;
+            }
+
+            if (stack.empty()) {
+                break;
+            }
+
+            Frame &frame = stack.back();
+            if (frame.value->IsArray()) {
+                const JsonArray &array = frame.value->Get<JsonArray>();
+                if (frame.element != array.end()) {
+                    value = &*frame.element++;
+                    continue;
+                }
+                _TapeClose(tape_, ']', frame.start, array.size());
+            } else {
+                const JsonObject &object = frame.value->Get<JsonObject>();
+                if (frame.member != object.end()) {
+                    _AppendString(frame.member->first);
+                    value = &frame.member->second;
+                    ++frame.member;
+                    continue;
+                }
+                _TapeClose(tape_, '}', frame.start, object.size());
+            }
+            stack.pop_back();
+        }
+    }
+
+    void _AppendScalar(const JsonValue &value) {
+        switch (value.Type()) {
+        case JsonType::kBoolean:
+            tape_.push_back(_TapeWord(value.Get<bool>() ? 't' : 'f', 0));
+            break;
+        case JsonType::kInteger:
+            tape_.push_back(_TapeWord('l', 0));
+            tape_.push_back(static_cast<std::uint64_t>(value.Get<std::int64_t>()));
+            break;
+        case JsonType::kNumber: {
+            double number = value.Get<double>();
+            std::uint64_t bits;
+            std::memcpy(&bits, &number, sizeof(bits));
+            tape_.push_back(_TapeWord('d', 0));
+            tape_.push_back(bits);
+            break;
+        }
+        case JsonType::kString:
+            _AppendString(value.GetStringView());
+            break;
+        default:
+            tape_.push_back(_TapeWord('n', 0));
+            break;
+        }
+    }
+
+    void _AppendString(std::string_view str) {
+        size_t offset = _TapeStartString(tape_, strings_);
+        strings_.append(str);
+        _TapeFinishString(strings_, offset);
+    }
+
+    void _Finish(bool ok) {
+        if (!ok || tape_.size() > std::numeric_limits<std::uint32_t>::max()) {
+            _Reset();
+        }
+    }
+
+    std::vector<std::uint64_t> tape_;
+    std::string strings_;
+};
+
+inline JsonType TapeValue::Type() const {
+    switch (_Kind()) {
+    case 't':
+    case 'f':
+        return JsonType::kBoolean;
+    case 'l':
+        return JsonType::kInteger;
+    case 'd':
+        return JsonType::kNumber;
+    case '"':
+        return JsonType::kString;
+    case '[':
+        return JsonType::kArray;
+    case '{':
+        return JsonType::kObject;
+    default:
+        return JsonType::kNull;
+    }
+}
+
+inline bool TapeValue::GetBool() const {
+    JSON_ASSERT(Type() == JsonType::kBoolean);
+    return _Kind() == 't';
+}
+
+inline std::int64_t TapeValue::GetInt64() const {
+    JSON_ASSERT(Type() == JsonType::kInteger);
+    return static_cast<std::int64_t>(tape_[index_ + 1]);
+}
+
+inline double TapeValue::GetDouble() const {
+    JSON_ASSERT(Type() == JsonType::kNumber || Type() == JsonType::kInteger);
+    if (_Kind() == 'l') {
+        return static_cast<double>(GetInt64());
+    }
+
+    double value;
+    std::memcpy(&value, &tape_[index_ + 1], sizeof(value));
+    return value;
+}
+
+inline std::string_view TapeValue::GetString() const {
+    JSON_ASSERT(Type() == JsonType::kString);
+    return _TapeString(strings_, tape_[index_]);
+}
+
+inline size_t TapeValue::Size() const {
+    JSON_ASSERT(Type() == JsonType::kArray || Type() == JsonType::kObject);
+    size_t count = static_cast<size_t>(_TapePayload(tape_[index_]) >> 32);
+    if (count < kMaxTapeCount) {
+        return count;
+    }
+
+    count = 0;
+    if (_Kind() == '[') {
+        for (TapeArrayIterator it = Elements(); it.Valid(); ++it) {
+            ++count;
+        }
+    } else {
+        for (TapeObjectIterator it = Members(); it.Valid(); ++it) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+inline TapeValue TapeValue::operator[](std::string_view key) const {
+    if (!IsValid() || _Kind() != '{') {
+        return TapeValue();
+    }
+
+    for (TapeObjectIterator it = Members(); it.Valid(); ++it) {
+        if (it.Key() == key) {
+            return it.Value();
+        }
+    }
+    return TapeValue();
+}
+
+inline TapeValue TapeValue::operator[](size_t index) const {
+    if (!IsValid() || _Kind() != '[') {
+        return TapeValue();
+    }
+
+    for (TapeArrayIterator it = Elements(); it.Valid(); ++it) {
+        if (index-- == 0) {
+            return *it;
+        }
+    }
+    return TapeValue();
+}
+
+inline TapeArrayIterator TapeValue::Elements() const {
+    JSON_ASSERT(Type() == JsonType::kArray);
+    return TapeArrayIterator(TapeValue(tape_, strings_, index_ + 1));
+}
+
+inline TapeObjectIterator TapeValue::Members() const {
+    JSON_ASSERT(Type() == JsonType::kObject);
+    return TapeObjectIterator(TapeValue(tape_, strings_, index_ + 1));
+}
+
+// The tape is read in document order, with the open arrays and objects on a stack instead of recursing
+// into them
+inline bool TapeValue::ToValue(JsonValue &value) const {
+    if (!IsValid()) {
+        return false;
+    }
+
+    std::vector<JsonValue *> stack;
+    std::string_view key;
+    bool have_key = false;
+    for (std::uint32_t i = index_, end = _End(); i != end;) {
+        TapeValue current(tape_, strings_, i);
+        char kind = current._Kind();
+        if (kind == ']' || kind == '}') {
+            stack.pop_back();
+            ++i;
+            continue;
+        }
+        if (!stack.empty() && stack.back()->IsObject() && !have_key) {
+            key = current.GetString();
+            have_key = true;
+            ++i;
+            continue;
+        }
+
+        JsonValue *slot = &value;
+        if (!stack.empty() && stack.back()->IsArray()) {
+            JsonArray &array = stack.back()->Get<JsonArray>();
+            array.emplace_back();
+            slot = &array.back();
+        } else if (!stack.empty()) {
+            slot = &_ObjectMember(stack.back()->Get<JsonObject>(), key);
+            have_key = false;
+        }
+
+        switch (current.Type()) {
+        case JsonType::kNull:
+            *slot = JsonValue();
+            break;
+        case JsonType::kBoolean:
+            *slot = JsonValue(current.GetBool());
+            break;
+        case JsonType::kInteger:
+            *slot = JsonValue(current.GetInt64());
+            break;
+        case JsonType::kNumber:
+            *slot = JsonValue(current.GetDouble());
+            break;
+        case JsonType::kString:
+            *slot = JsonValue(std::string(current.GetString()));
+            break;
+        case JsonType::kArray:
+        case JsonType::kObject:
+            // the elements or members follow the opening word
+            *slot = JsonValue(current.Type());
+            stack.push_back(slot);
+            ++i;
+            continue;
+        }
+        i = current._End();
+    }
+
+    return true;
+}
@@ -1,12 +1,29 @@
 #include "json_value.h"
 
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
 JsonValue::JsonValue() : JsonValue(JsonType::kNull) {
 }
 
 JsonValue::JsonValue(std::nullptr_t) : JsonValue(JsonType::kNull) {
 }
 
-JsonValue::JsonValue(JsonType type) : type_(type), u_({}) {
+namespace {
+
+template <typename T>
+T *NewInArena(std::pmr::memory_resource *resource) {
+    void *p = resource->allocate(sizeof(T), alignof(T));
+    return new (p) T(typename T::allocator_type(resource));
+}
+
+} // namespace
+
+JsonValue::JsonValue(JsonType type) : JsonValue(type, nullptr) {
+}
+
+JsonValue::JsonValue(JsonType type, std::pmr::memory_resource *resource) : type_(type), borrowed_(false), length_(0), u_({}) {
     switch (type_) {
     case JsonType::kBoolean:
         u_.boolean_ = false;
@@ -18,94 +35,129 @@ JsonValue::JsonValue(JsonType type) : type_(type), u_({}) {
         u_.int64_ = 0;
         break;
     case JsonType::kString:
-        u_.string_ = new std::string();
+        inline_length_ = 0;
         break;
     case JsonType::kArray:
-        u_.array_ = new JsonArray();
+        if (resource != nullptr) {
+            borrowed_ = true;
+            u_.array_ = NewInArena<JsonArray>(resource);
+        } else {
+            u_.array_ = new JsonArray();
+        }
         break;
     case JsonType::kObject:
-        u_.object_ = new JsonObject();
+        if (resource != nullptr) {
+            borrowed_ = true;
+            u_.object_ = NewInArena<JsonObject>(resource);
+        } else {
+            u_.object_ = new JsonObject();
+        }
         break;
     default:
         break;
     }
 }
 
-JsonValue::JsonValue(bool value) : type_(JsonType::kBoolean), u_({}) {
+JsonValue::JsonValue(std::string_view value, std::pmr::memory_resource *resource)
+    : type_(JsonType::kString), borrowed_(false), length_(0), u_({}) {
+    // the length of a borrowed string has to fit in length_
+    if (resource == nullptr || value.size() <= kInlineCapacity || value.size() > UINT32_MAX) {
+        InitString(value);
+        return;
+    }
+
+    char *chars = static_cast<char *>(resource->allocate(value.size(), 1));
+    value.copy(chars, value.size());
+    borrowed_ = true;
+    length_ = static_cast<std::uint32_t>(value.size());
+    u_.chars_ = chars;
+}
+
+JsonValue::JsonValue(bool value) : type_(JsonType::kBoolean), borrowed_(false), length_(0), u_({}) {
     u_.boolean_ = value;
 }
 
-JsonValue::JsonValue(double value) : type_(JsonType::kNumber), u_({}) {
+JsonValue::JsonValue(double value) : type_(JsonType::kNumber), borrowed_(false), length_(0), u_({}) {
     u_.number_ = value;
 }
 
-JsonValue::JsonValue(std::int64_t value) : type_(JsonType::kInteger), u_({}) {
+JsonValue::JsonValue(std::int64_t value) : type_(JsonType::kInteger), borrowed_(false), length_(0), u_({}) {
     u_.int64_ = value;
 }
 
-JsonValue::JsonValue(const std::string &value) : type_(JsonType::kString), u_({}) {
-    u_.string_ = new std::string(value);
+JsonValue::JsonValue(const std::string &value) : type_(JsonType::kString), borrowed_(false), length_(0), u_({}) {
+    InitString(value);
 }
 
-JsonValue::JsonValue(std::string &&value) : type_(JsonType::kString), u_({}) {
-    u_.string_ = new std::string(std::move(value));
+JsonValue::JsonValue(std::string &&value) : type_(JsonType::kString), borrowed_(false), length_(0), u_({}) {
+    InitString(std::move(value));
 }
 
-JsonValue::JsonValue(const char *value) : type_(JsonType::kString), u_({}) {
-    u_.string_ = new std::string(value);
+JsonValue::JsonValue(const char *value) : type_(JsonType::kString), borrowed_(false), length_(0), u_({}) {
+    InitString(std::string_view(value));
 }
 
-JsonValue::JsonValue(const JsonArray &value) : type_(JsonType::kArray), u_({}) {
+JsonValue::JsonValue(const JsonArray &value) : type_(JsonType::kArray), borrowed_(false), length_(0), u_({}) {
     u_.array_ = new JsonArray(value);
 }
 
-JsonValue::JsonValue(JsonArray &&value) : type_(JsonType::kArray), u_({}) {
-    u_.array_ = new JsonArray(std::move(value));
+JsonValue::JsonValue(JsonArray &&value) : type_(JsonType::kArray), borrowed_(false), length_(0), u_({}) {
+    u_.array_ = NewContainer(std::move(value));
 }
 
-JsonValue::JsonValue(const JsonObject &value) : type_(JsonType::kObject), u_({}) {
+JsonValue::JsonValue(const JsonObject &value) : type_(JsonType::kObject), borrowed_(false), length_(0), u_({}) {
     u_.object_ = new JsonObject(value);
 }
 
-JsonValue::JsonValue(JsonObject &&value) : type_(JsonType::kObject), u_({}) {
-    u_.object_ = new JsonObject(std::move(value));
+JsonValue::JsonValue(JsonObject &&value) : type_(JsonType::kObject), borrowed_(false), length_(0), u_({}) {
+    u_.object_ = NewContainer(std::move(value));
 }
 
-JsonValue::JsonValue(const JsonValue &other) : type_(other.type_), u_({}) {
-    switch (type_) {
-    case JsonType::kString:
-        u_.string_ = new std::string(*other.u_.string_);
-        break;
-    case JsonType::kArray:
-        u_.array_ = new JsonArray(*other.u_.array_);
-        break;
-    case JsonType::kObject:
-        u_.object_ = new JsonObject(*other.u_.object_);
-        break;
-    default:
-        u_ = other.u_;
-        break;
+JsonValue JsonValue::Borrow(std::string_view value) {
+    if (value.size() > UINT32_MAX) {
+        return JsonValue(std::string(value));
+    }
+
+    JsonValue ret;
+    ret.type_ = JsonType::kString;
+    ret.borrowed_ = true;
+    ret.length_ = static_cast<std::uint32_t>(value.size());
+    ret.u_.chars_ = value.data();
+    return ret;
+}
+
+// A copy always owns its payload, so it outlives the arena or input the original borrowed from. A
+// deep tree is copied one level at a time instead of recursively.
+JsonValue::JsonValue(const JsonValue &other) : type_(JsonType::kNull), borrowed_(false), length_(0), u_({}) {
+    std::vector<std::pair<JsonValue *, const JsonValue *>> pending;
+    try {
+        CopyLevel(other, pending);
+        while (!pending.empty()) {
+            auto [to, from] = pending.back();
+            pending.pop_back();
+            to->CopyLevel(*from, pending);
+        }
+    } catch (...) {
+        Clear();
+        throw;
     }
 }
 
 JsonValue &JsonValue::operator=(const JsonValue &other) {
     if (this != &other) {
         JsonValue tmp(other);
-        std::swap(type_, tmp.type_);
-        std::swap(u_, tmp.u_);
+        Swap(tmp);
     }
 
     return *this;
 }
 
-JsonValue::JsonValue(JsonValue &&other) noexcept : type_(JsonType::kNull), u_({}) {
-    std::swap(type_, other.type_);
-    std::swap(u_, other.u_);
+JsonValue::JsonValue(JsonValue &&other) noexcept : type_(JsonType::kNull), borrowed_(false), length_(0), u_({}) {
+    Swap(other);
 }
 
 JsonValue &JsonValue::operator=(JsonValue &&other) noexcept {
-    std::swap(type_, other.type_);
-    std::swap(u_, other.u_);
+    Swap(other);
     return *this;
 }
 
@@ -113,45 +165,185 @@ JsonValue::~JsonValue() {
     Clear();
 }
 
+// Nested arrays and objects are compared one level at a time instead of recursively
 bool JsonValue::operator==(const JsonValue &other) const {
-    if (type_ != other.type_) {
+    std::vector<std::pair<const JsonValue *, const JsonValue *>> pending;
+    if (!EqualLevel(other, pending)) {
         return false;
     }
 
+    while (!pending.empty()) {
+        auto [lhs, rhs] = pending.back();
+        pending.pop_back();
+        if (!lhs->EqualLevel(*rhs, pending)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void JsonValue::Clear() {
+    if (borrowed_) {
+        return;
+    }
+
     switch (type_) {
-    case JsonType::kBoolean:
-        return u_.boolean_ == other.u_.boolean_;
-    case JsonType::kNumber:
-        return u_.number_ == other.u_.number_;
-    case JsonType::kInteger:
-        return u_.int64_ == other.u_.int64_;
     case JsonType::kString:
-        return *u_.string_ == *other.u_.string_;
+        if (inline_length_ == kNotInline) {
+            delete u_.string_;
+        }
+        break;
     case JsonType::kArray:
-        return *u_.array_ == *other.u_.array_;
-    case JsonType::kObject:
-        return *u_.object_ == *other.u_.object_;
+    case JsonType::kObject: {
+        // a deep tree is freed one level at a time instead of recursively
+        std::vector<JsonValue> pending;
+        DetachChildren(pending);
+        while (!pending.empty()) {
+            JsonValue value(std::move(pending.back()));
+            pending.pop_back();
+            value.DetachChildren(pending);
+        }
+
+        if (type_ == JsonType::kArray) {
+            delete u_.array_;
+        } else {
+            delete u_.object_;
+        }
+        break;
+    }
     default:
-        return true;
+        break;
     }
 }
 
-void JsonValue::Clear() {
-    switch (type_) {
+// Moves the arrays and objects owned by this value's elements or members into pending
+void JsonValue::DetachChildren(std::vector<JsonValue> &pending) {
+    auto detach = [&pending](JsonValue &child) {
+        if (!child.borrowed_ && (child.type_ == JsonType::kArray || child.type_ == JsonType::kObject)) {
+            pending.push_back(std::move(child));
+        }
+    };
+
+    if (type_ == JsonType::kArray) {
+        for (JsonValue &element : *u_.array_) {
+            detach(element);
+        }
+    } else if (type_ == JsonType::kObject) {
+        for (auto &member : *u_.object_) {
+            detach(member.second);
+        }
+    }
+}
+
+// Copies other into this null value. The elements and members of an
+// array or object are copied too when they are scalars or strings; the others are left null and added
+// to pending with the value to copy into them.
+void JsonValue::CopyLevel(const JsonValue &other, std::vector<std::pair<JsonValue *, const JsonValue *>> &pending) {
+    auto copy_child = [&pending](JsonValue &to, const JsonValue &from) {
+        if (from.type_ == JsonType::kArray || from.type_ == JsonType::kObject) {
+            pending.emplace_back(&to, &from);
+        } else {
+            to = from;
+        }
+    };
+
+    // the type is set once the payload is there, so that Clear() can free a copy that failed halfway
+    switch (other.type_) {
     case JsonType::kString:
-        delete u_.string_;
+        InitString(other.GetStringView());
+        type_ = JsonType::kString;
         break;
-    case JsonType::kArray:
-        delete u_.array_;
+    case JsonType::kArray: {
+        const JsonArray &from = *other.u_.array_;
+        u_.array_ = new JsonArray(from.size());
+        type_ = JsonType::kArray;
+        for (size_t i = 0; i < from.size(); ++i) {
+            copy_child((*u_.array_)[i], from[i]);
+        }
         break;
-    case JsonType::kObject:
-        delete u_.object_;
+    }
+    case JsonType::kObject: {
+        const JsonObject &from = *other.u_.object_;
+        u_.object_ = new JsonObject();
+        type_ = JsonType::kObject;
+#ifdef JSON_FLAT_OBJECT
+        u_.object_->reserve(from.size());
+#endif
+        for (const auto &member : from) {
+            _ObjectMember(*u_.object_, member.first);
+        }
+        // both objects have the same keys in the same order
+        auto to = u_.object_->begin();
+        for (const auto &member : from) {
+            copy_child(to->second, member.second);
+            ++to;
+        }
         break;
+    }
     default:
+        u_ = other.u_;
+        type_ = other.type_;
         break;
     }
 }
 
+// Compares the types and payloads, and the sizes of arrays and objects. Their elements and members are
+// added to pending with the ones to compare them to.
+bool JsonValue::EqualLevel(const JsonValue &other, std::vector<std::pair<const JsonValue *, const JsonValue *>> &pending) const {
+    if (type_ != other.type_) {
+        return false;
+    }
+
+    switch (type_) {
+    case JsonType::kBoolean:
+        return u_.boolean_ == other.u_.boolean_;
+    case JsonType::kNumber:
+        return u_.number_ == other.u_.number_;
+    case JsonType::kInteger:
+        return u_.int64_ == other.u_.int64_;
+    case JsonType::kString:
+        return GetStringView() == other.GetStringView();
+    case JsonType::kArray: {
+        const JsonArray &lhs = *u_.array_;
+        const JsonArray &rhs = *other.u_.array_;
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            pending.emplace_back(&lhs[i], &rhs[i]);
+        }
+        return true;
+    }
+    case JsonType::kObject: {
+        // members are equal in any order
+        const JsonObject &rhs = *other.u_.object_;
+        if (u_.object_->size() != rhs.size()) {
+            return false;
+        }
+        for (const auto &member : *u_.object_) {
+            auto it = rhs.find(member.first);
+            if (it == rhs.end()) {
+                return false;
+            }
+            pending.emplace_back(&member.second, &it->second);
+        }
+        return true;
+    }
+    default:
+        return true;
+    }
+}
+
+void JsonValue::Swap(JsonValue &other) noexcept {
+    std::swap(type_, other.type_);
+    std::swap(borrowed_, other.borrowed_);
+    std::swap(inline_length_, other.inline_length_);
+    std::swap(inline_first_, other.inline_first_);
+    std::swap(length_, other.length_);
+    std::swap(u_, other.u_);
+}
+
 bool JsonValue::IsNull() const noexcept {
     return type_ == JsonType::kNull;
 }
@@ -182,4 +374,63 @@ bool JsonValue::IsObject() const noexcept {
 
 JsonType JsonValue::Type() const noexcept {
     return type_;
-}
\ No newline at end of file
+}
+
+std::string_view JsonValue::GetStringView() const {
+    JSON_ASSERT(IsString());
+    if (borrowed_) {
+        return std::string_view(u_.chars_, length_);
+    }
+    if (inline_length_ != kNotInline) {
+        return std::string_view(InlineChars(), inline_length_);
+    }
+
+    return *u_.string_;
+}
+
+double JsonValue::GetDouble() const {
+    JSON_ASSERT(IsNumber());
+    if (type_ == JsonType::kInteger) {
+        return static_cast<double>(u_.int64_);
+    }
+
+    return u_.number_;
+}
+
+void JsonValue::InitString(std::string_view value) {
+    if (value.size() > kInlineCapacity) {
+        inline_length_ = kNotInline;
+        u_.string_ = new std::string(value);
+        return;
+    }
+
+    inline_length_ = static_cast<std::uint8_t>(value.size());
+    value.copy(InlineChars(), value.size());
+}
+
+void JsonValue::InitString(std::string &&value) {
+    if (value.size() > kInlineCapacity) {
+        inline_length_ = kNotInline;
+        u_.string_ = new std::string(std::move(value));
+        return;
+    }
+
+    InitString(std::string_view(value));
+}
+
+// The characters are read and written through the bytes of the value, from inline_first_ to the end
+const char *JsonValue::InlineChars() const noexcept {
+    static_assert(offsetof(JsonValue, inline_first_) + kInlineCapacity == sizeof(JsonValue),
+                  "the inline string must end with the value");
+    return reinterpret_cast<const char *>(this) + offsetof(JsonValue, inline_first_);
+}
+
+char *JsonValue::InlineChars() noexcept {
+    return reinterpret_cast<char *>(this) + offsetof(JsonValue, inline_first_);
+}
+
+void JsonValue::MoveToHeap() {
+    std::string *str = new std::string(InlineChars(), inline_length_);
+    inline_length_ = kNotInline;
+    u_.string_ = str;
+}
@@ -1,18 +1,24 @@
 #pragma once
 
 #include <cstdint>
+#include <memory_resource>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
 #include <vector>
 #include <map>
 
+#include "json_flat_object.h"
+
 #define JSON_ASSERT(cond)                                                                                                          \
     do {                                                                                                                           \
         if (!(cond))                                                                                                               \
             throw std::runtime_error(#cond);                                                                                       \
     } while (0)
 
-enum class JsonType {
+enum class JsonType : std::uint8_t {
     kNull,
     kBoolean,
     kNumber,
@@ -23,8 +29,18 @@ enum class JsonType {
 };
 
 class JsonValue;
-using JsonArray = std::vector<JsonValue>;
-using JsonObject = std::map<std::string, JsonValue>;
+// The containers are pmr types so that a JsonDocument can allocate them from its arena. They used to
+// be std::vector<JsonValue> and std::map<std::string, JsonValue>, which do not convert to them: code
+// that named those types has to use JsonArray and JsonObject, and object keys are std::pmr::string
+// (std::string_view with JSON_FLAT_OBJECT) rather than std::string.
+using JsonArray = std::pmr::vector<JsonValue>;
+// Define JSON_FLAT_OBJECT to keep object members in a vector in insertion order instead of a tree
+// sorted by key
+#ifdef JSON_FLAT_OBJECT
+using JsonObject = FlatObject<JsonValue>;
+#else
+using JsonObject = std::pmr::map<std::pmr::string, JsonValue, std::less<>>;
+#endif
 
 class JsonValue {
   public:
@@ -40,20 +56,29 @@ class JsonValue {
     explicit JsonValue(double value);
     explicit JsonValue(std::int64_t value);
 
-    // string constructor
+    // string constructor. Strings up to kInlineCapacity bytes are stored in the value itself, longer
+    // ones in a std::string on the heap.
     explicit JsonValue(JsonType type);
+    // Arena constructors. Strings, arrays and objects are allocated from resource and are not freed
+    // by this value; they live until the resource releases its memory. nullptr means the heap.
+    JsonValue(JsonType type, std::pmr::memory_resource *resource);
+    JsonValue(std::string_view value, std::pmr::memory_resource *resource);
     explicit JsonValue(const std::string &value);
     explicit JsonValue(std::string &&value);
     explicit JsonValue(const char *value);
 
-    // array constructor
+    // array constructor. Like every container a value owns, the array uses the default resource; one
+    // from another resource, such as an arena, is copied rather than moved.
     explicit JsonValue(const JsonArray &value);
     explicit JsonValue(JsonArray &&value);
 
-    // object constructor
+    // object constructor, which also copies an object from another resource
     explicit JsonValue(const JsonObject &value);
     explicit JsonValue(JsonObject &&value);
 
+    // A string that points into memory owned by the caller, which must outlive the value
+    static JsonValue Borrow(std::string_view value);
+
     JsonValue(const JsonValue &other);
     JsonValue &operator=(const JsonValue &other);
     JsonValue(JsonValue &&other) noexcept;
@@ -84,17 +109,48 @@ class JsonValue {
     template <typename T>
     void Set(T &&value);
 
+    // Works for every string. Get<std::string>() only works on a non-const value that owns its string;
+    // on a const value it does not compile, since an inline string has no std::string to refer to.
+    std::string_view GetStringView() const;
+    // Works for every IsNumber() value, integers included. Is<double>() and Get<double>() are only for
+    // kNumber, as Is<std::int64_t>() and Get<std::int64_t>() are only for kInteger.
+    double GetDouble() const;
+
     JsonType Type() const noexcept;
 
+    static constexpr size_t kInlineCapacity = 13;
+
   private:
+    static constexpr std::uint8_t kNotInline = 0xff;
+
     void Clear();
+    void DetachChildren(std::vector<JsonValue> &pending);
+    void CopyLevel(const JsonValue &other, std::vector<std::pair<JsonValue *, const JsonValue *>> &pending);
+    bool EqualLevel(const JsonValue &other, std::vector<std::pair<const JsonValue *, const JsonValue *>> &pending) const;
+    void Swap(JsonValue &other) noexcept;
+    template <typename Container>
+    static Container *NewContainer(Container &&value);
+    void InitString(std::string_view value);
+    void InitString(std::string &&value);
+    const char *InlineChars() const noexcept;
+    char *InlineChars() noexcept;
+    // Moves an inline string to the heap, for the non-const Get<std::string>()
+    void MoveToHeap();
 
     JsonType type_;
+    // The payload is not owned: it is in an arena, and a string is stored as chars_ and length_
+    bool borrowed_;
+    // The length of a string stored in the value itself, whose characters start at inline_first_ and
+    // run on over length_ and u_
+    std::uint8_t inline_length_ = kNotInline;
+    char inline_first_ = 0;
+    std::uint32_t length_;
     union {
         bool boolean_;
         double number_;
         std::int64_t int64_;
         std::string *string_;
+        const char *chars_;
         JsonArray *array_;
         JsonObject *object_;
     } u_;
@@ -129,42 +185,51 @@ IS(JsonObject, JsonType::kObject)
 
 GET(bool, u_.boolean_)
 GET(std::int64_t, u_.int64_)
-GET(std::string, *u_.string_)
 GET(JsonArray, *u_.array_)
 GET(JsonObject, *u_.object_)
 
 #undef GET
 
-// for number
+// An inline string would have to be moved to the heap, which a const value cannot do; use
+// GetStringView(). The non-const overload moves an inline string to the heap first.
+template <>
+const std::string &JsonValue::Get<std::string>() const = delete;
+
+template <>
+inline std::string &JsonValue::Get<std::string>() {
+    JSON_ASSERT(Is<std::string>() && !borrowed_);
+    if (inline_length_ != kNotInline) {
+        MoveToHeap();
+    }
+    return *u_.string_;
+}
+
+// for number; an integer is read with Get<std::int64_t>() or GetDouble()
 template <>
 inline bool JsonValue::Is<double>() const noexcept {
-    return type_ == JsonType::kNumber || type_ == JsonType::kInteger;
+    return type_ == JsonType::kNumber;
 }
 
 template <>
 inline const double &JsonValue::Get<double>() const {
     JSON_ASSERT(Is<double>());
-    if (type_ == JsonType::kNumber) {
-        return u_.number_;
-    }
-
-    auto *self = const_cast<JsonValue *>(this);
-    self->type_ = JsonType::kNumber;
-    self->u_.number_ = self->u_.int64_;
-    return self->u_.number_;
+    return u_.number_;
 }
 
 template <>
 inline double &JsonValue::Get<double>() {
     JSON_ASSERT(Is<double>());
-    if (type_ == JsonType::kNumber) {
-        return u_.number_;
-    }
+    return u_.number_;
+}
 
-    auto *self = const_cast<JsonValue *>(this);
-    self->type_ = JsonType::kNumber;
-    self->u_.number_ = self->u_.int64_;
-    return self->u_.number_;
+// The value frees the container with delete, so one that allocates from another resource is copied
+// into the default one instead of being moved; its resource may be released before the value goes.
+template <typename Container>
+inline Container *JsonValue::NewContainer(Container &&value) {
+    if (value.get_allocator().resource() == std::pmr::get_default_resource()) {
+        return new Container(std::move(value));
+    }
+    return new Container(value);
 }
 
 #define SET(c_type, json_type, setter)                                                                                             \
@@ -172,13 +237,15 @@ inline double &JsonValue::Get<double>() {
     inline void JsonValue::Set<c_type>(const c_type &value) {                                                                      \
         Clear();                                                                                                                   \
         type_ = (json_type);                                                                                                       \
+        borrowed_ = false;                                                                                                         \
+        inline_length_ = kNotInline;                                                                                               \
         setter;                                                                                                                    \
     }
 
 SET(bool, JsonType::kBoolean, u_.boolean_ = value)
 SET(double, JsonType::kNumber, u_.number_ = value)
 SET(std::int64_t, JsonType::kInteger, u_.int64_ = value)
-SET(std::string, JsonType::kString, u_.string_ = new std::string(value))
+SET(std::string, JsonType::kString, InitString(value))
 SET(JsonArray, JsonType::kArray, u_.array_ = new JsonArray(value))
 SET(JsonObject, JsonType::kObject, u_.object_ = new JsonObject(value))
 
@@ -189,11 +256,39 @@ SET(JsonObject, JsonType::kObject, u_.object_ = new JsonObject(value))
     inline void JsonValue::Set<c_type>(c_type && value) {                                                                          \
         Clear();                                                                                                                   \
         type_ = (json_type);                                                                                                       \
+        borrowed_ = false;                                                                                                         \
+        inline_length_ = kNotInline;                                                                                               \
         setter;                                                                                                                    \
     }
 
-RVALUE_SET(std::string, JsonType::kString, u_.string_ = new std::string(std::move(value)))
-RVALUE_SET(JsonArray, JsonType::kArray, u_.array_ = new JsonArray(std::move(value)))
-RVALUE_SET(JsonObject, JsonType::kObject, u_.object_ = new JsonObject(std::move(value)))
+RVALUE_SET(std::string, JsonType::kString, InitString(std::move(value)))
+RVALUE_SET(JsonArray, JsonType::kArray, u_.array_ = NewContainer(std::move(value)))
+RVALUE_SET(JsonObject, JsonType::kObject, u_.object_ = NewContainer(std::move(value)))
+
+#undef RVALUE_SET
+
+// Returns the member for key, adding a null one when there is none. The key is allocated with the
+// allocator of the object.
+inline JsonValue &_ObjectMember(JsonObject &object, std::string_view key) {
+#ifdef JSON_FLAT_OBJECT
+    return object.try_emplace(key).first->second;
+#else
+    auto it = object.lower_bound(key);
+    if (it == object.end() || it->first != key) {
+        it = object.emplace_hint(it, std::piecewise_construct, std::forward_as_tuple(key.data(), key.size()),
+                                 std::forward_as_tuple());
+    }
+    return it->second;
+#endif
+}
 
-#undef RVALUE_SET
\ No newline at end of file
+// Like _ObjectMember for a key interned in symbols. Only a FlatObject can point to interned keys;
+// the keys of a std::map are always copied.
+inline JsonValue &_InternedObjectMember(JsonObject &object, std::string_view key, SymbolTable &symbols) {
+#ifdef JSON_FLAT_OBJECT
+    return object.try_emplace_interned(key, symbols).first->second;
+#else
+    (void)symbols;
+    return _ObjectMember(object, key);
+#endif
+}
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <unistd.h>
+
+#include "json_value.h"
+#include "input_source.h"
+
+// A sink receives the serialized bytes through Write(data, size) and Put(ch).
+
+// Appends to a caller-provided string, which grows as needed
+class StringSink {
+  public:
+    explicit StringSink(std::string &out) : out_(out) {
+    }
+
+    void Write(const char *data, size_t size) {
+        out_.append(data, size);
+    }
+
+    void Put(char ch) {
+        out_.push_back(ch);
+    }
+
+  private:
+    std::string &out_;
+};
+
+// Buffers the output and writes it to a file descriptor in large chunks
+class FileSink {
+  public:
+    explicit FileSink(int fd) : fd_(fd), size_(0), ok_(true) {
+    }
+
+    FileSink(const FileSink &) = delete;
+    FileSink &operator=(const FileSink &) = delete;
+
+    ~FileSink() {
+        Flush();
+    }
+
+    void Write(const char *data, size_t size) {
+        if (size > sizeof(buffer_) - size_) {
+            Flush();
+            if (size > sizeof(buffer_)) {
+                WriteAll(data, size);
+                return;
+            }
+        }
+
+        std::memcpy(buffer_ + size_, data, size);
+        size_ += size;
+    }
+
+    void Put(char ch) {
+        if (size_ == sizeof(buffer_)) {
+            Flush();
+        }
+
+        buffer_[size_++] = ch;
+    }
+
+    // Returns false if any write so far has failed
+    bool Flush() {
+        WriteAll(buffer_, size_);
+        size_ = 0;
+        return ok_;
+    }
+
+  private:
+    void WriteAll(const char *data, size_t size) {
+        while (ok_ && size > 0) {
+            ssize_t written = ::write(fd_, data, size);
+            if (written < 0) {
+                ok_ = errno == EINTR;
+                continue;
+            }
+
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    int fd_;
+    char buffer_[64 * 1024];
+    size_t size_;
+    bool ok_;
+};
+
+struct WriteOptions {
+    // Puts every array element and object member on its own line
+    bool pretty = false;
+    int indent = 4;
+};
+
+template <typename Sink>
+inline void _WriteString(std::string_view str, Sink &sink) {
+    static constexpr char hex[] = "0123456789abcdef";
+
+    sink.Put('"');
+
+    const char *p = str.data();
+    const char *end = p + str.size();
+    while (true) {
+        // the characters to escape are the ones that end a plain run in the parser
+        const char *special = _ScanPlainString(p, end);
+        sink.Write(p, static_cast<size_t>(special - p));
+        if (special == end) {
+            break;
+        }
+
+        switch (*special) {
+        case '"':
+            sink.Write("\\\"", 2);
+            break;
+        case '\\':
+            sink.Write("\\\\", 2);
+            break;
+        case '\b':
+            sink.Write("\\b", 2);
+            break;
+        case '\f':
+            sink.Write("\\f", 2);
+            break;
+        case '\n':
+            sink.Write("\\n", 2);
+            break;
+        case '\r':
+            sink.Write("\\r", 2);
+            break;
+        case '\t':
+            sink.Write("\\t", 2);
+            break;
+        default: {
+            char escape[] = {'\\', 'u', '0', '0', hex[(*special >> 4) & 0xf], hex[*special & 0xf]};
+            sink.Write(escape, sizeof(escape));
+            break;
+        }
+        }
+
+        p = special + 1;
+    }
+
+    sink.Put('"');
+}
+
+template <typename Sink>
+inline void _WriteNumber(double value, Sink &sink) {
+    // JSON has no representation for them
+    if (!std::isfinite(value)) {
+        sink.Write("null", 4);
+        return;
+    }
+
+    // shortest representation that reads back to the same double
+    char buf[32];
+    char *end = std::to_chars(buf, buf + sizeof(buf), value).ptr;
+    sink.Write(buf, static_cast<size_t>(end - buf));
+
+    // keep it a number rather than an integer when it is parsed again
+    if (std::find_if(buf, end, [](char ch) { return ch == '.' || ch == 'e'; }) == end) {
+        sink.Write(".0", 2);
+    }
+}
+
+template <typename Sink>
+inline void _WriteIndent(int level, const WriteOptions &options, Sink &sink) {
+    static constexpr char spaces[] = "                                ";
+
+    sink.Put('\n');
+    for (int n = level * options.indent; n > 0; n -= sizeof(spaces) - 1) {
+        sink.Write(spaces, static_cast<size_t>(std::min<int>(n, sizeof(spaces) - 1)));
+    }
+}
+
+template <typename Sink>
+inline void _WriteScalar(const JsonValue &value, Sink &sink) {
+    switch (value.Type()) {
+    case JsonType::kBoolean:
+        if (value.Get<bool>()) {
+            sink.Write("true", 4);
+        } else {
+            sink.Write("false", 5);
+        }
+        break;
+    case JsonType::kInteger: {
+        char buf[24];
+        char *end = std::to_chars(buf, buf + sizeof(buf), value.Get<std::int64_t>()).ptr;
+        sink.Write(buf, static_cast<size_t>(end - buf));
+        break;
+    }
+    case JsonType::kNumber:
+        _WriteNumber(value.Get<double>(), sink);
+        break;
+    case JsonType::kString:
+        _WriteString(value.GetStringView(), sink);
+        break;
+    default:
+        sink.Write("null", 4);
+        break;
+    }
+}
+
+// An array or object being written, and its next element or member
+struct _WriteFrame {
+    const JsonValue *value;
+    JsonArray::const_iterator element;
+    JsonObject::const_iterator member;
+};
+
+// Nested arrays and objects are written from a stack instead of recursively, so any value the parser
+// accepts can be written back
+template <typename Sink>
+inline void _WriteJson(const JsonValue &root, Sink &sink, const WriteOptions &options) {
+    std::vector<_WriteFrame> stack;
+    const JsonValue *value = &root;
+    while (true) {
+        if (value != nullptr) {
+            if (value->IsArray()) {
+                sink.Put('[');
+                stack.push_back({value, value->Get<JsonArray>().begin(), JsonObject::const_iterator()});
+            } else if (value->IsObject()) {
+                sink.Put('{');
+                stack.push_back({value, JsonArray::const_iterator(), value->Get<JsonObject>().begin()});
+            } else {
+                _WriteScalar(*value, sink);
+            }
+            value = nullptr;
+        }
+
+        if (stack.empty()) {
+            break;
+        }
+
+        _WriteFrame &frame = stack.back();
+        int level = static_cast<int>(stack.size()) - 1;
+        if (frame.value->IsArray()) {
+            const JsonArray &array = frame.value->Get<JsonArray>();
+            if (frame.element != array.end()) {
+                if (frame.element != array.begin()) {
+                    sink.Put(',');
+                }
+                if (options.pretty) {
+                    _WriteIndent(level + 1, options, sink);
+                }
+
+                value = &*frame.element++;
+                continue;
+            }
+
+            if (options.pretty && !array.empty()) {
+                _WriteIndent(level, options, sink);
+            }
+            sink.Put(']');
+        } else {
+            const JsonObject &object = frame.value->Get<JsonObject>();
+            if (frame.member != object.end()) {
+                if (frame.member != object.begin()) {
+                    sink.Put(',');
+                }
+                if (options.pretty) {
+                    _WriteIndent(level + 1, options, sink);
+                }
+
+                _WriteString(frame.member->first, sink);
+                if (options.pretty) {
+                    sink.Write(": ", 2);
+                } else {
+                    sink.Put(':');
+                }
+                value = &frame.member->second;
+                ++frame.member;
+                continue;
+            }
+
+            if (options.pretty && !object.empty()) {
+                _WriteIndent(level, options, sink);
+            }
+            sink.Put('}');
+        }
+        stack.pop_back();
+    }
+}
+
+// The second parameter is only taken as a sink when it has Put(), so WriteJson(value, options) picks
+// the overload below
+template <typename Sink, typename = decltype(std::declval<Sink &>().Put(' '))>
+void WriteJson(const JsonValue &value, Sink &sink, const WriteOptions &options = WriteOptions()) {
+    _WriteJson(value, sink, options);
+}
+
+inline std::string WriteJson(const JsonValue &value, const WriteOptions &options = WriteOptions()) {
+    std::string out;
+    StringSink sink(out);
+    WriteJson(value, sink, options);
+    return out;
+}
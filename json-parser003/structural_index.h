@@ -0,0 +1,327 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "input_source.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define JSON_STRUCTURAL_INDEX_X86 1
+#endif
+
+// Stage 1 of the two-stage parser for contiguous input.
+//
+// Each 64-byte block is classified with SIMD into bitmasks of quotes, backslashes, structural
+// characters and whitespace. Escaped quotes are removed, the inside of strings is masked out with a
+// prefix xor over the quotes, and the offsets of structural characters, quotes and the first byte of
+// every scalar outside strings are recorded.
+class StructuralIndex {
+  public:
+    // Whether stage 1 runs with SIMD. Build() also works without it, one byte at a time.
+    static bool IsSupported() {
+        return _SelectKernel() != _ClassifyScalar;
+    }
+
+    bool Build(const char *begin, const char *end) {
+        ClassifyFunc classify = _SelectKernel();
+        std::size_t size = static_cast<std::size_t>(end - begin);
+        if (size > std::numeric_limits<std::uint32_t>::max()) {
+            return false;
+        }
+
+        positions_.clear();
+
+        std::uint64_t prev_escaped = 0;
+        std::uint64_t prev_in_string = 0;
+        std::uint64_t prev_boundary = 1;
+        for (std::size_t offset = 0; offset < size; offset += 64) {
+            const char *block = begin + offset;
+            char tail[64];
+            if (size - offset < 64) {
+                std::memset(tail, ' ', sizeof(tail));
+                std::memcpy(tail, block, size - offset);
+                block = tail;
+            }
+
+            BlockMasks masks;
+            classify(block, masks);
+
+            std::uint64_t escaped = _FindEscaped(masks.backslash, prev_escaped);
+            std::uint64_t quote = masks.quote & ~escaped;
+            std::uint64_t in_string = _PrefixXor(quote) ^ prev_in_string;
+            prev_in_string = 0 - (in_string >> 63);
+
+            // in_string covers an opening quote and the string body but not the closing quote
+            std::uint64_t outside = ~in_string;
+            std::uint64_t op = masks.op & outside;
+            std::uint64_t boundary = op | (masks.space & outside) | (quote & outside);
+            std::uint64_t scalar = outside & ~(masks.op | masks.space | quote) & ((boundary << 1) | prev_boundary);
+            prev_boundary = boundary >> 63;
+
+            std::uint64_t bits = op | quote | scalar;
+            if (size - offset < 64) {
+                bits &= (std::uint64_t(1) << (size - offset)) - 1;
+            }
+
+            while (bits != 0) {
+                positions_.push_back(static_cast<std::uint32_t>(offset + __builtin_ctzll(bits)));
+                bits &= bits - 1;
+            }
+        }
+
+        return true;
+    }
+
+    const std::vector<std::uint32_t> &Positions() const noexcept {
+        return positions_;
+    }
+
+  private:
+    struct BlockMasks {
+        std::uint64_t quote;
+        std::uint64_t backslash;
+        std::uint64_t op;
+        std::uint64_t space;
+    };
+
+    using ClassifyFunc = void (*)(const char *block, BlockMasks &masks);
+
+    // Backslashes are rare, so walking them one by one is cheaper than the carry tricks
+    static std::uint64_t _FindEscaped(std::uint64_t backslash, std::uint64_t &prev_escaped) {
+        std::uint64_t escaped = prev_escaped;
+        backslash &= ~prev_escaped;
+        prev_escaped = 0;
+
+        while (backslash != 0) {
+            int i = __builtin_ctzll(backslash);
+            if (i == 63) {
+                prev_escaped = 1;
+                break;
+            }
+
+            escaped |= std::uint64_t(2) << i;
+            backslash &= ~(std::uint64_t(3) << i);
+        }
+
+        return escaped;
+    }
+
+    static std::uint64_t _PrefixXor(std::uint64_t bits) {
+        bits ^= bits << 1;
+        bits ^= bits << 2;
+        bits ^= bits << 4;
+        bits ^= bits << 8;
+        bits ^= bits << 16;
+        bits ^= bits << 32;
+        return bits;
+    }
+
+    static void _ClassifyScalar(const char *block, BlockMasks &masks) {
+        masks = BlockMasks{};
+        for (int i = 0; i < 64; ++i) {
+            std::uint64_t bit = std::uint64_t(1) << i;
+            switch (block[i]) {
+            case '"':
+                masks.quote |= bit;
+                break;
+            case '\\':
+                masks.backslash |= bit;
+                break;
+            case ',':
+            case ':':
+            case '[':
+            case ']':
+            case '{':
+            case '}':
+                masks.op |= bit;
+                break;
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                masks.space |= bit;
+                break;
+            }
+        }
+    }
+
+#ifdef JSON_STRUCTURAL_INDEX_X86
+    __attribute__((target("avx2"))) static void _ClassifyAvx2(const char *block, BlockMasks &masks) {
+        masks = BlockMasks{};
+        for (int i = 0; i < 2; ++i) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(block + 32 * i));
+            __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+
+            __m256i quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+            __m256i backslash = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'));
+            // '[' and ']' differ from '{' and '}' only in bit 0x20
+            __m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(lower, _mm256_set1_epi8('{')),
+                                                         _mm256_cmpeq_epi8(lower, _mm256_set1_epi8('}'))),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')),
+                                                         _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':'))));
+            __m256i space = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                                            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+
+            int shift = 32 * i;
+            masks.quote |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(quote))) << shift;
+            masks.backslash |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(backslash))) << shift;
+            masks.op |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(op))) << shift;
+            masks.space |= std::uint64_t(static_cast<std::uint32_t>(_mm256_movemask_epi8(space))) << shift;
+        }
+    }
+
+    __attribute__((target("sse4.2"))) static void _ClassifySse42(const char *block, BlockMasks &masks) {
+        constexpr int mode = _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK;
+        const __m128i op_set = _mm_setr_epi8(',', ':', '[', ']', '{', '}', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i space_set = _mm_setr_epi8(' ', '\t', '\n', '\r', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+        masks = BlockMasks{};
+        for (int i = 0; i < 4; ++i) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i));
+
+            // explicit lengths, so NUL bytes in the input do not cut the comparison short
+            std::uint64_t op = static_cast<std::uint16_t>(_mm_cvtsi128_si32(_mm_cmpestrm(op_set, 6, v, 16, mode)));
+            std::uint64_t space = static_cast<std::uint16_t>(_mm_cvtsi128_si32(_mm_cmpestrm(space_set, 4, v, 16, mode)));
+            std::uint64_t quote = static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"'))));
+            std::uint64_t backslash = static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+
+            int shift = 16 * i;
+            masks.quote |= quote << shift;
+            masks.backslash |= backslash << shift;
+            masks.op |= op << shift;
+            masks.space |= space << shift;
+        }
+    }
+#endif
+
+    static ClassifyFunc _SelectKernel() {
+#ifdef JSON_STRUCTURAL_INDEX_X86
+        static const ClassifyFunc kernel = []() -> ClassifyFunc {
+            if (__builtin_cpu_supports("avx2")) {
+                return _ClassifyAvx2;
+            }
+            if (__builtin_cpu_supports("sse4.2")) {
+                return _ClassifySse42;
+            }
+            return _ClassifyScalar;
+        }();
+        return kernel;
+#else
+        return _ClassifyScalar;
+#endif
+    }
+
+    std::vector<std::uint32_t> positions_;
+};
+
+// Stage 2 of the two-stage parser. Whitespace runs and string bodies are crossed by jumping to the
+// next position recorded in a StructuralIndex instead of scanning them.
+class StructuralInputSource : public InputSource<const char *> {
+  public:
+    StructuralInputSource(const char *begin, const char *end, const StructuralIndex &index)
+        : InputSource<const char *>(begin, end), positions_(index.Positions().data()), num_positions_(index.Positions().size()),
+          next_(0) {
+    }
+
+    // Starts reading at start instead of begin
+    StructuralInputSource(const char *begin, const char *end, const StructuralIndex &index, const char *start)
+        : StructuralInputSource(begin, end, index) {
+        current_ = start;
+        next_ = static_cast<std::size_t>(std::lower_bound(positions_, positions_ + num_positions_,
+                                                          static_cast<std::uint32_t>(start - begin)) -
+                                         positions_);
+    }
+
+    void SkipWhiteSpace() {
+        consumed_ = false;
+        if (current_ == end_ || !(*current_ == ' ' || *current_ == '\t' || *current_ == '\n' || *current_ == '\r')) {
+            return;
+        }
+
+        // the first byte after whitespace outside a string is always in the index
+        current_ = _NextPosition();
+    }
+
+    bool Expect(int expected) {
+        SkipWhiteSpace();
+        if (GetChar() != expected) {
+            UnGetChar();
+            return false;
+        }
+
+        return true;
+    }
+
+    // Inside a string the next indexed position is its closing quote
+    void ReadStringRun(std::string &out) {
+        _ReadStringRun(_NextPosition(), out);
+    }
+
+    bool ReadPlainString(std::string_view &out) {
+        return _ReadPlainString(_NextPosition(), out);
+    }
+
+    // Moves past the value at the current position by walking the index alone. Brackets are
+    // counted but not paired, and strings and scalars are not read, so an error inside the value
+    // may go unnoticed.
+    bool SkipValue() {
+        SkipWhiteSpace();
+        const char *p = _NextPosition();
+        if (p == end_ || p != current_) {
+            return false;
+        }
+
+        std::size_t depth = 0;
+        do {
+            char ch = begin_[positions_[next_++]];
+            if (ch == '[' || ch == '{') {
+                ++depth;
+            } else if (ch == ']' || ch == '}') {
+                if (depth-- == 0) {
+                    return false;
+                }
+            } else if (ch == '"') {
+                // the closing quote
+                if (next_++ == num_positions_) {
+                    return false;
+                }
+            } else if (depth == 0 && ch != '-' && (ch < '0' || ch > '9') && ch != 't' && ch != 'f' && ch != 'n') {
+                return false;
+            }
+        } while (depth > 0 && next_ < num_positions_);
+
+        if (depth > 0) {
+            return false;
+        }
+
+        // a scalar runs up to the next token
+        char last = begin_[positions_[next_ - 1]];
+        if (last == ']' || last == '}' || last == '"') {
+            current_ = begin_ + positions_[next_ - 1] + 1;
+        } else {
+            current_ = next_ < num_positions_ ? begin_ + positions_[next_] : end_;
+        }
+        return true;
+    }
+
+  private:
+    const char *_NextPosition() {
+        std::uint32_t offset = static_cast<std::uint32_t>(current_ - begin_);
+        while (next_ < num_positions_ && positions_[next_] < offset) {
+            ++next_;
+        }
+
+        return next_ < num_positions_ ? begin_ + positions_[next_] : end_;
+    }
+
+    const std::uint32_t *positions_;
+    std::size_t num_positions_;
+    std::size_t next_;
+};
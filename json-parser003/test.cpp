@@ -1,6 +1,25 @@
 #include <cassert>
+#include <cstdio>
+#include <limits>
+#include <list>
+#include <thread>
+#include <type_traits>
+#include <utility>
 
+#include "json_binary.h"
+#include "json_bind.h"
+#include "json_compact.h"
+#include "json_document.h"
+#include "json_file.h"
+#include "json_filter.h"
+#include "json_lazy.h"
+#include "json_ndjson.h"
 #include "json_parser.h"
+#include "json_push_parser.h"
+#include "json_sax.h"
+#include "json_snapshot.h"
+#include "json_tape.h"
+#include "json_writer.h"
 
 namespace {
 
@@ -36,6 +55,14 @@ void TestNumber() {
     } test_data[] = {
         {"0.5", 0.5},
         {"123.0", 123},
+        {"-1.25e-3", -0.00125},
+        {"1E2", 100},
+        {"-122.4194155", -122.4194155},
+        {"1.7976931348623157e308", 1.7976931348623157e308},
+        {"4.9e-324", 4.9e-324},
+        {"9223372036854775808", 9223372036854775808.0},
+        {"123456789012345678901234567890", 123456789012345678901234567890.0},
+        {"0.1000000000000000055511151231257827021181583404541015625", 0.1},
     };
 
     for (const auto &t : test_data) {
@@ -54,6 +81,9 @@ void TestInteger() {
     } test_data[] = {
         {"42", 42},
         {"52719", 52719},
+        {"-0", 0},
+        {"9223372036854775807", std::numeric_limits<std::int64_t>::max()},
+        {"-9223372036854775808", std::numeric_limits<std::int64_t>::min()},
     };
 
     for (const auto &t : test_data) {
@@ -62,6 +92,29 @@ void TestInteger() {
         assert(error.empty());
         assert(v.IsInteger());
         assert(v.Get<std::int64_t>() == t.expected);
+
+        // GetDouble() converts without turning the integer into a number, and Get<double>() is only for
+        // numbers whether the value is const or not
+        const JsonValue &const_v = v;
+        assert(const_v.GetDouble() == static_cast<double>(t.expected) && const_v.IsInteger() && const_v.IsNumber());
+        assert(!v.Is<double>());
+        bool thrown = false;
+        try {
+            v.Get<double>();
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        assert(thrown && v.IsInteger());
+    }
+}
+
+void TestInvalidNumber() {
+    std::string inputs[] = {"-", "[1.]", "[.5]", "[1e]", "[1e+]", "[01]", "[-x]"};
+
+    for (const auto &input : inputs) {
+        JsonValue v;
+        std::string error = ParseJson(input, v);
+        assert(!error.empty());
     }
 }
 
@@ -83,6 +136,56 @@ void TestString() {
     }
 }
 
+template <typename Value, typename = void>
+struct HasConstStringGetter : std::false_type {};
+
+template <typename Value>
+struct HasConstStringGetter<Value, std::void_t<decltype(std::declval<const Value &>().template Get<std::string>())>>
+    : std::true_type {};
+
+void TestInlineString() {
+    static_assert(sizeof(JsonValue) == 16, "inline strings must not grow the value");
+    auto is_inline = [](const JsonValue &v) {
+        const char *data = v.GetStringView().data();
+        return data >= reinterpret_cast<const char *>(&v) && data < reinterpret_cast<const char *>(&v + 1);
+    };
+
+    std::string longest(JsonValue::kInlineCapacity, 'x');
+    JsonValue v;
+    assert(ParseJson(R"(["ok", "", ")" + longest + R"(", ")" + longest + R"(y", "a\u0000b"])", v).empty());
+    const JsonArray &array = v.Get<JsonArray>();
+    assert(is_inline(array[0]) && array[0].GetStringView() == "ok");
+    assert(is_inline(array[1]) && array[1].GetStringView().empty());
+    assert(is_inline(array[2]) && array[2].GetStringView() == longest);
+    assert(!is_inline(array[3]) && array[3].GetStringView() == longest + "y");
+    assert(is_inline(array[4]) && array[4].GetStringView() == std::string_view("a\0b", 3));
+
+    // copies and moves keep the characters, and the moved from value is null
+    JsonValue copy = array[0];
+    JsonValue moved = std::move(copy);
+    assert(copy.IsNull() && is_inline(moved) && moved == array[0]);
+    moved = JsonValue(longest + "y");
+    assert(moved == array[3]);
+    moved.Set(std::string("de"));
+    assert(is_inline(moved) && moved.GetStringView() == "de");
+
+    // a const string is read through GetStringView(); Get<std::string>() does not compile on it
+    const JsonValue &const_moved = moved;
+    static_assert(!HasConstStringGetter<JsonValue>::value);
+    assert(const_moved.GetStringView() == "de" && is_inline(moved));
+
+    // the non-const Get<std::string>() moves the string to the heap
+    std::string &str = moved.Get<std::string>();
+    assert(!is_inline(moved) && str == "de");
+    str += " and more";
+    assert(const_moved.GetStringView() == "de and more");
+
+    // short strings of a document are not copied into the arena
+    JsonDocument doc;
+    assert(doc.Parse(R"({"code": "JP"})").empty());
+    assert(is_inline(doc.Root().Get<JsonObject>().find("code")->second));
+}
+
 void TestArray() {
     struct TestData {
         std::string input;
@@ -123,6 +226,1387 @@ void TestObject() {
     }
 }
 
+void TestContiguousInput() {
+    // strings and backslash runs that cross the 64-byte blocks of the structural index
+    std::string escapes = "\"" + std::string(62, 'a') + "\\\\\\\"\\\"" + std::string(70, 'b') + "\"";
+    std::string inputs[] = {
+        R"({"name": "tom", "tags": ["a", "b\"c", [], {}], "age": 99.0, "ok": true, "ng": false, "x": null})",
+        "[" + escapes + ", " + escapes + "]",
+        "\n\n  [\n" + std::string(100, ' ') + "1,\t\"" + std::string(200, '{') + "\"\r\n]",
+        "[1 2]",
+        "[\"abc",
+        "{\"a\": 1,\n \"b\" 2}",
+        "[12x]",
+        "[\"\\\n\"]",
+        "{\n        \"indent\": [\n                1\n        ]\n}",
+    };
+
+    for (const auto &input : inputs) {
+        JsonValue expected;
+        std::string expected_error;
+        ParseJson(input.begin(), input.end(), expected, &expected_error);
+
+        JsonValue v;
+        std::string error = ParseJson(input, v);
+        assert(error == expected_error);
+        assert(v == expected);
+
+        // generic iterator input over the same pointers
+        JsonValue pv;
+        std::string pointer_error;
+        ParseJson<const char *>(input.data(), input.data() + input.size(), pv, &pointer_error);
+        assert(pointer_error == expected_error);
+        assert(pv == expected);
+
+        // the source the parallel and filtered parsers read through the structural index
+        StructuralIndex index;
+        if (StructuralIndex::IsSupported() && index.Build(input.data(), input.data() + input.size())) {
+            StructuralInputSource in(input.data(), input.data() + input.size(), index);
+            JsonValue iv;
+            ParseContext context(&iv);
+            error.clear();
+            _Parse(context, in, &error);
+            assert(error == expected_error);
+            assert(iv == expected);
+        }
+
+        JsonDocument doc;
+        error = doc.Parse(input);
+        assert(error == expected_error);
+        assert(!error.empty() || doc.Root() == expected);
+    }
+}
+
+void TestDocument() {
+    std::string input = R"({"name": "a name longer than the small string buffer", "tags": ["x", "y\nz"], "n": [1, 2.5, null]})";
+
+    JsonValue expected;
+    std::string error = ParseJson(input, expected);
+    assert(error.empty());
+
+    JsonDocument doc;
+    for (int i = 0; i < 2; ++i) {
+        error = doc.Parse(input);
+        assert(error.empty());
+        assert(doc.Root() == expected);
+    }
+
+    const JsonObject &object = doc.Root().Get<JsonObject>();
+    const JsonValue &name = object.find("name")->second;
+    assert(name.GetStringView() == "a name longer than the small string buffer");
+
+    // a copy owns its payload and outlives the document
+    JsonValue copy = doc.Root();
+    doc.Parse("[]");
+    assert(copy == expected);
+    assert(copy.Get<JsonObject>().find("name")->second.Get<std::string>() == "a name longer than the small string buffer");
+
+    // containers moved out of the document are copied out of its arena
+    assert(doc.Parse(input).empty());
+    JsonObject &root = doc.Root().Get<JsonObject>();
+    JsonValue tags(std::move(root["tags"].Get<JsonArray>()));
+    JsonValue moved_object;
+    moved_object.Set(std::move(root));
+    doc.Parse("[]");
+    assert(tags == expected.Get<JsonObject>().find("tags")->second);
+    assert(moved_object.Get<JsonObject>().find("name")->second == JsonValue("a name longer than the small string buffer"));
+
+    error = doc.Parse("[1, {\"a\": }]");
+    assert(!error.empty());
+}
+
+void TestBorrowedStrings() {
+    std::string input = R"(["an id", "2026-10-17T00:00:00Z", "tab\tbed", {"key": "value"}])";
+
+    JsonValue expected;
+    assert(ParseJson(input, expected).empty());
+
+    ParseOptions options;
+    options.borrow_strings = true;
+
+    auto in_input = [&input](const JsonValue &v) {
+        const char *p = v.GetStringView().data();
+        return p >= input.data() && p < input.data() + input.size();
+    };
+
+    JsonValue v;
+    assert(ParseJson(input, v, options).empty());
+    assert(v == expected);
+
+    const JsonArray &array = v.Get<JsonArray>();
+    assert(in_input(array[0]) && array[0].GetStringView() == "an id");
+    assert(in_input(array[1]));
+    // strings with escapes are unescaped into their own buffer
+    assert(!in_input(array[2]) && array[2].GetStringView() == "tab\tbed");
+    assert(in_input(array[3].Get<JsonObject>().find("key")->second));
+
+    JsonDocument doc;
+    assert(doc.Parse(input, options).empty());
+    assert(doc.Root() == expected);
+    assert(in_input(doc.Root().Get<JsonArray>()[0]));
+}
+
+void TestWrite() {
+    struct TestData {
+        std::string input;
+        std::string expected;
+    } test_data[] = {
+        {"null", "null"},
+        {"[true, false]", "[true,false]"},
+        {"[42, -7, 0.1, 1.0, 1e100, -2.5e-8]", "[42,-7,0.1,1.0,1e+100,-2.5e-08]"},
+        {R"("quote\" backslash\\ \n\t\u0001 \u3042")", "\"quote\\\" backslash\\\\ \\n\\t\\u0001 \u3042\""},
+#ifdef JSON_FLAT_OBJECT
+        {R"({"b": [], "a": {}})", R"({"b":[],"a":{}})"},
+#else
+        {R"({"b": [], "a": {}})", R"({"a":{},"b":[]})"},
+#endif
+    };
+
+    for (const auto &t : test_data) {
+        JsonValue v;
+        assert(ParseJson(t.input, v).empty());
+        std::string out = WriteJson(v);
+        assert(out == t.expected);
+
+        JsonValue reparsed;
+        assert(ParseJson(out, reparsed).empty());
+        assert(reparsed == v);
+    }
+
+    JsonValue v;
+    assert(ParseJson(R"({"name": "tom", "tags": [1, [], {}]})", v).empty());
+
+    WriteOptions options;
+    options.pretty = true;
+    options.indent = 2;
+    assert(WriteJson(v, options) == "{\n  \"name\": \"tom\",\n  \"tags\": [\n    1,\n    [],\n    {}\n  ]\n}");
+
+    // file descriptor output
+    FILE *fp = std::tmpfile();
+    {
+        FileSink sink(fileno(fp));
+        WriteJson(v, sink);
+        assert(sink.Flush());
+    }
+
+    std::rewind(fp);
+    char buf[256];
+    size_t size = std::fread(buf, 1, sizeof(buf), fp);
+    std::fclose(fp);
+    assert(std::string(buf, size) == WriteJson(v));
+}
+
+// Records the events as text so the order can be checked
+class RecordingHandler : public SaxHandler {
+  public:
+    bool OnNull() {
+        events += "null ";
+        return true;
+    }
+    bool OnBool(bool value) {
+        events += value ? "true " : "false ";
+        return true;
+    }
+    bool OnInt64(std::int64_t value) {
+        events += "i" + std::to_string(value) + " ";
+        return true;
+    }
+    bool OnDouble(double value) {
+        events += "d" + std::to_string(value) + " ";
+        return true;
+    }
+    bool OnString(std::string_view value) {
+        events += "s:" + std::string(value) + " ";
+        return true;
+    }
+    bool OnKey(std::string_view key) {
+        events += "k:" + std::string(key) + " ";
+        return key != "stop";
+    }
+    bool OnStartArray() {
+        events += "[ ";
+        return true;
+    }
+    bool OnEndArray(size_t count) {
+        events += "]" + std::to_string(count) + " ";
+        return true;
+    }
+    bool OnStartObject() {
+        events += "{ ";
+        return true;
+    }
+    bool OnEndObject(size_t count) {
+        events += "}" + std::to_string(count) + " ";
+        return true;
+    }
+
+    std::string events;
+};
+
+void TestSax() {
+    std::string input = R"({"a": [1, 2.5, "x\ty", null], "b": {}, "c": [], "d": true, "e": "plain"})";
+    std::string expected = "{ k:a [ i1 d2.500000 s:x\ty null ]4 k:b { }0 k:c [ ]0 k:d true k:e s:plain }5 ";
+
+    {
+        RecordingHandler handler;
+        std::string error = ParseSax(input, handler);
+        assert(error.empty());
+        assert(handler.events == expected);
+    }
+    {
+        RecordingHandler handler;
+        std::string error;
+        ParseSax(input.begin(), input.end(), handler, &error);
+        assert(error.empty());
+        assert(handler.events == expected);
+    }
+    {
+        CountingHandler handler;
+        std::string error = ParseSax(input, handler);
+        assert(error.empty());
+        assert(handler.nulls == 1 && handler.booleans == 1 && handler.integers == 1 && handler.numbers == 1);
+        assert(handler.strings == 2 && handler.keys == 5 && handler.arrays == 2 && handler.objects == 2);
+    }
+    {
+        ValidationHandler handler;
+        assert(ParseSax(input, handler).empty());
+        assert(!ParseSax("[1, 2", handler).empty());
+        assert(!ParseSax(R"({"a" 1})", handler).empty());
+        assert(!ParseSax(std::string(101, '[') + std::string(101, ']'), handler).empty());
+        assert(!ParseSax(std::string(101, '{'), handler).empty());
+    }
+    {
+        // a handler stops the parse by returning false
+        RecordingHandler handler;
+        assert(!ParseSax(R"({"a": 1, "stop": 2, "c": 3})", handler).empty());
+        assert(handler.events == "{ k:a i1 k:stop ");
+    }
+}
+
+void TestPushParser() {
+    std::string inputs[] = {
+        R"({"a": [1, 2.5, "x\ty", null], "b": {}, "c": [], "d": true, "e": "plain"})",
+        R"([-12.5e+3, "\u3042\ud83d\ude00", false, [[0]], {"k": {"l": "m"}}])",
+        "  123  ",
+        "\"str\"",
+    };
+
+    for (const auto &input : inputs) {
+        RecordingHandler expected;
+        assert(ParseSax(input, expected).empty());
+
+        // every split point must give the same events as parsing the whole input
+        for (size_t i = 0; i <= input.size(); ++i) {
+            RecordingHandler handler;
+            PushParser<RecordingHandler> parser(handler);
+            assert(parser.Feed(input.data(), i));
+            assert(parser.Feed(input.data() + i, input.size() - i));
+            assert(parser.Finish());
+            assert(handler.events == expected.events);
+        }
+
+        // one byte at a time
+        JsonValue v;
+        ValueBuilder builder(v);
+        PushParser<ValueBuilder> parser(builder);
+        for (char ch : input) {
+            assert(parser.Feed(&ch, 1));
+        }
+        assert(parser.Finish());
+
+        JsonValue whole;
+        assert(ParseJson(input, whole).empty());
+        assert(v == whole);
+    }
+
+    std::string invalid_inputs[] = {
+        "[1, 2",    "[1 2]",        R"({"a" 1})", "[1,]",        "tru",    "nul1",         "01x",  "1.",
+        "-",        R"("\x")",     R"("\u12")", R"("\ud800")", "[1]]",   R"({"a": 1])", "\"a\nb\"", "",
+        "[1] [2]",
+    };
+    for (const auto &input : invalid_inputs) {
+        ValidationHandler handler;
+        PushParser<ValidationHandler> parser(handler);
+        assert(!(parser.Feed(input) && parser.Finish()));
+        assert(!parser.Error().empty());
+    }
+
+    {
+        ValidationHandler handler;
+        PushParser<ValidationHandler> parser(handler);
+        assert(!parser.Feed("[\n1,\n2 3]"));
+        assert(parser.Error() == "syntax error at line 3 near: 3]");
+        assert(!parser.Feed("]"));
+    }
+    {
+        ValidationHandler handler;
+        PushParser<ValidationHandler> parser(handler);
+        assert(!parser.Feed(std::string(101, '[')));
+    }
+}
+
+void TestNdjson() {
+    std::string input;
+    std::vector<JsonValue> expected;
+    for (int i = 0; i < 1000; ++i) {
+        std::string line = i % 3 == 0 ? std::to_string(i) : R"({"id": )" + std::to_string(i) + R"(, "tags": ["a", "b\n"]})";
+        input += line + (i % 7 == 0 ? "\r\n" : "\n");
+        if (i % 100 == 0) {
+            input += "  \n";
+        }
+
+        expected.emplace_back();
+        assert(ParseJson(line, expected.back()).empty());
+    }
+
+    for (unsigned threads : {1u, 4u}) {
+        NdjsonOptions options;
+        options.threads = threads;
+        options.batch_bytes = 64;
+        options.max_batches_in_flight = 3;
+
+        std::vector<JsonValue> values;
+        assert(ParseNdjson(input, values, options).empty());
+        assert(values == expected);
+
+        // the line numbers count blank lines too
+        std::vector<size_t> lines;
+        assert(ParseNdjson(
+            input.data(), input.data() + input.size(),
+            [&](size_t line, JsonValue &, const std::string &error) {
+                assert(error.empty());
+                lines.push_back(line);
+                return true;
+            },
+            options));
+        assert(lines.size() == 1000 && lines[0] == 1 && lines[1] == 3 && lines[101] == 104);
+
+        size_t count = 0;
+        assert(!ParseNdjson(
+            input.data(), input.data() + input.size(), [&](size_t, JsonValue &, const std::string &) { return ++count < 10; },
+            options));
+        assert(count == 10);
+
+        // an exception from the callback reaches the caller once the workers are stopped
+        count = 0;
+        bool thrown = false;
+        try {
+            ParseNdjson(
+                input.data(), input.data() + input.size(),
+                [&](size_t, JsonValue &, const std::string &) {
+                    if (++count == 10) {
+                        throw std::runtime_error("stop");
+                    }
+                    return true;
+                },
+                options);
+        } catch (const std::runtime_error &) {
+            thrown = true;
+        }
+        assert(thrown && count == 10);
+#ifdef JSON_PARSE_STATS
+        // batches after the one the callback stopped in are not parsed
+        ParseStats stats;
+        options.parse.stats = &stats;
+        count = 0;
+        assert(!ParseNdjson(
+            input.data(), input.data() + input.size(), [&](size_t, JsonValue &, const std::string &) { return ++count < 10; },
+            options));
+        assert(stats.bytes < input.size() / 2);
+        options.parse.stats = nullptr;
+#endif
+
+        values.clear();
+        assert(ParseNdjson("1\n[2,\n3\n", values, options) == "syntax error at line 2 near: ");
+        assert(values.size() == 1);
+
+        values.clear();
+        assert(ParseNdjson("1\n\n2 3\n", values, options) == "syntax error at line 3 near: 3");
+    }
+}
+
+void TestParallelArray() {
+    std::string input = "[";
+    for (int i = 0; i < 20000; ++i) {
+        if (i != 0) {
+            input += ",\n";
+        }
+        switch (i % 4) {
+        case 0:
+            input += std::to_string(i);
+            break;
+        case 1:
+            input += R"("a, [b] \"c, d\" \\")";
+            break;
+        case 2:
+            input += R"({"k": [1, {"l": ","}], "m": "]"})";
+            break;
+        default:
+            input += "[[], {}, null]";
+            break;
+        }
+    }
+    input += "]";
+
+    ParseOptions parallel;
+    parallel.threads = 4;
+
+    JsonValue expected;
+    assert(ParseJson(input, expected).empty());
+
+    JsonValue v;
+    const char *end = ParseJson(input.data(), input.data() + input.size(), v, nullptr, parallel);
+    assert(end == input.data() + input.size());
+    assert(v == expected);
+    assert(v.Get<JsonArray>().size() == 20000);
+
+    // the error is the first one in the input, as in the sequential parser
+    std::string invalid = input;
+    invalid.replace(invalid.size() * 3 / 4, 0, "x");
+    invalid.replace(invalid.size() / 2, 0, "x");
+    std::string expected_error = ParseJson(invalid, v);
+    assert(!expected_error.empty());
+    assert(ParseJson(invalid, v, parallel) == expected_error);
+
+    // other values and small arrays are parsed as usual
+    for (const std::string &other : {std::string(R"({"a": [1, 2]})"), std::string("[1, 2, 3]"), std::string("[")}) {
+        JsonValue a;
+        JsonValue b;
+        assert(ParseJson(other, a) == ParseJson(other, b, parallel));
+        assert(a == b);
+    }
+}
+
+void TestParseFile() {
+    std::string input = R"({"a": [1, 2.5, "x\ty"], "b": {"c": null}})";
+    JsonValue expected;
+    assert(ParseJson(input, expected).empty());
+
+    char path[] = "/tmp/json_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(write(fd, input.data(), input.size()) == static_cast<ssize_t>(input.size()));
+    close(fd);
+
+    {
+        JsonValue v;
+        assert(ParseJsonFile(path, v).empty());
+        assert(v == expected);
+
+        ParseOptions options;
+        options.borrow_strings = true;
+        assert(ParseJsonFile(path, v, options).empty());
+        assert(v == expected);
+        // the strings are owned, since the mapping is gone
+        assert(v.Get<JsonObject>().find("a")->second.Get<JsonArray>()[2].Get<std::string>() == "x\ty");
+    }
+    {
+        fd = open(path, O_RDONLY);
+        MappedFile file;
+        std::string error;
+        assert(file.Open(fd, &error));
+        close(fd);
+        assert(std::string(file.Data(), file.Size()) == input);
+    }
+    unlink(path);
+
+    // pipes cannot be mapped and are read instead
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], input.data(), input.size()) == static_cast<ssize_t>(input.size()));
+    close(fds[1]);
+    {
+        JsonValue v;
+        assert(ParseJsonFile("/dev/fd/" + std::to_string(fds[0]), v).empty());
+        assert(v == expected);
+    }
+    close(fds[0]);
+
+    JsonValue v;
+    assert(ParseJsonFile("/nonexistent/file.json", v).find("cannot open") == 0);
+}
+
+void TestFlatObject() {
+    FlatObject<JsonValue> object{
+        {"b", JsonValue(1.0)},
+        {"a", JsonValue("x")},
+    };
+    assert(object.size() == 2);
+    assert(object.begin()->first == "b");
+    assert(object.find("a")->second == JsonValue("x"));
+    assert(object.find("c") == object.end());
+
+    // equality does not depend on the order
+    FlatObject<JsonValue> other{
+        {"a", JsonValue("x")},
+        {"b", JsonValue(1.0)},
+    };
+    assert(object == other);
+    other["b"] = JsonValue(2.0);
+    assert(object != other);
+
+    // large objects are looked up through the hash index, which follows insertions and erasures
+    for (int i = 0; i < 100; ++i) {
+        assert(object.try_emplace("key" + std::to_string(i)).second);
+        object["key" + std::to_string(i)] = JsonValue(static_cast<std::int64_t>(i));
+    }
+    assert(object.size() == 102);
+    for (int i = 0; i < 100; ++i) {
+        assert(object.find("key" + std::to_string(i))->second.Get<std::int64_t>() == i);
+        assert(!object.try_emplace("key" + std::to_string(i)).second);
+    }
+    assert(object.erase("key50") == 1);
+    assert(object.count("key50") == 0 && object.count("key51") == 1);
+    assert(object.find("a")->second == JsonValue("x"));
+
+    // the index is kept up to date by the methods that add and remove members, so const lookups only
+    // read and can run on several threads
+    const FlatObject<JsonValue> shared = object;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&shared] {
+            for (int i = 0; i < 100; ++i) {
+                assert(shared.count("key" + std::to_string(i)) == (i == 50 ? 0 : 1));
+            }
+        });
+    }
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+
+    std::pmr::monotonic_buffer_resource arena;
+    FlatObject<JsonValue> in_arena{FlatObject<JsonValue>::allocator_type(&arena)};
+    in_arena["key"] = JsonValue(true);
+    in_arena["key"] = JsonValue(false);
+    assert(in_arena.size() == 1 && in_arena.begin()->first == "key");
+
+    // keys added with a symbol table point into it
+    SymbolTable symbols;
+    FlatObject<JsonValue> interned;
+    interned.try_emplace_interned(symbols.Intern("a"), symbols);
+    interned["b"] = JsonValue(true);
+    assert(interned.find("b")->first.data() == symbols.Intern("b").data());
+    FlatObject<JsonValue> copy = interned;
+    assert(copy == interned && copy.find("b")->first.data() != symbols.Intern("b").data());
+
+#ifdef JSON_FLAT_OBJECT
+    // parsed members keep the input order and the last duplicate wins
+    JsonValue v;
+    assert(ParseJson(R"({"z": 1, "y": 2, "z": 3})", v).empty());
+    const JsonObject &parsed = v.Get<JsonObject>();
+    assert(parsed.size() == 2);
+    assert(parsed.begin()->first == "z" && parsed.begin()->second.Get<std::int64_t>() == 3);
+#endif
+}
+
+void TestSymbolTable() {
+    SymbolTable symbols;
+    ParseOptions options;
+    options.symbols = &symbols;
+
+    std::vector<JsonValue> values(100);
+    for (int i = 0; i < 100; ++i) {
+        std::string input = R"({"id": )" + std::to_string(i) + R"(, "user": {"name": "u", "id": 1}, "tags": []})";
+        JsonValue expected;
+        assert(ParseJson(input, expected).empty());
+        assert(ParseJson(input, values[i], options).empty());
+        assert(values[i] == expected);
+    }
+
+    const SymbolTable::Shape *shape = symbols.Next(symbols.Next(symbols.Root(), "id"), "user");
+    assert(shape->size == 2 && shape->key == "user" && shape->parent->key == "id");
+
+#ifdef JSON_FLAT_OBJECT
+    // one key per distinct string and one shape per distinct key sequence
+    assert(symbols.NumKeys() == 4);
+    assert(symbols.NumShapes() == 5);
+    assert(symbols.Intern("user") == "user");
+    assert(symbols.Next(symbols.Next(symbols.Root(), "id"), "user") == shape);
+
+    // the records share the key characters
+    const char *key = values[0].Get<JsonObject>().begin()->first.data();
+    assert(values[99].Get<JsonObject>().begin()->first.data() == key);
+    assert(key == symbols.Intern("id").data());
+
+    JsonDocument doc;
+    assert(doc.Parse(R"({"id": 1, "user": {}})", options).empty());
+    assert(symbols.NumKeys() == 4);
+#else
+    // a std::map copies its keys, so the parser does not intern them
+    assert(symbols.NumKeys() == 2 && symbols.NumShapes() == 2);
+#endif
+
+    // a shape with many children finds them by hash
+    for (int i = 0; i < 100; ++i) {
+        std::string name = "k" + std::to_string(i);
+        assert(symbols.Next(symbols.Root(), name)->key == name);
+    }
+    assert(symbols.Next(symbols.Root(), "k42") == symbols.Next(symbols.Root(), "k42"));
+
+    // a full table records no more shapes
+    SymbolTable small(3);
+    for (const char *name : {"a", "b", "c"}) {
+        assert(small.Next(small.Root(), name) != nullptr);
+    }
+    assert(small.Next(small.Root(), "new") == nullptr && small.Next(small.Root(), "a") != nullptr);
+
+    // and the parser adds the keys it has no shape for as it does without a table
+    options.symbols = &small;
+    for (int i = 0; i < 10; ++i) {
+        std::string input = R"({"a": 1, "b": {"c": 2, "d)" + std::to_string(i) + R"(": 3}})";
+        JsonValue expected;
+        assert(ParseJson(input, expected).empty());
+        assert(ParseJson(input, values[i], options).empty());
+        assert(values[i] == expected);
+    }
+    assert(small.NumShapes() == 3);
+}
+
+void TestLazyDocument() {
+    std::string input = R"({"id": 7, "user": {"name": "tom", "tags": ["a", "b\"c", []]}, "k/x": -1.5, "e\u0073c": true, "n": null})";
+    JsonValue expected;
+    assert(ParseJson(input, expected).empty());
+
+    LazyDocument doc;
+    assert(doc.Parse(input).empty());
+    LazyValue root = doc.Root();
+    assert(root.Type() == JsonType::kObject);
+    assert(root.Size() == 5);
+
+    JsonValue v;
+    assert(root["id"].ToValue(v) && v.Get<std::int64_t>() == 7);
+    assert(root["user"]["tags"][1].ToValue(v) && v.GetStringView() == "b\"c");
+    assert(root["user"]["tags"][2].Type() == JsonType::kArray && root["user"]["tags"][2].Size() == 0);
+    assert(root["esc"].Type() == JsonType::kBoolean);
+    assert(root["n"].Type() == JsonType::kNull && root["n"].IsValid());
+    assert(root["k/x"].Type() == JsonType::kNumber);
+    assert(root["id"].Type() == JsonType::kInteger);
+    assert(!root["missing"].IsValid() && !root["user"]["tags"][3].IsValid() && !root["id"]["x"].IsValid());
+
+    assert(root.At("/user/tags/0").ToValue(v) && v.GetStringView() == "a");
+    assert(root.At("/k~1x").ToValue(v) && v.Get<double>() == -1.5);
+    assert(root.At("").Type() == JsonType::kObject);
+    assert(!root.At("/user/tags/01").IsValid() && !root.At("user").IsValid());
+
+    std::vector<std::string> keys;
+    for (auto it = root.begin(); it != root.end(); ++it) {
+        keys.push_back(it.Key());
+    }
+    assert((keys == std::vector<std::string>{"id", "user", "k/x", "esc", "n"}));
+
+    size_t count = 0;
+    for (LazyValue tag : root["user"]["tags"]) {
+        assert(tag.IsValid());
+        ++count;
+    }
+    assert(count == 3);
+
+    assert(root.ToValue(v) && v == expected);
+    assert(root["user"].ToValue(v) && v == expected.Get<JsonObject>().find("user")->second);
+
+    // the token order is checked when parsing, the scalars when they are converted
+    for (std::string invalid : {"", "[1, 2", "[1 2]", R"({"a" 1})", "[1,]", "{,}", "[] x", "]", R"(["a)", "[}"}) {
+        assert(!doc.Parse(invalid).empty());
+        assert(!doc.Root().IsValid());
+    }
+    // numbers are typed from their text, the way ParseJson types them
+    input = "[0, -0, 12 , -1.5, 1e3, 2E-1, 9223372036854775807, -9223372036854775808, 9223372036854775808, 01, 1., -]";
+    assert(doc.Parse(input).empty());
+    std::vector<JsonType> types;
+    for (LazyValue number : doc.Root()) {
+        types.push_back(number.Type());
+    }
+    assert((types == std::vector<JsonType>{JsonType::kInteger, JsonType::kInteger, JsonType::kInteger, JsonType::kNumber,
+                                           JsonType::kNumber, JsonType::kNumber, JsonType::kInteger, JsonType::kInteger,
+                                           JsonType::kNumber, JsonType::kNull, JsonType::kNull, JsonType::kNull}));
+
+    input = "[\n1,\n2 3]";
+    assert(doc.Parse(input) == "syntax error at line 3 near: 3]");
+
+    input = R"([1x, "a\q", 2])";
+    assert(doc.Parse(input).empty());
+    assert(doc.Root()[0].Type() == JsonType::kNull);
+    assert(!doc.Root()[0].ToValue(v));
+    assert(!doc.Root()[1].ToValue(v));
+    assert(doc.Root()[2].ToValue(v) && v.Get<std::int64_t>() == 2);
+    assert(!doc.Root().ToValue(v));
+}
+
+void TestTapeDocument() {
+    std::string input = R"({"id": 7, "user": {"name": "tom", "tags": ["a", "b\"c", []]}, "x": -1.5, "e\u0073c": true, "n": null})";
+    JsonValue expected;
+    assert(ParseJson(input, expected).empty());
+
+    TapeDocument doc;
+    assert(doc.Parse(input).empty());
+    TapeValue root = doc.Root();
+    assert(root.Type() == JsonType::kObject && root.Size() == 5);
+    assert(root["id"].GetInt64() == 7 && root["id"].GetDouble() == 7.0);
+    assert(root["user"]["tags"][1].GetString() == "b\"c");
+    assert(root["user"]["tags"][2].Type() == JsonType::kArray && root["user"]["tags"][2].Size() == 0);
+    assert(root["x"].GetDouble() == -1.5);
+    assert(root["esc"].GetBool());
+    assert(root["n"].IsValid() && root["n"].Type() == JsonType::kNull);
+    assert(!root["missing"].IsValid() && !root["user"]["tags"][3].IsValid() && !root["id"]["x"].IsValid());
+
+    // the whole "user" object is skipped in one step
+    assert(root.Members().Value().Next().GetString() == "user");
+
+    std::vector<std::string> keys;
+    for (TapeObjectIterator it = root.Members(); it.Valid(); ++it) {
+        keys.emplace_back(it.Key());
+    }
+    assert((keys == std::vector<std::string>{"id", "user", "x", "esc", "n"}));
+
+    JsonValue v;
+    assert(root.ToValue(v) && v == expected);
+
+    // a string and an array of two numbers, each number taking two words
+    assert(doc.Parse(R"(["ab", [1, 2.5]])").empty());
+    assert(doc.Tape().size() == 9 && doc.Strings().size() == 7);
+    assert(doc.Root()[1].Size() == 2 && doc.Root()[1][1].GetDouble() == 2.5);
+
+    std::list<char> list_input = {'[', 't', 'r', 'u', 'e', ']'};
+    std::string error;
+    doc.Parse(list_input.begin(), list_input.end(), &error);
+    assert(error.empty() && doc.Root()[0].GetBool());
+
+    for (std::string invalid : {"", "[1, 2", R"({"a" 1})", "[1,]", R"(["a\q"])"}) {
+        assert(!doc.Parse(invalid).empty());
+        assert(!doc.Root().IsValid());
+    }
+}
+
+void TestCompactDocument() {
+    std::string input = R"({"id": 7, "user": {"name": "tom", "tags": ["a", "b\"c", []]}, "x": -1.5, "e\u0073c": true, "n": null,)"
+                        R"( "big": [140737488355327, -140737488355328, 140737488355328, -9223372036854775808, 1e308, -0.0]})";
+    JsonValue expected;
+    assert(ParseJson(input, expected).empty());
+
+    CompactDocument doc;
+    assert(doc.Parse(input).empty());
+    CompactValue root = doc.Root();
+    assert(root.Type() == JsonType::kObject && root.Size() == 6);
+    assert(root["id"].GetInt64() == 7 && root["id"].GetDouble() == 7.0);
+    assert(root["user"]["tags"][1].GetString() == "b\"c");
+    assert(root["user"]["tags"][2].Type() == JsonType::kArray && root["user"]["tags"][2].Size() == 0);
+    assert(root["x"].GetDouble() == -1.5);
+    assert(root["esc"].GetBool());
+    assert(root["n"].IsValid() && root["n"].Type() == JsonType::kNull);
+    assert(!root["missing"].IsValid() && !root["user"]["tags"][3].IsValid() && !root["id"]["x"].IsValid());
+
+    // integers that do not fit in 48 bits are boxed as pointers, and doubles keep their bits
+    CompactValue big = root["big"];
+    assert(big[0].GetInt64() == (std::int64_t(1) << 47) - 1 && big[1].GetInt64() == -(std::int64_t(1) << 47));
+    assert(big[2].GetInt64() == std::int64_t(1) << 47);
+    assert(big[3].GetInt64() == std::numeric_limits<std::int64_t>::min());
+    assert(big[4].Type() == JsonType::kNumber && big[4].GetDouble() == 1e308);
+    assert(big[5].GetDouble() == 0.0 && std::signbit(big[5].GetDouble()));
+
+    // the elements of an array are contiguous words
+    static_assert(sizeof(CompactValue) == 8);
+    assert(big.Elements().size() == 6 && big.Elements().begin() + 6 == big.Elements().end());
+    std::vector<std::string> keys;
+    for (const CompactMember &member : root.Members()) {
+        keys.emplace_back(member.Key());
+    }
+    assert((keys == std::vector<std::string>{"id", "user", "x", "esc", "n", "big"}));
+
+    JsonValue v;
+    assert(root.ToValue(v) && v == expected);
+
+    // a value converts back and forth, with every NaN stored as the same one
+    CompactDocument assigned;
+    assigned.Assign(expected);
+    assert(assigned.Root().ToValue(v) && v == expected);
+    assigned.Assign(JsonValue(JsonArray{JsonValue(-std::numeric_limits<double>::quiet_NaN()), JsonValue("s")}));
+    assert(std::isnan(assigned.Root()[0].GetDouble()) && assigned.Root()[1].GetString() == "s");
+
+    std::list<char> list_input = {'[', 't', 'r', 'u', 'e', ']'};
+    std::string error;
+    doc.Parse(list_input.begin(), list_input.end(), &error);
+    assert(error.empty() && doc.Root()[0].GetBool());
+
+    for (std::string invalid : {"", "[1, 2", R"({"a" 1})", "[1,]", R"(["a\q"])"}) {
+        assert(!doc.Parse(invalid).empty());
+        assert(!doc.Root().IsValid());
+    }
+    assert(!doc.Parse(std::string(101, '[') + std::string(101, ']')).empty());
+}
+
+// The last of repeated keys wins in every representation, as in a parsed JsonValue
+void TestDuplicateKeys() {
+    std::string input = R"({"a": 1, "b": {"a": [1, 2.5], "a": {"x": [true]}}, "a": 2, "c": [{"d": 1, "d": "e"}]})";
+    // the keys of a wide object are hashed
+    std::string wide = "{";
+    for (int i = 0; i < 20; ++i) {
+        wide += "\"k" + std::to_string(i) + "\": [" + std::to_string(i) + "], ";
+    }
+    wide += R"("k3": {"last": [null]}})";
+
+    JsonValue expected;
+    JsonValue wide_expected;
+    assert(ParseJson(input, expected).empty());
+    assert(expected.Get<JsonObject>().size() == 3);
+    assert(ParseJson(wide, wide_expected).empty());
+    JsonValue v;
+
+    TapeDocument tape;
+    assert(tape.Parse(input).empty());
+    TapeValue tape_root = tape.Root();
+    assert(tape_root.Size() == 3 && tape_root["a"].GetInt64() == 2);
+    assert(tape_root["b"].Size() == 1 && tape_root["b"]["a"]["x"][0].GetBool());
+    assert(tape_root["c"][0].Size() == 1 && tape_root["c"][0]["d"].GetString() == "e");
+    assert(tape_root.ToValue(v) && v == expected);
+    assert(tape.Parse(wide).empty() && tape.Root().Size() == 20 && tape.Root()["k3"]["last"][0].IsValid());
+    assert(tape.Root()["k19"][0].GetInt64() == 19);
+    assert(tape.Root().ToValue(v) && v == wide_expected);
+
+    CompactDocument compact;
+    assert(compact.Parse(input).empty());
+    CompactValue compact_root = compact.Root();
+    assert(compact_root.Size() == 3 && compact_root["a"].GetInt64() == 2);
+    assert(compact_root["b"].Size() == 1 && compact_root["b"]["a"]["x"][0].GetBool());
+    assert(compact_root["c"][0].Size() == 1 && compact_root["c"][0]["d"].GetString() == "e");
+    assert(compact_root.ToValue(v) && v == expected);
+    assert(compact.Parse(wide).empty() && compact.Root().Size() == 20 && compact.Root()["k3"]["last"][0].IsValid());
+    assert(compact.Root().ToValue(v) && v == wide_expected);
+
+    // a lazy document is a view of the text, which still holds every member
+    LazyDocument lazy;
+    assert(lazy.Parse(input).empty());
+    LazyValue lazy_root = lazy.Root();
+    assert(lazy_root.Size() == 4);
+    assert(lazy_root["a"].ToValue(v) && v.Get<std::int64_t>() == 2);
+    assert(lazy_root["b"]["a"]["x"][0].Type() == JsonType::kBoolean);
+    assert(lazy_root["c"][0]["d"].Type() == JsonType::kString);
+    assert(lazy_root.ToValue(v) && v == expected);
+    assert(lazy.Parse(wide).empty() && lazy.Root()["k3"]["last"].IsValid());
+}
+
+void TestSnapshot() {
+    std::string input = R"({"id": 7, "user": {"name": "tom", "tags": ["a", "b\"c", []]}, "x": -1.5, "ok": true, "n": null})";
+    JsonValue expected;
+    assert(ParseJson(input, expected).empty());
+
+    // a tape built from a value matches the one parsed from its text, up to the order of the keys
+    TapeDocument doc;
+    doc.Assign(expected);
+    JsonValue v;
+    assert(doc.Root().ToValue(v) && v == expected);
+    assert(doc.Root()["user"]["tags"][1].GetString() == "b\"c");
+
+    char path[] = "/tmp/json_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    assert(doc.Parse(input).empty());
+    assert(WriteSnapshotFile(path, doc).empty());
+    {
+        JsonSnapshot snapshot;
+        assert(snapshot.Open(path).empty());
+        TapeValue root = snapshot.Root();
+        assert(root["id"].GetInt64() == 7 && root["x"].GetDouble() == -1.5);
+        assert(root["user"]["name"].GetString() == "tom");
+        assert(root.ToValue(v) && v == expected);
+
+        // the old snapshot stays readable while a new one replaces it
+        assert(WriteSnapshotFile(path, JsonValue("replaced")).empty());
+        assert(root["user"]["name"].GetString() == "tom");
+        assert(snapshot.Open(path).empty());
+        assert(snapshot.Root().GetString() == "replaced");
+    }
+
+    // the file that replaces the old one can be read by others too
+    struct stat st;
+    assert(stat(path, &st) == 0 && (st.st_mode & 0777) == 0644);
+    assert(WriteSnapshotFile("/nonexistent/snapshot", doc).find("cannot create /nonexistent/snapshot.") == 0);
+
+    std::string bytes;
+    StringSink sink(bytes);
+    WriteSnapshot(doc, sink);
+    std::vector<std::uint64_t> aligned((bytes.size() + 7) / 8);
+    std::memcpy(aligned.data(), bytes.data(), bytes.size());
+    const char *data = reinterpret_cast<const char *>(aligned.data());
+
+    JsonSnapshot snapshot;
+    assert(snapshot.Open(data, bytes.size()).empty());
+    assert(snapshot.Root().ToValue(v) && v == expected);
+    assert(snapshot.Open(data, bytes.size() - 1) == "truncated snapshot");
+
+    // a damaged tape is rejected unless the snapshot is trusted, which only checks the extent of the root
+    std::uint64_t *tape = aligned.data() + sizeof(_SnapshotHeader) / 8;
+    size_t tape_size = doc.Tape().size();
+    std::uint64_t saved = tape[tape_size - 1];
+    tape[tape_size - 1] = _TapeWord('}', 1);
+    assert(snapshot.Open(data, bytes.size()) == "corrupt snapshot");
+    assert(snapshot.OpenTrusted(data, bytes.size()).empty());
+    tape[tape_size - 1] = saved;
+    saved = tape[1];
+    tape[1] = _TapeWord('"', doc.Strings().size() - 4);
+    assert(snapshot.Open(data, bytes.size()) == "corrupt snapshot");
+    tape[1] = _TapeWord('t', 0);
+    assert(snapshot.Open(data, bytes.size()) == "corrupt snapshot");
+    tape[1] = _TapeWord('x', 0);
+    assert(snapshot.Open(data, bytes.size()) == "corrupt snapshot");
+    tape[1] = saved;
+    saved = tape[0];
+    tape[0] = _TapeWord('{', _TapePayload(saved) + (std::uint64_t(1) << 32));
+    assert(snapshot.Open(data, bytes.size()) == "corrupt snapshot");
+    tape[0] = saved;
+    assert(snapshot.Open(data, bytes.size()).empty());
+    assert(snapshot.Open(data + 8, bytes.size() - 8) == "not a JSON snapshot");
+    assert(!snapshot.Root().IsValid());
+    assert(!snapshot.Open("/nonexistent/snapshot").empty());
+
+    unlink(path);
+}
+
+void TestFilter() {
+    JsonPointerFilter filter;
+    assert(filter.Add("/user/id") == 0);
+    assert(filter.Add("/meta/tenant") == 1);
+    assert(filter.Add("/items/1") == 2);
+    assert(filter.Add("/items/1/x") == 3);
+    assert(filter.Add("/missing") == 4);
+    assert(filter.Add("/user/id") == 0);
+    assert(filter.Add("user") == -1);
+    assert(filter.Size() == 5);
+
+    std::string input = R"({"skip": {"a": [1, "}", {"b": "\"]"}]}, "user": {"name": "x", "id": 42},)"
+                        R"( "items": [true, {"x": "y"}, null], "meta": {"tenant": ["t", 1.5]}})";
+    std::vector<JsonFilterMatch> matches;
+    assert(ParseJsonFiltered(input, filter, matches).empty());
+    assert(matches.size() == 5);
+    assert(matches[0].found && matches[0].value.Get<std::int64_t>() == 42);
+    assert(matches[1].found && matches[1].value.Get<JsonArray>().size() == 2);
+    assert(matches[2].found && matches[2].value.Is<JsonObject>());
+    assert(matches[3].found && matches[3].value.Get<std::string>() == "y");
+    assert(!matches[4].found);
+
+    // the iterator source skips with a context that only checks the input
+    std::list<char> list_input(input.begin(), input.end());
+    std::string error;
+    ParseJsonFiltered(list_input.begin(), list_input.end(), filter, matches, &error);
+    assert(error.empty() && matches[0].found && matches[0].value.Get<std::int64_t>() == 42);
+
+    JsonPointerFilter root;
+    assert(root.Add("") == 0);
+    JsonValue expected;
+    assert(ParseJson(input, expected).empty());
+    assert(ParseJsonFiltered(input, root, matches).empty() && matches[0].value == expected);
+
+    // a pointer through a scalar matches nothing, and an index token is also a key
+    assert(ParseJsonFiltered(R"({"user": 1, "items": {"1": 2}})", filter, matches).empty());
+    assert(!matches[0].found && matches[2].found && matches[2].value.Get<std::int64_t>() == 2);
+
+    assert(!ParseJsonFiltered(R"({"user": {"id": 1x}})", filter, matches).empty());
+    assert(!ParseJsonFiltered(R"({"skip": ], "user": {}})", filter, matches).empty());
+    assert(!ParseJsonFiltered(R"({"skip": [1, 2)", filter, matches).empty());
+    assert(!ParseJsonFiltered(R"({"skip": ")", filter, matches).empty());
+
+    // skipped values are checked on every source, unless the bracket count is asked for
+    ParseOptions unchecked;
+    unchecked.skip_unchecked = true;
+    for (std::string invalid : {R"({"a": 1, "b": [1 2 tru]})", R"({"b": {"x" 1}})"}) {
+        assert(!ParseJsonFiltered(invalid, filter, matches).empty());
+        std::list<char> invalid_list(invalid.begin(), invalid.end());
+        ParseJsonFiltered(invalid_list.begin(), invalid_list.end(), filter, matches, &error);
+        assert(!error.empty());
+        if (StructuralIndex::IsSupported()) {
+            assert(ParseJsonFiltered(invalid, filter, matches, unchecked).empty());
+        }
+    }
+}
+
+struct BoundAddress {
+    std::string city;
+    std::optional<std::int32_t> zip;
+};
+
+struct BoundUser {
+    std::int64_t id = 0;
+    std::string name;
+    double score = 0;
+    bool active = false;
+    std::vector<std::string> tags;
+    std::vector<BoundAddress> addresses;
+    std::optional<BoundAddress> home;
+    std::uint8_t level = 0;
+    JsonValue extra;
+};
+
+void TestDepth() {
+    auto nested = [](size_t depth, const char *open, const char *close) {
+        std::string input;
+        for (size_t i = 0; i < depth; ++i) {
+            input += open;
+        }
+        input += "1";
+        for (size_t i = 0; i < depth; ++i) {
+            input += close;
+        }
+        return input;
+    };
+
+    JsonValue v;
+    assert(ParseJson(nested(100, "[", "]"), v).empty());
+    assert(!ParseJson(nested(101, "[", "]"), v).empty());
+    // objects count towards the depth too
+    assert(ParseJson(nested(100, R"({"a":)", "}"), v).empty());
+    assert(!ParseJson(nested(101, R"({"a":)", "}"), v).empty());
+    assert(ParseJson(nested(50, R"({"a":[)", "]}"), v).empty());
+    assert(!ParseJson(nested(51, R"({"a":[)", "]}"), v).empty());
+
+    // far deeper than recursion could go
+    ParseOptions options;
+    options.max_depth = 100000;
+    std::string input = nested(50000, R"([{"a":)", "}]");
+    assert(ParseJson(input, v, options).empty());
+    assert(v.Get<JsonArray>()[0].Get<JsonObject>().size() == 1);
+    assert(!ParseJson(nested(100001, "[", "]"), v, options).empty());
+
+    JsonDocument doc;
+    assert(doc.Parse(nested(1000, "[", "]"), options).empty());
+
+    // and copied, compared, written and converted without recursion
+    assert(ParseJson(input, v, options).empty());
+    JsonValue copy = v;
+    assert(copy == v);
+    copy.Get<JsonArray>()[0].Get<JsonObject>()["a"] = JsonValue(2.0);
+    assert(!(copy == v));
+    assert(WriteJson(v) == input);
+    assert(!WriteJson(v, WriteOptions{true, 0}).empty());
+
+    TapeDocument tape;
+    tape.Assign(v);
+    JsonValue from_tape;
+    assert(tape.Root().ToValue(from_tape) && from_tape == v);
+
+    CompactDocument compact;
+    compact.Assign(v);
+    JsonValue from_compact;
+    assert(compact.Root().ToValue(from_compact) && from_compact == v);
+
+    JsonValue decoded;
+    assert(ParseCbor(WriteCbor(v), decoded, options).empty() && decoded == v);
+    assert(ParseMessagePack(WriteMessagePack(v), decoded, options).empty() && decoded == v);
+
+    // a value nested this deep is also freed without recursion
+    v = JsonValue();
+}
+
+void TestUtf8() {
+    assert(ValidateUtf8("") == 0);
+    assert(ValidateUtf8("abc \xc3\xa9 \xe3\x81\x82 \xf0\x9f\x98\x80") == 15);
+    // a stray continuation byte, an overlong form, a surrogate, a code point above U+10FFFF, a cut off sequence
+    assert(ValidateUtf8("ab\x80") == 2);
+    assert(ValidateUtf8("ab\xc0\xaf") == 2);
+    assert(ValidateUtf8("\xed\xa0\x80") == 0);
+    assert(ValidateUtf8("\xf4\x90\x80\x80") == 0);
+    assert(ValidateUtf8("\xe3\x81") == 0);
+
+    // long enough for the SIMD kernels, with the error far from the start
+    std::string text;
+    for (int i = 0; i < 50; ++i) {
+        text += "abc\xce\xbb\xe3\x81\x82";
+    }
+    assert(ValidateUtf8(text) == text.size());
+    assert(ValidateUtf8(text + "\xe3\x81") == text.size());
+    assert(ValidateUtf8(text + "\xe3\x81x" + text) == text.size());
+
+    ParseOptions options;
+    options.validate_utf8 = true;
+    JsonValue v;
+    std::string valid = "{\"\xce\xbb\": [\"" + text + "\", \"a\\n\xe3\x81\x82\"]}";
+    assert(ParseJson(valid, v, options).empty());
+    assert(v.Get<JsonObject>().begin()->second.Get<JsonArray>()[0].Get<std::string>() == text);
+
+    std::vector<std::string> invalid_inputs = {"\"ab\x80\"", "\"\xc0\xaf\"", "\"\xe3\x81\"", "{\"\xff\": 1}",
+                                               "[\"" + text + "\xed\xa0\x80\"]"};
+    for (const std::string &invalid : invalid_inputs) {
+        assert(!ParseJson(invalid, v, options).empty());
+        std::list<char> list_input(invalid.begin(), invalid.end());
+        std::string error;
+        ParseJson(list_input.begin(), list_input.end(), v, &error);
+        assert(error.empty());
+        ParseContext context(&v, nullptr, nullptr, options);
+        _Parse(context, list_input.begin(), list_input.end(), &error);
+        assert(!error.empty());
+        assert(ParseJson(invalid, v).empty());
+    }
+
+    // the error gives the offset of the invalid sequence, for every source
+    std::string bad = "[\"ab\",\n \"c\xc0\xaf\"]";
+    std::string expected = "invalid UTF-8 at byte offset 10, line 2 near: \xc0\xaf\"]";
+    assert(ParseJson(bad, v, options) == expected);
+    std::list<char> bad_list(bad.begin(), bad.end());
+    std::string error;
+    ParseContext context(&v, nullptr, nullptr, options);
+    _Parse(context, bad_list.begin(), bad_list.end(), &error);
+    assert(error == expected);
+    StructuralIndex index;
+    if (StructuralIndex::IsSupported() && index.Build(bad.data(), bad.data() + bad.size())) {
+        StructuralInputSource in(bad.data(), bad.data() + bad.size(), index);
+        ParseContext indexed_context(&v, nullptr, nullptr, options);
+        error.clear();
+        _Parse(indexed_context, in, &error);
+        assert(error == expected);
+    }
+    assert(ParseJson("[\"" + text + "\xe3\x81\"]", v, options).find("at byte offset " + std::to_string(text.size() + 2)) !=
+           std::string::npos);
+
+    NdjsonOptions ndjson_options;
+    ndjson_options.threads = 1;
+    ndjson_options.parse = options;
+    std::vector<JsonValue> records;
+    assert(ParseNdjson("1\n\"\x80\"\n", records, ndjson_options).find("at byte offset 3, line 2") != std::string::npos);
+
+    options.borrow_strings = true;
+    assert(!ParseJson("[\"ab\x80\"]", v, options).empty());
+}
+
+void TestBinary() {
+    using namespace std::string_literals;
+
+    JsonValue v;
+    assert(ParseJson(R"({"id": 42, "neg": -300, "min": -9223372036854775808, "pi": 3.25, "one": 1.0, "tiny": 1e-300,
+                         "s": "héllo", "list": [null, true, false, [], {}, [[1]]],
+                         "long": "0123456789012345678901234567890123456789"})",
+                     v)
+               .empty());
+
+    // both encodings read back to the same value, integers and numbers included (== compares types)
+    JsonValue decoded;
+    assert(ParseCbor(WriteCbor(v), decoded).empty());
+    assert(decoded == v);
+    assert(ParseMessagePack(WriteMessagePack(v), decoded).empty());
+    assert(decoded == v);
+
+    // examples from RFC 8949 Appendix A
+    struct TestData {
+        std::string cbor;
+        std::string json;
+    } cbor_data[] = {
+        {std::string("\x00", 1), "0"},
+        {"\x18\x18", "24"},
+        {"\x1b\x00\x00\x00\xe8\xd4\xa5\x10\x00"s, "1000000000000"},
+        {"\x39\x03\xe7", "-1000"},
+        {"\x1b\xff\xff\xff\xff\xff\xff\xff\xff", "18446744073709551615"},
+        {"\xf9\x3e\x00"s, "1.5"},
+        {"\xf9\x7b\xff", "65504.0"},
+        {"\xfa\x47\xc3\x50\x00"s, "100000.0"},
+        {"\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a", "1.1"},
+        {"\xf5", "true"},
+        {"\xf7", "null"},
+        {"\x64IETF", "\"IETF\""},
+        {"\x83\x01\x82\x02\x03\x82\x04\x05", "[1, [2, 3], [4, 5]]"},
+        {"\xa2\x61\x61\x01\x61\x62\x82\x02\x03", R"({"a": 1, "b": [2, 3]})"},
+        {"\xc0\x74\x32\x30\x31\x33\x2d\x30\x33\x2d\x32\x31\x54\x32\x30\x3a\x30\x34\x3a\x30\x30\x5a", "\"2013-03-21T20:04:00Z\""},
+        {"\x7f\x65strea\x64ming\xff", "\"streaming\""},
+        {"\x9f\x01\x82\x02\x03\x9f\x04\x05\xff\xff", "[1, [2, 3], [4, 5]]"},
+        {"\xbf\x61\x61\x01\x61\x62\x9f\x02\x03\xff\xff", R"({"a": 1, "b": [2, 3]})"},
+    };
+    for (const auto &t : cbor_data) {
+        JsonValue expected;
+        assert(ParseJson(t.json, expected).empty());
+        assert(ParseCbor(t.cbor, decoded).empty());
+        assert(decoded == expected);
+    }
+
+    // the shortest forms
+    assert(WriteCbor(JsonValue(std::int64_t(1000))) == "\x19\x03\xe8");
+    assert(WriteCbor(JsonValue(100000.0)) == "\xfa\x47\xc3\x50\x00"s);
+    assert(WriteCbor(JsonValue(1.1)) == "\xfb\x3f\xf1\x99\x99\x99\x99\x99\x9a");
+    assert(WriteMessagePack(JsonValue(std::int64_t(127))) == "\x7f");
+    assert(WriteMessagePack(JsonValue(std::int64_t(128))) == "\xcc\x80");
+    assert(WriteMessagePack(JsonValue(std::int64_t(-32))) == "\xe0");
+    assert(WriteMessagePack(JsonValue(std::int64_t(-33))) == "\xd0\xdf");
+    assert(WriteMessagePack(JsonValue(std::int64_t(65536))) == "\xce\x00\x01\x00\x00"s);
+    assert(WriteMessagePack(JsonValue(std::numeric_limits<std::int64_t>::min())) == "\xd3\x80\x00\x00\x00\x00\x00\x00\x00"s);
+    assert(WriteMessagePack(JsonValue(1.5)) == "\xca\x3f\xc0\x00\x00"s);
+
+    assert(ParseMessagePack("\xcf\xff\xff\xff\xff\xff\xff\xff\xff", decoded).empty());
+    assert(decoded.Type() == JsonType::kNumber);
+    assert(ParseMessagePack("\xd1\xfe\xd4", decoded).empty());
+    assert(decoded == JsonValue(std::int64_t(-300)));
+    assert(ParseMessagePack("\x82\xa1\x61\xc4\x02\x01\x02\xa1\x62\x90", decoded).empty());
+    assert(WriteJson(decoded) == "{\"a\":\"\\u0001\\u0002\",\"b\":[]}");
+
+    // a stream of items is read one at a time
+    std::string stream = WriteCbor(JsonValue(std::int64_t(1))) + WriteCbor(JsonValue("two"));
+    const char *end = stream.data() + stream.size();
+    std::string error;
+    const char *p = ParseCbor(stream.data(), end, decoded, &error);
+    assert(error.empty() && decoded == JsonValue(std::int64_t(1)));
+    p = ParseCbor(p, end, decoded, &error);
+    assert(error.empty() && decoded == JsonValue("two") && p == end);
+
+    std::string appended = "x";
+    StringSink sink(appended);
+    WriteMessagePack(JsonValue("y"), sink);
+    assert(appended == "x\xa1y");
+
+    // strings and byte strings point into the input
+    ParseOptions options;
+    options.borrow_strings = true;
+    std::string input = "\x82\x63\x61\x62\x63\x42\x01\x02";
+    assert(ParseCbor(input, decoded, options).empty());
+    assert(decoded.Get<JsonArray>()[0].GetStringView().data() == input.data() + 2);
+    assert(decoded.Get<JsonArray>()[1].GetStringView().data() == input.data() + 6);
+
+    // text strings must be UTF-8 when validated, byte strings need not be
+    options.validate_utf8 = true;
+    assert(!ParseCbor("\x62\xc0\xaf", decoded, options).empty());
+    assert(ParseCbor("\x42\xc0\xaf", decoded, options).empty());
+    assert(ParseMessagePack("\x81\xa1\xff\x01", decoded, options) == "invalid UTF-8 in MessagePack at offset 2");
+    assert(ParseCbor("\x82\x01\x62\x61\xc0", decoded, options) == "invalid UTF-8 in CBOR at offset 4");
+
+    assert(ParseCbor("\x82\x01\xf8", decoded) == "invalid CBOR at offset 3");
+    std::string invalid_cbor[] = {
+        "", "\x1c", "\x3f", "\xff", "\x9b\xff\xff\xff\xff\xff\xff\xff\xff", "\xa1\x01\x02", "\x82\x01\xff", "\x5f\x61\x61\xff",
+        "\xf8\x20", "\xc0",
+    };
+    for (const std::string &invalid : invalid_cbor) {
+        assert(!ParseCbor(invalid, decoded).empty());
+    }
+    std::string invalid_msgpack[] = {"", "\xc1", "\xd4\x01\x02", "\x92\x01", "\xdd\xff\xff\xff\xff", "\x81\x01\x02", "\xa3" "ab"};
+    for (const std::string &invalid : invalid_msgpack) {
+        assert(!ParseMessagePack(invalid, decoded).empty());
+    }
+
+    // deep nesting is limited by max_depth and does not recurse
+    std::string deep(1000, '\x81');
+    deep.push_back('\x00');
+    assert(!ParseCbor(deep, decoded).empty());
+    options = ParseOptions();
+    options.max_depth = 1000;
+    assert(ParseCbor(deep, decoded, options).empty());
+}
+
+void TestParseStats() {
+#ifdef JSON_PARSE_STATS
+    std::string input = R"({"a":[1,2.5,"x\n",true,null],"b\u0041":{"c":"a string longer than sso"}, "d": []})";
+    ParseStats stats;
+    ParseOptions options;
+    options.stats = &stats;
+    JsonValue v;
+    assert(ParseJson(input, v, options).empty());
+    assert(stats.bytes == input.size());
+    assert(stats.Values(JsonType::kObject) == 2 && stats.Values(JsonType::kArray) == 2);
+    assert(stats.Values(JsonType::kInteger) == 1 && stats.Values(JsonType::kNumber) == 1);
+    assert(stats.Values(JsonType::kString) == 2 && stats.Values(JsonType::kBoolean) == 1);
+    assert(stats.Values(JsonType::kNull) == 1);
+    assert(stats.escaped_strings == 2);
+    assert(stats.max_depth == 2);
+    assert(stats.estimated_allocations > 0 && stats.estimated_bytes > 0);
+
+    // the counts add up over parses, and borrowed strings are not allocated
+    ParseStats copied = stats;
+    options.borrow_strings = true;
+    assert(ParseJson(input, v, options).empty());
+    assert(stats.Values(JsonType::kString) == 4 && stats.bytes == 2 * input.size());
+    assert(stats.estimated_allocations - copied.estimated_allocations < copied.estimated_allocations);
+
+    // strings in an arena
+    ParseStats arena_stats;
+    options = ParseOptions();
+    options.stats = &arena_stats;
+    JsonDocument doc;
+    assert(doc.Parse(input, options).empty());
+    assert(arena_stats.Values(JsonType::kString) == 2 && arena_stats.escaped_strings == 2);
+    assert(arena_stats.estimated_allocations > 0);
+
+    // the slices of a parallel parse are counted as one array
+    std::string numbers = "[";
+    for (int i = 0; i < 50000; ++i) {
+        numbers += i == 0 ? "[" : ",[";
+        numbers += std::to_string(i) + "]";
+    }
+    numbers += "]";
+    ParseStats parallel_stats;
+    options.threads = 4;
+    options.stats = &parallel_stats;
+    assert(ParseJson(numbers, v, options).empty());
+    assert(parallel_stats.Values(JsonType::kArray) == 50001);
+    assert(parallel_stats.Values(JsonType::kInteger) == 50000);
+    assert(parallel_stats.max_depth == 2);
+
+    // NDJSON workers count on their own
+    ParseStats ndjson_stats;
+    NdjsonOptions ndjson_options;
+    ndjson_options.threads = 2;
+    ndjson_options.parse.stats = &ndjson_stats;
+    std::vector<JsonValue> records;
+    assert(ParseNdjson("{\"a\": 1}\n[2, 3]\n\"x\"\n", records, ndjson_options).empty());
+    assert(ndjson_stats.Values(JsonType::kInteger) == 3 && ndjson_stats.Values(JsonType::kString) == 1);
+
+    // generic sources count values but cannot see escapes
+    ParseStats list_stats;
+    options = ParseOptions();
+    options.stats = &list_stats;
+    std::list<char> list_input(input.begin(), input.end());
+    ParseContext context(&v, nullptr, nullptr, options);
+    assert(_Parse(context, list_input.begin(), list_input.end(), nullptr) == list_input.end());
+    assert(list_stats.Values(JsonType::kString) == 2 && list_stats.escaped_strings == 0 && list_stats.bytes == 0);
+#endif
+}
+
+} // namespace
+
+template <>
+struct JsonBinding<BoundAddress> {
+    static constexpr auto kFields = JsonFields(JsonField("city", &BoundAddress::city), JsonField("zip", &BoundAddress::zip));
+};
+
+template <>
+struct JsonBinding<BoundUser> {
+    static constexpr auto kFields =
+        JsonFields(JsonField("id", &BoundUser::id), JsonField("name", &BoundUser::name), JsonField("score", &BoundUser::score),
+                   JsonField("active", &BoundUser::active), JsonField("tags", &BoundUser::tags),
+                   JsonField("addresses", &BoundUser::addresses), JsonField("home", &BoundUser::home),
+                   JsonField("level", &BoundUser::level), JsonField("extra", &BoundUser::extra));
+};
+
+namespace {
+
+void TestBind() {
+    static_assert(JsonBinding<BoundUser>::kFields.Find("score") == 2);
+    static_assert(JsonBinding<BoundUser>::kFields.Find("scor") == 9);
+
+    std::string input = R"({"id": 42, "name": "t\u00f6m", "unknown": {"a": [1, {}]}, "score": 3, "active": true,)"
+                        R"( "tags": ["a", "b"], "addresses": [{"city": "x", "zip": 123}, {"city": "y", "zip": null}],)"
+                        R"( "home": {"city": "z"}, "level": 255, "extra": [null, {"k": 1.5}]})";
+    BoundUser user;
+    assert(ParseJsonInto(input, user).empty());
+    assert(user.id == 42 && user.name == "t\xc3\xb6m" && user.score == 3.0 && user.active);
+    assert((user.tags == std::vector<std::string>{"a", "b"}));
+    assert(user.addresses.size() == 2 && user.addresses[0].city == "x" && user.addresses[0].zip == 123);
+    assert(user.addresses[1].city == "y" && !user.addresses[1].zip);
+    assert(user.home && user.home->city == "z" && !user.home->zip);
+    assert(user.level == 255);
+    assert(user.extra.Get<JsonArray>().size() == 2);
+
+    std::list<char> list_input(input.begin(), input.end());
+    BoundUser list_user;
+    std::string error;
+    ParseJsonInto(list_input.begin(), list_input.end(), list_user, &error);
+    assert(error.empty() && list_user.name == user.name && list_user.addresses.size() == 2);
+
+    std::vector<std::int16_t> numbers;
+    assert(ParseJsonInto("[1, -2, 32767]", numbers).empty());
+    assert((numbers == std::vector<std::int16_t>{1, -2, 32767}));
+
+    // wrong types and values out of range are errors
+    for (std::string invalid : {R"({"id": "1"})", R"({"id": 1.5})", R"({"name": null})", R"({"level": 256})",
+                                R"({"level": -1})", R"({"tags": "a"})", R"({"home": []})", "[]", R"({"id": 1)"}) {
+        BoundUser u;
+        assert(!ParseJsonInto(invalid, u).empty());
+    }
+    assert(!ParseJsonInto("[32768]", numbers).empty());
+}
+
 } // namespace
 
 int main() {
@@ -130,9 +1614,33 @@ int main() {
     TestBoolean();
     TestNumber();
     TestInteger();
+    TestInvalidNumber();
     TestString();
+    TestInlineString();
     TestArray();
     TestObject();
+    TestContiguousInput();
+    TestDocument();
+    TestBorrowedStrings();
+    TestWrite();
+    TestSax();
+    TestPushParser();
+    TestNdjson();
+    TestParallelArray();
+    TestParseFile();
+    TestFlatObject();
+    TestSymbolTable();
+    TestLazyDocument();
+    TestTapeDocument();
+    TestCompactDocument();
+    TestDuplicateKeys();
+    TestSnapshot();
+    TestFilter();
+    TestBind();
+    TestDepth();
+    TestUtf8();
+    TestBinary();
+    TestParseStats();
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define JSON_UTF8_VALIDATOR_X86 1
+#endif
+
+// RFC 3629 UTF-8. For a lead byte, sets the number of continuation bytes and the range of the
+// first one, which excludes overlong forms, surrogates and code points above U+10FFFF. Returns
+// false for a byte that cannot start a sequence.
+inline bool _Utf8SequenceBounds(unsigned char lead, int &length, unsigned char &low, unsigned char &high) {
+    low = 0x80;
+    high = 0xbf;
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        length = 1;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+        length = 2;
+        if (lead == 0xe0) {
+            low = 0xa0;
+        } else if (lead == 0xed) {
+            high = 0x9f;
+        }
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+        length = 3;
+        if (lead == 0xf0) {
+            low = 0x90;
+        } else if (lead == 0xf4) {
+            high = 0x8f;
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Returns the start of the first sequence in [p, end) that is not valid UTF-8, or end
+inline const char *_FindInvalidUtf8Scalar(const char *p, const char *end) {
+    while (p != end) {
+        unsigned char lead = static_cast<unsigned char>(*p);
+        if (lead < 0x80) {
+            ++p;
+            continue;
+        }
+
+        int length;
+        unsigned char low, high;
+        if (!_Utf8SequenceBounds(lead, length, low, high) || end - p <= length) {
+            return p;
+        }
+
+        unsigned char first = static_cast<unsigned char>(p[1]);
+        if (first < low || first > high) {
+            return p;
+        }
+        for (int i = 2; i <= length; ++i) {
+            if ((static_cast<unsigned char>(p[i]) & 0xc0) != 0x80) {
+                return p;
+            }
+        }
+        p += length + 1;
+    }
+
+    return end;
+}
+
+#ifdef JSON_UTF8_VALIDATOR_X86
+// The lookup algorithm of Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per
+// Byte". Each pair of adjacent bytes is classified through three 16-entry tables indexed by the
+// high nibble of the first byte, its low nibble and the high nibble of the second byte; a bit set
+// in all three is an error. Third and fourth bytes of a sequence are checked against the leads two
+// and three bytes back.
+enum : std::uint8_t {
+    kUtf8TooShort = 1 << 0,
+    kUtf8TooLong = 1 << 1,
+    kUtf8Overlong3 = 1 << 2,
+    kUtf8TooLarge = 1 << 3,
+    kUtf8Surrogate = 1 << 4,
+    kUtf8Overlong2 = 1 << 5,
+    kUtf8TooLarge1000 = 1 << 6,
+    kUtf8Overlong4 = 1 << 6,
+    kUtf8TwoConts = 1 << 7,
+    kUtf8Carry = kUtf8TooShort | kUtf8TooLong | kUtf8TwoConts,
+};
+
+alignas(16) constexpr std::uint8_t kUtf8Byte1High[16] = {
+    kUtf8TooLong, kUtf8TooLong, kUtf8TooLong, kUtf8TooLong, kUtf8TooLong, kUtf8TooLong, kUtf8TooLong, kUtf8TooLong,
+    kUtf8TwoConts, kUtf8TwoConts, kUtf8TwoConts, kUtf8TwoConts, kUtf8TooShort | kUtf8Overlong2, kUtf8TooShort,
+    kUtf8TooShort | kUtf8Overlong3 | kUtf8Surrogate, kUtf8TooShort | kUtf8TooLarge | kUtf8TooLarge1000 | kUtf8Overlong4,
+};
+
+alignas(16) constexpr std::uint8_t kUtf8Byte1Low[16] = {
+    kUtf8Carry | kUtf8Overlong3 | kUtf8Overlong2 | kUtf8Overlong4,
+    kUtf8Carry | kUtf8Overlong2,
+    kUtf8Carry,
+    kUtf8Carry,
+    kUtf8Carry | kUtf8TooLarge,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000 | kUtf8Surrogate,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000,
+    kUtf8Carry | kUtf8TooLarge | kUtf8TooLarge1000,
+};
+
+alignas(16) constexpr std::uint8_t kUtf8Byte2High[16] = {
+    kUtf8TooShort, kUtf8TooShort, kUtf8TooShort, kUtf8TooShort, kUtf8TooShort, kUtf8TooShort, kUtf8TooShort, kUtf8TooShort,
+    kUtf8TooLong | kUtf8Overlong2 | kUtf8TwoConts | kUtf8Overlong3 | kUtf8TooLarge1000 | kUtf8Overlong4,
+    kUtf8TooLong | kUtf8Overlong2 | kUtf8TwoConts | kUtf8Overlong3 | kUtf8TooLarge,
+    kUtf8TooLong | kUtf8Overlong2 | kUtf8TwoConts | kUtf8Surrogate | kUtf8TooLarge,
+    kUtf8TooLong | kUtf8Overlong2 | kUtf8TwoConts | kUtf8Surrogate | kUtf8TooLarge,
+    kUtf8TooShort, kUtf8TooShort, kUtf8TooShort, kUtf8TooShort,
+};
+
+// Blocks that are all ASCII skip the tables. The scalar validator finishes the input from the last
+// block boundary that is not inside a sequence, which also pins down the first error.
+__attribute__((target("avx2"))) inline const char *_FindInvalidUtf8Avx2(const char *p, const char *end) {
+    const __m256i byte_1_high = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(kUtf8Byte1High)));
+    const __m256i byte_1_low = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(kUtf8Byte1Low)));
+    const __m256i byte_2_high = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(kUtf8Byte2High)));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    // a lead byte this close to the end of a block continues into the next one
+    const __m256i max_tail = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                              -1, -1, -1, -1, -1, -1, -1, -1, -1, static_cast<char>(0xf0 - 1),
+                                              static_cast<char>(0xe0 - 1), static_cast<char>(0xc0 - 1));
+
+    const char *boundary = p;
+    __m256i prev = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    for (; end - p >= 32; p += 32) {
+        __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        if (_mm256_movemask_epi8(input) == 0) {
+            if (!_mm256_testz_si256(prev_incomplete, prev_incomplete)) {
+                break;
+            }
+        } else {
+            __m256i shifted = _mm256_permute2x128_si256(prev, input, 0x21);
+            __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+            __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+            __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+            __m256i special = _mm256_and_si256(
+                _mm256_and_si256(_mm256_shuffle_epi8(byte_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                                 _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1, nibble))),
+                _mm256_shuffle_epi8(byte_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+            __m256i must_continue = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80)),
+                                                    _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xf0 - 0x80)));
+            __m256i error = _mm256_xor_si256(_mm256_and_si256(must_continue, _mm256_set1_epi8(static_cast<char>(0x80))), special);
+            if (!_mm256_testz_si256(error, error)) {
+                break;
+            }
+        }
+
+        prev = input;
+        prev_incomplete = _mm256_subs_epu8(input, max_tail);
+        if (_mm256_testz_si256(prev_incomplete, prev_incomplete)) {
+            boundary = p + 32;
+        }
+    }
+
+    return _FindInvalidUtf8Scalar(boundary, end);
+}
+
+__attribute__((target("sse4.2"))) inline const char *_FindInvalidUtf8Sse42(const char *p, const char *end) {
+    const __m128i byte_1_high = _mm_load_si128(reinterpret_cast<const __m128i *>(kUtf8Byte1High));
+    const __m128i byte_1_low = _mm_load_si128(reinterpret_cast<const __m128i *>(kUtf8Byte1Low));
+    const __m128i byte_2_high = _mm_load_si128(reinterpret_cast<const __m128i *>(kUtf8Byte2High));
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i max_tail = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, static_cast<char>(0xf0 - 1),
+                                           static_cast<char>(0xe0 - 1), static_cast<char>(0xc0 - 1));
+
+    const char *boundary = p;
+    __m128i prev = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    for (; end - p >= 16; p += 16) {
+        __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        if (_mm_movemask_epi8(input) == 0) {
+            if (!_mm_testz_si128(prev_incomplete, prev_incomplete)) {
+                break;
+            }
+        } else {
+            __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+            __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+            __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+
+            __m128i special =
+                _mm_and_si128(_mm_and_si128(_mm_shuffle_epi8(byte_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                                            _mm_shuffle_epi8(byte_1_low, _mm_and_si128(prev1, nibble))),
+                              _mm_shuffle_epi8(byte_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+            __m128i must_continue = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80)),
+                                                 _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80)));
+            __m128i error = _mm_xor_si128(_mm_and_si128(must_continue, _mm_set1_epi8(static_cast<char>(0x80))), special);
+            if (!_mm_testz_si128(error, error)) {
+                break;
+            }
+        }
+
+        prev = input;
+        prev_incomplete = _mm_subs_epu8(input, max_tail);
+        if (_mm_testz_si128(prev_incomplete, prev_incomplete)) {
+            boundary = p + 16;
+        }
+    }
+
+    return _FindInvalidUtf8Scalar(boundary, end);
+}
+#endif
+
+using _FindInvalidUtf8Func = const char *(*)(const char *, const char *);
+
+inline _FindInvalidUtf8Func _SelectUtf8Kernel() {
+#ifdef JSON_UTF8_VALIDATOR_X86
+    static const _FindInvalidUtf8Func kernel = []() -> _FindInvalidUtf8Func {
+        if (__builtin_cpu_supports("avx2")) {
+            return _FindInvalidUtf8Avx2;
+        }
+        if (__builtin_cpu_supports("sse4.2")) {
+            return _FindInvalidUtf8Sse42;
+        }
+        return _FindInvalidUtf8Scalar;
+    }();
+    return kernel;
+#else
+    return _FindInvalidUtf8Scalar;
+#endif
+}
+
+// Returns the start of the first sequence in [p, end) that is not valid UTF-8, or end
+inline const char *_FindInvalidUtf8(const char *p, const char *end) {
+    return _SelectUtf8Kernel()(p, end);
+}
+
+// Returns the offset of the first byte of the first invalid UTF-8 sequence, or data.size() when all
+// of data is valid
+inline size_t ValidateUtf8(std::string_view data) {
+    return static_cast<size_t>(_FindInvalidUtf8(data.data(), data.data() + data.size()) - data.data());
+}